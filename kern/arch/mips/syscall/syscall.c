@@ -124,6 +124,11 @@ syscall(struct trapframe *tf)
 			err = sys___time(	(userptr_t)tf->tf_a0,
 				 				(userptr_t)tf->tf_a1);
 		break;
+
+	    case SYS_nanosleep:
+			err = sys_nanosleep(	(userptr_t)tf->tf_a0,
+						(userptr_t)tf->tf_a1);
+		break;
 		/* Added for Assginment 4: Filesystem Calls */
 		case SYS___getcwd:
 			err = sys___getcwd(	(userptr_t)tf->tf_a0, 
@@ -157,6 +162,38 @@ syscall(struct trapframe *tf)
 							 	tf->tf_a2,
 							 	&retval);
 		break;
+		case SYS_pread:
+			err = sys_pread(	tf->tf_a0,
+								(userptr_t)tf->tf_a1,
+								tf->tf_a2,
+								tf->tf_sp,
+								&retval);
+		break;
+		case SYS_pwrite:
+			err = sys_pwrite(	tf->tf_a0,
+								(userptr_t)tf->tf_a1,
+								tf->tf_a2,
+								tf->tf_sp,
+								&retval);
+		break;
+		case SYS_readv:
+			err = sys_readv(	tf->tf_a0,
+								(userptr_t)tf->tf_a1,
+								tf->tf_a2,
+								&retval);
+		break;
+		case SYS_writev:
+			err = sys_writev(	tf->tf_a0,
+								(userptr_t)tf->tf_a1,
+								tf->tf_a2,
+								&retval);
+		break;
+		case SYS_copy_file_range:
+			err = sys_copy_file_range(	tf->tf_a0,
+								tf->tf_a1,
+								tf->tf_a2,
+								&retval);
+		break;
 		case SYS_close: 
 			err = sys_close(	tf->tf_a0);
 		break;
@@ -165,6 +202,46 @@ syscall(struct trapframe *tf)
 								tf->tf_a1,
 								&retval);
 		break;
+		case SYS_fstat:
+			err = sys_fstat(	tf->tf_a0,
+								(userptr_t)tf->tf_a1);
+		break;
+		case SYS_getdirentry:
+			err = sys_getdirentry(	tf->tf_a0,
+								(userptr_t)tf->tf_a1,
+								tf->tf_a2,
+								&retval);
+		break;
+		case SYS_getdirentries:
+			err = sys_getdirentries(	tf->tf_a0,
+								(userptr_t)tf->tf_a1,
+								tf->tf_a2,
+								&retval);
+		break;
+		case SYS_mkdir:
+			err = sys_mkdir(	(userptr_t)tf->tf_a0,
+								tf->tf_a1);
+		break;
+		case SYS_rmdir:
+			err = sys_rmdir(	(userptr_t)tf->tf_a0);
+		break;
+		case SYS_remove:
+			err = sys_remove(	(userptr_t)tf->tf_a0);
+		break;
+		case SYS_rename:
+			err = sys_rename(	(userptr_t)tf->tf_a0,
+								(userptr_t)tf->tf_a1);
+		break;
+		case SYS_pipe:
+			err = sys_pipe(		(userptr_t)tf->tf_a0,
+								&retval);
+		break;
+		case SYS_poll:
+			err = sys_poll(		(userptr_t)tf->tf_a0,
+								tf->tf_a1,
+								tf->tf_a2,
+								&retval);
+		break;
 		case SYS_fork:
 			err = sys_fork(		tf, // tf
 								&retval);
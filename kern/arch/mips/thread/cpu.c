@@ -221,6 +221,18 @@ cpu_irqoff(void)
         SET_STATUS(x);
 }
 
+/*
+ * Cycle counter (coprocessor 0 register 9).
+ */
+uint32_t
+cpu_cycles(void)
+{
+	uint32_t count;
+
+	__asm volatile("mfc0 %0,$9" : "=r" (count));
+	return count;
+}
+
 /*
  * Used below.
  */
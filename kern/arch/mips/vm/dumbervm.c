@@ -19,6 +19,8 @@
 #include <proctable.h>
 #include <kern/swapspace.h>
 #include <cpu.h>
+#include <kmalloc_tag.h>
+#include <workqueue.h>
 
 
 /**
@@ -333,10 +335,105 @@ getppages(unsigned long npages)
 
 }
 
+/*
+ * Pool of pre-zeroed pages.
+ *
+ * Every page alloc_kpages hands out is zeroed, and doing that inline
+ * puts a page worth of stores on the path of every page fault, page
+ * table and kmalloc slab. Instead, single-page allocations are served
+ * from a small pool of pages that a workqueue item keeps zeroed and
+ * topped up in the background. The pool is only refilled while there
+ * is plenty of free memory, so it never competes with swapping.
+ *
+ * Pages in the pool are allocated as far as the bitmap is concerned.
+ */
+#define ZEROPAGE_POOL_MAX	8	/* pages kept zeroed */
+#define ZEROPAGE_POOL_LOW	2	/* refill when down to this many */
+#define ZEROPAGE_RESERVE	32	/* free pages to leave when refilling */
+
+static vaddr_t zeropages[ZEROPAGE_POOL_MAX];
+static unsigned num_zeropages = 0;
+static struct spinlock zeropage_lock = SPINLOCK_INITIALIZER;
+
+static void zeropage_refill(void *junk);
+static struct work zeropage_work = WORK_INITIALIZER(zeropage_refill, NULL);
+
+static
+void
+zeropage_refill(void *junk)
+{
+	paddr_t pa;
+	vaddr_t va;
+	bool full;
+
+	(void)junk;
+
+	if (dumbervm.kern_lk == NULL) {
+		return;
+	}
+
+	spinlock_acquire(&zeropage_lock);
+	full = num_zeropages == ZEROPAGE_POOL_MAX;
+	spinlock_release(&zeropage_lock);
+	while (!full) {
+		lock_acquire(dumbervm.kern_lk);
+		if (dumbervm.n_ppages_allocated + ZEROPAGE_RESERVE >=
+		    dumbervm.n_ppages) {
+			lock_release(dumbervm.kern_lk);
+			return;
+		}
+		pa = getppages(1);
+		lock_release(dumbervm.kern_lk);
+		if (pa == 0) {
+			return;
+		}
+
+		va = PADDR_TO_KSEG0_VADDR(pa);
+		as_zero_region(va, 1);
+
+		/* Only this work item adds to the pool, so there is room */
+		spinlock_acquire(&zeropage_lock);
+		KASSERT(num_zeropages < ZEROPAGE_POOL_MAX);
+		zeropages[num_zeropages++] = va;
+		full = num_zeropages == ZEROPAGE_POOL_MAX;
+		spinlock_release(&zeropage_lock);
+	}
+}
+
+/*
+ * Take a page from the pool, or return 0 if it is empty. Schedules a
+ * refill when the pool runs low.
+ */
+static
+vaddr_t
+zeropage_get(void)
+{
+	vaddr_t va = 0;
+	unsigned left;
+
+	spinlock_acquire(&zeropage_lock);
+	if (num_zeropages > 0) {
+		va = zeropages[--num_zeropages];
+	}
+	left = num_zeropages;
+	spinlock_release(&zeropage_lock);
+
+	if (left <= ZEROPAGE_POOL_LOW) {
+		work_queue(&zeropage_work);
+	}
+	return va;
+}
+
 vaddr_t
 alloc_kpages(unsigned npages, bool kmalloc)
 {
 	KASSERT(npages > 0);
+	if (npages == 1 && dumbervm.vm_ready) {
+		vaddr_t va = zeropage_get();
+		if (va != 0) {
+			return va;
+		}
+	}
 	if (kmalloc && dumbervm.swap_buffer!=NULL && curcpu->c_spinlocks !=1)
 	{
 		lock_acquire(dumbervm.kern_lk);
@@ -443,6 +540,7 @@ alloc_upages(struct addrspace* as, vaddr_t* va, unsigned npages ,bool* in_swap,
 		if (as->ptbase[vpn1] == 0)  // This means the low level page table for this top level page entery was not created yet
 		{
 			ll_pagetable_va = (vaddr_t *)alloc_kpages(1,false); // allocate a single page for a low lever page table
+			kmalloc_tag_account(KMT_PAGETABLE, PAGE_SIZE);
 			as_zero_region((vaddr_t)ll_pagetable_va, 1); // zero all entries in the new low level page table.
 
 			as->ptbase[vpn1] = (vaddr_t)((ll_pagetable_va)); // NOTE: for now no counts too complicated
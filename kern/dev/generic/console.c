@@ -174,6 +174,7 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars_head = nexthead;
 
 	V(cs->cs_rsem);
+	pollwakeup(&cs->cs_pollhead);
 }
 
 /*
@@ -302,10 +303,34 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * Input is ready once there is a character buffered; reading one
+ * character then won't block. Output never waits long, so it is
+ * always ready.
+ */
+static
+int
+con_poll(struct device *dev, int events, struct pollentry *pe)
+{
+	struct con_softc *cs = dev->d_data;
+	int revents;
+
+	if (pe != NULL) {
+		pollhead_add(pe, &cs->cs_pollhead);
+	}
+
+	revents = events & POLLOUT;
+	if (cs->cs_gotchars_head != cs->cs_gotchars_tail) {
+		revents |= events & POLLIN;
+	}
+	return revents;
+}
+
 static const struct device_ops console_devops = {
 	.devop_eachopen = con_eachopen,
 	.devop_io = con_io,
 	.devop_ioctl = con_ioctl,
+	.devop_poll = con_poll,
 };
 
 static
@@ -386,6 +411,7 @@ config_con(struct con_softc *cs, int unit)
 	cs->cs_wsem = wsem;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	pollhead_init(&cs->cs_pollhead);
 
 	the_console = cs;
 	con_userlock_read = rlk;
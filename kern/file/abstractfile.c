@@ -8,38 +8,114 @@
 #include <copyinout.h>
 #include <kern/errno.h>
 #include <vnode.h>
+#include <kmem_cache.h>
+#include <synch.h>
+#include <membar.h>
 
+/*
+ * Every open() and close() creates and destroys an abstractfile, so
+ * they come from their own cache instead of the shared kmalloc lists.
+ * A cached abstractfile keeps its offset lock.
+ */
+static int af_ctor(void *obj);
+static void af_dtor(void *obj);
+
+static struct kmem_cache af_cache =
+    KMEM_CACHE_INITIALIZER("abstractfile", struct abstractfile, KMT_FILE,
+                           af_ctor, af_dtor);
+
+static
+int
+af_ctor(void *obj)
+{
+    struct abstractfile *af = obj;
+
+    af->offset_lk = lock_create("file offset lk");
+    if (af->offset_lk == NULL)
+    {
+        return ENOMEM;
+    }
+    return 0;
+}
+
+static
+void
+af_dtor(void *obj)
+{
+    struct abstractfile *af = obj;
+
+    lock_destroy(af->offset_lk);
+}
 
 int
 af_create(unsigned int status ,struct vnode* vn, struct abstractfile** af)
 {
-    *af = kmalloc(sizeof(struct abstractfile));
-    if (af == NULL)
+    *af = kmem_cache_alloc(&af_cache);
+    if (*af == NULL)
     {
         return ENOMEM;
     }
     (*af)->offset = 0;
     (*af)->vn = vn;
-    (*af)->ref_count = 1;
+    spinlock_data_set(&(*af)->ref_count, 1);
     (*af)->status = status;
 
     return 0;
 }
 
+void
+af_incref(struct abstractfile* af)
+{
+    KASSERT(spinlock_data_get(&af->ref_count) > 0);
+    spinlock_data_fetchadd(&af->ref_count, 1);
+}
+
+bool
+af_decref(struct abstractfile* af)
+{
+    spinlock_data_t old;
+
+    /* Everything we did with the file happens before whoever frees it sees zero */
+    membar_any_any();
+    old = spinlock_data_fetchadd(&af->ref_count, (unsigned)-1);
+    KASSERT(old > 0);
+    if (old == 1)
+    {
+        membar_any_any();
+        return true;
+    }
+    return false;
+}
+
 int 
 af_destroy(struct abstractfile** af)
 {
     struct abstractfile* local_af = (*af);
     
     // Should not destroy a file that still has references to it
-    if(local_af->ref_count != 0)
+    if(spinlock_data_get(&local_af->ref_count) != 0)
     {
         return EINVAL;
     }
     
     // No need to decrease ref on the vnode as vfs_close does that!!!
     local_af->vn = NULL;
-    kfree(local_af);
+    kmem_cache_free(&af_cache, local_af);
     
     return 0;
-}
\ No newline at end of file
+}
+
+void
+af_discard(struct abstractfile* af)
+{
+    bool last;
+    int result;
+
+    vfs_close(af->vn);
+
+    /* af_destroy only frees a file nobody refers to */
+    last = af_decref(af);
+    KASSERT(last);
+    result = af_destroy(&af);
+    KASSERT(result == 0);
+}
@@ -0,0 +1,304 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <limits.h>
+#include <spinlock.h>
+#include <abstractfile.h>
+#include <filetable.h>
+#include <fdtable.h>
+#include <kmalloc_tag.h>
+
+#define FDT_WORDS(size) ((size) / 32)
+
+/*
+ * Makes room for at least MINSIZE fds. Must not be shared.
+ */
+static
+int
+fdtable_grow(struct fdtable* fdt, unsigned int minsize)
+{
+    unsigned int newsize, i;
+    int* newmap;
+    uint32_t* newbitmap;
+
+    KASSERT(minsize <= __OPEN_MAX);
+
+    newsize = fdt->fdt_size;
+    while (newsize < minsize)
+    {
+        newsize *= 2;
+    }
+    if (newsize > __OPEN_MAX)
+    {
+        newsize = __OPEN_MAX;
+    }
+    if (newsize == fdt->fdt_size)
+    {
+        return 0;
+    }
+
+    newmap = kmalloc_tagged(newsize * sizeof(int), KMT_FILE);
+    if (newmap == NULL)
+    {
+        return ENOMEM;
+    }
+    newbitmap = kmalloc_tagged(FDT_WORDS(newsize) * sizeof(uint32_t), KMT_FILE);
+    if (newbitmap == NULL)
+    {
+        kfree_tagged(newmap, KMT_FILE);
+        return ENOMEM;
+    }
+
+    memcpy(newmap, fdt->fdt_map, fdt->fdt_size * sizeof(int));
+    for (i = fdt->fdt_size; i < newsize; i++)
+    {
+        newmap[i] = FDTABLE_EMPTY;
+    }
+    memcpy(newbitmap, fdt->fdt_bitmap, FDT_WORDS(fdt->fdt_size) * sizeof(uint32_t));
+    for (i = FDT_WORDS(fdt->fdt_size); i < FDT_WORDS(newsize); i++)
+    {
+        newbitmap[i] = 0;
+    }
+
+    kfree_tagged(fdt->fdt_map, KMT_FILE);
+    kfree_tagged(fdt->fdt_bitmap, KMT_FILE);
+    fdt->fdt_map = newmap;
+    fdt->fdt_bitmap = newbitmap;
+    fdt->fdt_size = newsize;
+
+    return 0;
+}
+
+static
+void
+fdtable_free(struct fdtable* fdt)
+{
+    spinlock_cleanup(&fdt->fdt_reflock);
+    kfree_tagged(fdt->fdt_map, KMT_FILE);
+    kfree_tagged(fdt->fdt_bitmap, KMT_FILE);
+    kfree_tagged(fdt, KMT_FILE);
+}
+
+struct fdtable*
+fdtable_create(void)
+{
+    struct fdtable* fdt;
+    unsigned int i;
+
+    fdt = kmalloc_tagged(sizeof(struct fdtable), KMT_FILE);
+    if (fdt == NULL)
+    {
+        return NULL;
+    }
+
+    fdt->fdt_map = kmalloc_tagged(FDTABLE_INIT_SIZE * sizeof(int), KMT_FILE);
+    fdt->fdt_bitmap = kmalloc_tagged(FDT_WORDS(FDTABLE_INIT_SIZE) * sizeof(uint32_t), KMT_FILE);
+    if (fdt->fdt_map == NULL || fdt->fdt_bitmap == NULL)
+    {
+        kfree_tagged(fdt->fdt_map, KMT_FILE);
+        kfree_tagged(fdt->fdt_bitmap, KMT_FILE);
+        kfree_tagged(fdt, KMT_FILE);
+        return NULL;
+    }
+
+    for (i = 0; i < FDTABLE_INIT_SIZE; i++)
+    {
+        fdt->fdt_map[i] = FDTABLE_EMPTY;
+    }
+    for (i = 0; i < FDT_WORDS(FDTABLE_INIT_SIZE); i++)
+    {
+        fdt->fdt_bitmap[i] = 0;
+    }
+    fdt->fdt_size = FDTABLE_INIT_SIZE;
+    fdt->fdt_count = 0;
+    fdt->fdt_hint = 0;
+
+    spinlock_init(&fdt->fdt_reflock);
+    fdt->fdt_refcount = 1;
+
+    return fdt;
+}
+
+struct fdtable*
+fdtable_share(struct fdtable* fdt)
+{
+    spinlock_acquire(&fdt->fdt_reflock);
+    KASSERT(fdt->fdt_refcount > 0);
+    fdt->fdt_refcount++;
+    spinlock_release(&fdt->fdt_reflock);
+
+    return fdt;
+}
+
+void
+fdtable_release(struct fdtable* fdt)
+{
+    unsigned int fd;
+    bool last;
+
+    spinlock_acquire(&fdt->fdt_reflock);
+    KASSERT(fdt->fdt_refcount > 0);
+    fdt->fdt_refcount--;
+    last = fdt->fdt_refcount == 0;
+    spinlock_release(&fdt->fdt_reflock);
+
+    if (!last)
+    {
+        return;
+    }
+
+    for (fd = 0; fd < fdt->fdt_size && fdt->fdt_count > 0; fd++)
+    {
+        if (fdt->fdt_map[fd] != FDTABLE_EMPTY)
+        {
+            ft_release_file(fdtable_clear(fdt, fd));
+        }
+    }
+
+    fdtable_free(fdt);
+}
+
+int
+fdtable_unshare(struct fdtable** fdtp)
+{
+    struct fdtable* old = *fdtp;
+    struct fdtable* copy;
+    unsigned int fd;
+    int result;
+
+    spinlock_acquire(&old->fdt_reflock);
+    if (old->fdt_refcount == 1)
+    {
+        spinlock_release(&old->fdt_reflock);
+        return 0;
+    }
+    spinlock_release(&old->fdt_reflock);
+
+    copy = fdtable_create();
+    if (copy == NULL)
+    {
+        return ENOMEM;
+    }
+    result = fdtable_grow(copy, old->fdt_size);
+    if (result)
+    {
+        fdtable_free(copy);
+        return result;
+    }
+
+    /* The copy gets a reference of its own to every file */
+    for (fd = 0; fd < old->fdt_size; fd++)
+    {
+        if (old->fdt_map[fd] != FDTABLE_EMPTY)
+        {
+            ft_hold_file(old->fdt_map[fd]);
+        }
+    }
+    memcpy(copy->fdt_map, old->fdt_map, old->fdt_size * sizeof(int));
+    memcpy(copy->fdt_bitmap, old->fdt_bitmap, FDT_WORDS(old->fdt_size) * sizeof(uint32_t));
+    copy->fdt_count = old->fdt_count;
+    copy->fdt_hint = old->fdt_hint;
+
+    /* The other users may all have let go meanwhile; then this frees it */
+    fdtable_release(old);
+    *fdtp = copy;
+
+    return 0;
+}
+
+int
+fdtable_get(struct fdtable* fdt, int fd)
+{
+    if (fd < 0 || (unsigned int)fd >= fdt->fdt_size)
+    {
+        return FDTABLE_EMPTY;
+    }
+    return fdt->fdt_map[fd];
+}
+
+int
+fdtable_find_free(struct fdtable* fdt, int* fd)
+{
+    unsigned int word, bit;
+    int result;
+
+    KASSERT(fdt->fdt_refcount == 1);
+
+    if (fdt->fdt_count == __OPEN_MAX)
+    {
+        return EMFILE;
+    }
+
+    /* Every word before the hint is full */
+    for (word = fdt->fdt_hint; word < FDT_WORDS(fdt->fdt_size); word++)
+    {
+        if (fdt->fdt_bitmap[word] != 0xffffffff)
+        {
+            break;
+        }
+    }
+    fdt->fdt_hint = word;
+
+    if (word == FDT_WORDS(fdt->fdt_size))
+    {
+        /* All in use; the first fd past the end will do */
+        result = fdtable_grow(fdt, fdt->fdt_size + 1);
+        if (result)
+        {
+            return result;
+        }
+    }
+
+    for (bit = 0; fdt->fdt_bitmap[word] & ((uint32_t)1 << bit); bit++);
+
+    *fd = word * 32 + bit;
+    return 0;
+}
+
+int
+fdtable_set(struct fdtable* fdt, int fd, int ft_index)
+{
+    int result;
+
+    KASSERT(fdt->fdt_refcount == 1);
+    KASSERT(fd >= 0 && fd < __OPEN_MAX);
+    KASSERT(ft_index != FDTABLE_EMPTY);
+
+    if ((unsigned int)fd >= fdt->fdt_size)
+    {
+        result = fdtable_grow(fdt, fd + 1);
+        if (result)
+        {
+            return result;
+        }
+    }
+
+    KASSERT(fdt->fdt_map[fd] == FDTABLE_EMPTY);
+    fdt->fdt_map[fd] = ft_index;
+    fdt->fdt_bitmap[fd / 32] |= (uint32_t)1 << (fd % 32);
+    fdt->fdt_count++;
+
+    return 0;
+}
+
+int
+fdtable_clear(struct fdtable* fdt, int fd)
+{
+    int ft_index;
+
+    KASSERT(fdt->fdt_refcount <= 1);
+    KASSERT(fd >= 0 && (unsigned int)fd < fdt->fdt_size);
+
+    ft_index = fdt->fdt_map[fd];
+    KASSERT(ft_index != FDTABLE_EMPTY);
+
+    fdt->fdt_map[fd] = FDTABLE_EMPTY;
+    fdt->fdt_bitmap[fd / 32] &= ~((uint32_t)1 << (fd % 32));
+    fdt->fdt_count--;
+    if ((unsigned int)fd / 32 < fdt->fdt_hint)
+    {
+        fdt->fdt_hint = fd / 32;
+    }
+
+    return ft_index;
+}
@@ -6,35 +6,178 @@
 #include <kern/errno.h>
 #include <stat.h>
 #include <vfs.h>
+#include <vnode.h>
 #include <current.h>
 #include <filetable.h>
+#include <kmalloc_tag.h>
+#include <lib.h>
+#include <limits.h>
+#include <copyinout.h>
 
 #define STD_DEVICE "con:"
 
+/* Free list links of slot I of the kernel file table */
+#define FT_NEXT_FREE(i) \
+    (kfile_table->chunks[(unsigned)(i) >> FT_CHUNK_SHIFT]->next_free[(unsigned)(i) & (FT_CHUNK_SIZE - 1)])
+#define FT_PREV_FREE(i) \
+    (kfile_table->chunks[(unsigned)(i) >> FT_CHUNK_SHIFT]->prev_free[(unsigned)(i) & (FT_CHUNK_SIZE - 1)])
+
+/*
+ * Puts a slot on the free list. Slots in the last chunk go to the back so
+ * they are handed out last and the chunk gets a chance to empty out and be
+ * given back; everything else goes to the front. Must hold location_lk.
+ */
+static
+void
+ft_free_slot(int index)
+{
+    bool last_chunk = (unsigned)index >> FT_CHUNK_SHIFT == kfile_table->num_chunks - 1;
+
+    if (kfile_table->free_head == FT_NO_SLOT)
+    {
+        FT_NEXT_FREE(index) = FT_NO_SLOT;
+        FT_PREV_FREE(index) = FT_NO_SLOT;
+        kfile_table->free_head = index;
+        kfile_table->free_tail = index;
+    }
+    else if (last_chunk)
+    {
+        FT_NEXT_FREE(index) = FT_NO_SLOT;
+        FT_PREV_FREE(index) = kfile_table->free_tail;
+        FT_NEXT_FREE(kfile_table->free_tail) = index;
+        kfile_table->free_tail = index;
+    }
+    else
+    {
+        FT_NEXT_FREE(index) = kfile_table->free_head;
+        FT_PREV_FREE(index) = FT_NO_SLOT;
+        FT_PREV_FREE(kfile_table->free_head) = index;
+        kfile_table->free_head = index;
+    }
+}
+
+/*
+ * Takes a slot off the free list. Must hold location_lk.
+ */
+static
+void
+ft_unfree_slot(int index)
+{
+    int next = FT_NEXT_FREE(index);
+    int prev = FT_PREV_FREE(index);
+
+    if (prev == FT_NO_SLOT)
+    {
+        kfile_table->free_head = next;
+    }
+    else
+    {
+        FT_NEXT_FREE(prev) = next;
+    }
+
+    if (next == FT_NO_SLOT)
+    {
+        kfile_table->free_tail = prev;
+    }
+    else
+    {
+        FT_PREV_FREE(next) = prev;
+    }
+}
+
+/*
+ * Adds an empty chunk to the end of the table. Must hold location_lk.
+ */
+static
+int
+ft_grow(void)
+{
+    struct ft_chunk* chunk;
+    unsigned int i;
+    int base;
+
+    if (kfile_table->num_chunks == FT_MAX_CHUNKS)
+    {
+        return ENFILE;
+    }
+
+    chunk = (struct ft_chunk*)kmalloc_tagged(sizeof(struct ft_chunk), KMT_FILE);
+    if (chunk == NULL)
+    {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < FT_CHUNK_SIZE; i++)
+    {
+        chunk->files[i] = NULL;
+    }
+    chunk->used = 0;
+
+    base = kfile_table->num_chunks * FT_CHUNK_SIZE;
+    kfile_table->chunks[kfile_table->num_chunks] = chunk;
+    kfile_table->num_chunks++;
+    kfile_table->curr_size = kfile_table->num_chunks * FT_CHUNK_SIZE;
+
+    for (i = 0; i < FT_CHUNK_SIZE; i++)
+    {
+        ft_free_slot(base + i);
+    }
+
+    return 0;
+}
+
+/*
+ * Gives the last chunk, which must be empty, back. Must hold location_lk.
+ */
+static
+void
+ft_shrink(void)
+{
+    struct ft_chunk* chunk;
+    unsigned int i;
+    int base;
+
+    KASSERT(kfile_table->num_chunks > 1);
+
+    chunk = kfile_table->chunks[kfile_table->num_chunks - 1];
+    KASSERT(chunk->used == 0);
+
+    base = (kfile_table->num_chunks - 1) * FT_CHUNK_SIZE;
+    for (i = 0; i < FT_CHUNK_SIZE; i++)
+    {
+        ft_unfree_slot(base + i);
+    }
+
+    kfile_table->num_chunks--;
+    kfile_table->chunks[kfile_table->num_chunks] = NULL;
+    kfile_table->curr_size = kfile_table->num_chunks * FT_CHUNK_SIZE;
+
+    kfree_tagged(chunk, KMT_FILE);
+}
+
 // Make sure to destroy
 void 
 ft_bootstrap() 
 {
+    int location;
 
     /* Allocation of all memory needed for a file */
-    kfile_table = (struct filetable*)kmalloc(sizeof(struct filetable));
+    kfile_table = (struct filetable*)kmalloc_tagged(sizeof(struct filetable), KMT_FILE);
 
     if (kfile_table == NULL) 
     { 
         panic("Could not create file table\n");
     }
 
-    kfile_table->files = (struct abstractfile**)kmalloc(FILETABLE_INIT_SIZE*sizeof(struct abstractfile*));
-    if (kfile_table->files == NULL) 
+    for (unsigned int i = 0; i < FT_MAX_CHUNKS; i++)
     {
-        panic("Could not create file table\n");
+        kfile_table->chunks[i] = NULL;
     }
-
-    // kfile_table->files_lk = (struct lock**)kmalloc(FILETABLE_INIT_SIZE*sizeof(struct lock*));
-    // if (kfile_table->files_lk == NULL) 
-    // {
-    //     panic("Could not create file table\n");
-    // }
+    kfile_table->num_chunks = 0;
+    kfile_table->curr_size = 0;
+    kfile_table->files_counter = 0;
+    kfile_table->free_head = FT_NO_SLOT;
+    kfile_table->free_tail = FT_NO_SLOT;
 
     kfile_table->location_lk = lock_create("ft lock");
     if(kfile_table->location_lk == NULL)
@@ -42,24 +185,15 @@ ft_bootstrap()
         panic("cannot create location lock for file table");
     }
 
-	//char *ft_loc = (char *) kmalloc(32 * sizeof(char));
-	// for (unsigned int i = 0; i < FILETABLE_INIT_SIZE; i++)
-	// {
-	// 	//snprintf(ft_loc, 32, "kfile_table lock %d", i);
-	// 	kfile_table->files_lk[i] = lock_create("file_table location lock");
-
-	// 	if (kfile_table->files_lk[i] == NULL)
-	// 	{
-	// 		panic("Creating locks for file table failed\n");
-	// 	}
-	// }
-    
-    /* Make sure to track the size of the file - room to make it dynamic in the future */
-    kfile_table->curr_size = FILETABLE_INIT_SIZE;
+    /* Start with one chunk; it is never given back, so stdin/out/err always have a home */
+    lock_acquire(kfile_table->location_lk);
+    if (ft_grow())
+    {
+        panic("Could not create file table\n");
+    }
+    lock_release(kfile_table->location_lk);
 
     /* Create the standard input/out/error for all processes */
-    kfile_table->files_counter = 3; 
-
     struct abstractfile* stdin = NULL;
     struct abstractfile* stdout = NULL;
     struct abstractfile* stderr = NULL;
@@ -84,75 +218,102 @@ ft_bootstrap()
         panic("Could not open std");
     }
 
-    kfile_table->files[0] = stdin;
-    kfile_table->files[1] = stdout;
-    kfile_table->files[2] = stderr;
-
-    
+    /* The table is empty and the free list in order, so these land in 0, 1 and 2 */
+    if (ft_add_file(&stdin, &location) || location != 0 ||
+        ft_add_file(&stdout, &location) || location != 1 ||
+        ft_add_file(&stderr, &location) || location != 2)
+    {
+        panic("Could not add std to the file table");
+    }
 }
 
 void 
 ft_destroy(struct filetable* ft)
 {
-    (void)ft;
-    unsigned int i;
-    // for (i = 0; i < ft->curr_size; i++)
-    // {
-    //     lock_destroy(ft->files_lk[i]);
-    // }
+    unsigned int i, j;
 
-    for (i = 0; i < ft->files_counter; i++)
+    for (i = 0; i < ft->num_chunks; i++)
     {
-        af_destroy(&ft->files[i]);
+        for (j = 0; j < FT_CHUNK_SIZE; j++)
+        {
+            if (ft->chunks[i]->files[j] != NULL)
+            {
+                af_destroy(&ft->chunks[i]->files[j]);
+            }
+        }
+        kfree_tagged(ft->chunks[i], KMT_FILE);
     }
 
-    lock_destroy(kfile_table->location_lk);
+    lock_destroy(ft->location_lk);
     
-    kfree(ft);
+    kfree_tagged(ft, KMT_FILE);
 
 }
 
 
-void 
+int 
 ft_adjust_size(void) 
 {
-    return;
+    struct ft_chunk* last;
+    unsigned int free_slots;
+
+    KASSERT(lock_do_i_hold(kfile_table->location_lk));
+
+    if (kfile_table->free_head == FT_NO_SLOT)
+    {
+        return ft_grow();
+    }
+
+    /*
+     * Give back empty chunks at the end, but only while half a chunk
+     * would still be free afterwards, so a process opening and closing
+     * one file at the boundary doesn't allocate and free a chunk each time.
+     */
+    while (kfile_table->num_chunks > 1)
+    {
+        last = kfile_table->chunks[kfile_table->num_chunks - 1];
+        free_slots = kfile_table->curr_size - kfile_table->files_counter;
+        if (last->used != 0 || free_slots < FT_CHUNK_SIZE + FT_CHUNK_SIZE / 2)
+        {
+            break;
+        }
+        ft_shrink();
+    }
+
+    return 0;
 }
 
 int 
 ft_add_file(struct abstractfile** file, int* location) 
 {
+    int result;
+    int index;
+
     KASSERT(kfile_table != NULL); 
-    KASSERT(kfile_table->files != NULL);
-    
-    // TODO: add check for a valid file
-    
-    if ((kfile_table->files_counter % FILETABLE_INIT_SIZE )== 0)
-    {
-        ft_adjust_size();
-    }
+    KASSERT(*file != NULL);
 
     lock_acquire(kfile_table->location_lk);
-    /* Find an empty spot in the table */
-    for(unsigned int i = 0; i < kfile_table->curr_size; i++)
+
+    result = ft_adjust_size();
+    if (result)
     {
-        if(kfile_table->files[i] == NULL)
-        {
-            kfile_table->files[i] = *file;
-            *location = i;     // Exit the loop
-            break;
-        }
-        else if(i == (kfile_table->curr_size -1))
-        {
-            lock_release(kfile_table->location_lk);
-            /* Either have this or make a table that dynamiclly adjusts size */
-            return ENFILE;
-        }
+        lock_release(kfile_table->location_lk);
+        return result;
     }
-    
+
+    /* Take the first free slot */
+    index = kfile_table->free_head;
+    KASSERT(index != FT_NO_SLOT);
+    ft_unfree_slot(index);
+
+    KASSERT(FT_FILE(kfile_table, index) == NULL);
+    FT_FILE(kfile_table, index) = *file;
+    kfile_table->chunks[index >> FT_CHUNK_SHIFT]->used++;
     kfile_table->files_counter++;
+
     lock_release(kfile_table->location_lk);
 
+    *location = index;
     return 0;
 
 }
@@ -160,22 +321,79 @@ ft_add_file(struct abstractfile** file, int* location)
 void 
 ft_remove_file(unsigned int index) 
 {
+    struct abstractfile* af;
+
     KASSERT(kfile_table != NULL); 
-    KASSERT(kfile_table->files != NULL);
-    KASSERT(index < kfile_table->curr_size);
 
     /*
      * Completely remove the file from the table 
      */
-
-    // No need to decrease ref on the vnode as vfs_close does that
-    af_destroy(&kfile_table->files[index]);
-    kfile_table->files[index] = NULL;
-
     lock_acquire(kfile_table->location_lk);
+    KASSERT(index < kfile_table->curr_size);
+
+    af = FT_FILE(kfile_table, index);
+    KASSERT(af != NULL);
+    FT_FILE(kfile_table, index) = NULL;
+    kfile_table->chunks[index >> FT_CHUNK_SHIFT]->used--;
     kfile_table->files_counter--; // This should be the only place that files_counter of the main file table decreases
+    ft_free_slot(index);
+
+    /* Shrinking never fails */
+    ft_adjust_size();
     lock_release(kfile_table->location_lk);
 
+    // No need to decrease ref on the vnode as vfs_close does that
+    af_destroy(&af);
+
+}
+
+struct abstractfile* 
+ft_hold_file(unsigned int index) 
+{
+    struct abstractfile* af;
+
+    /*
+     * The caller holds a reference, so the slot can't be emptied or its
+     * chunk given back under us, and the count can't be zero.
+     */
+    KASSERT(index < kfile_table->curr_size);
+    af = FT_FILE(kfile_table, index);
+    KASSERT(af != NULL);
+    af_incref(af);
+    if (af->vn != NULL)
+    {
+        VOP_INCREF(af->vn);
+    }
+
+    return af;
+}
+
+void 
+ft_release_file(unsigned int index) 
+{
+    struct abstractfile* af;
+    struct vnode* vn;
+    bool last;
+
+    KASSERT(index < kfile_table->curr_size);
+    af = FT_FILE(kfile_table, index);
+    vn = af->vn;
+    last = af_decref(af); // this should be the only place where ref_count of an absreact file decreases
+
+    /* 
+     *  We are assuming here that the vfs sructre knows to remove the v-node 
+     *  once it has no references.
+     */
+    if (vn != NULL)
+    {
+        vfs_close(vn);
+    }
+
+    /* Only now is the table lock needed */
+    if (last)
+    {
+        ft_remove_file(index);
+    }
 }
 
 int 
@@ -210,8 +428,8 @@ __open(char kpath[__PATH_MAX], int flags, struct abstractfile** af)
         result = VOP_STAT(vn, &st);
         if (result)
         {
-            vfs_close(vn);
-            af_destroy(af);
+            af_discard(*af);
+            *af = NULL;
             return result;
         }
 
@@ -221,6 +439,28 @@ __open(char kpath[__PATH_MAX], int flags, struct abstractfile** af)
     return 0;
 }
 
+int
+__copyin_path(userptr_t path, char** kpath)
+{
+    int result;
+
+    /* Off the stack; rename needs two and the kernel stack is one page */
+    *kpath = kmalloc(__PATH_MAX);
+    if (*kpath == NULL)
+    {
+        return ENOMEM;
+    }
+
+    result = copyinstr(path, *kpath, __PATH_MAX, NULL);
+    if (result)
+    {
+        kfree(*kpath);
+        return result;
+    }
+
+    return 0;
+}
+
 int
 __close(struct proc* cur_proc, int fd)
 {
@@ -232,39 +472,25 @@ __close(struct proc* cur_proc, int fd)
         return result;
     }
 
-    int index_in_fd = cur_proc->fdtable[fd];
-
-    if (index_in_fd == FDTABLE_EMPTY)
+    if (fdtable_get(cur_proc->p_fdtable, fd) == FDTABLE_EMPTY)
     {
         return EBADF;
     }
+
+    /* Don't close it for the other processes sharing the table */
+    result = fdtable_unshare(&cur_proc->p_fdtable);
+    if (result)
+    {
+        return result;
+    }
+
     /*
      * Removes the file descriptor for this process only
      * Makes it available to reuse.
      * Note that at this point we should have the lock for the current process's file table
      */ 
-    cur_proc->fdtable[fd] = FDTABLE_EMPTY; 
-    cur_proc->fdtable_num_entries--; // This shuld be the only place where the entries count of the individual process decreases
-
-    // We probably want to lock this index before writing to it
-    //lock_acquire(kfile_table->files_lk[index_in_fd]);
-    lock_acquire(kfile_table->location_lk);
-    kfile_table->files[index_in_fd]->ref_count --; // this should be the only place where ref_count of an absreact file decreases
-    lock_release(kfile_table->location_lk);
-    //lock_release(kfile_table->files_lk[index_in_fd]);
-    /* 
-     *  We are assuming here that the vfs sructre knows to remove the v-node 
-     *  once it has no references.
-     */
-    if (kfile_table->files[index_in_fd]->vn != NULL)
-    {
-        vfs_close(kfile_table->files[index_in_fd]->vn);
-    }
-    
+    int index_in_fd = fdtable_clear(cur_proc->p_fdtable, fd);
 
-    if (kfile_table->files[index_in_fd]->ref_count == 0)
-    {
-        ft_remove_file(index_in_fd);
-    }
+    ft_release_file(index_in_fd);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,492 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/poll.h>
+#include <lib.h>
+#include <stat.h>
+#include <membar.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <uio.h>
+#include <vnode.h>
+#include <kmalloc_tag.h>
+#include <poll.h>
+#include <pipe.h>
+
+#define PIPE_MASK (PIPE_SIZE - 1)
+
+/* Bytes in the ring */
+#define PIPE_USED(p) ((p)->p_head - (p)->p_tail)
+
+static
+unsigned int
+pipe_min(unsigned int a, unsigned int b)
+{
+    return a < b ? a : b;
+}
+
+/*
+ * Wakes the threads counted in WAITERS, if there are any. What the
+ * caller changed is visible before the count is read, and a waiter is
+ * counted before it looks at what it is waiting for, so either the
+ * waiter sees the change or we see the waiter.
+ */
+static
+void
+pipe_wake(struct pipe* p, struct wchan* wc, volatile unsigned int* waiters)
+{
+    membar_any_any();
+    if (*waiters == 0)
+    {
+        return;
+    }
+
+    spinlock_acquire(&p->p_lock);
+    wchan_wakeall(wc, &p->p_lock);
+    spinlock_release(&p->p_lock);
+}
+
+/*
+ * Sleeps on WC until READY(p) is true.
+ */
+static
+void
+pipe_wait(struct pipe* p, struct wchan* wc, volatile unsigned int* waiters,
+          bool (*ready)(struct pipe*))
+{
+    spinlock_acquire(&p->p_lock);
+    (*waiters)++;
+    membar_any_any();
+    while (!ready(p))
+    {
+        wchan_sleep(wc, &p->p_lock);
+    }
+    (*waiters)--;
+    spinlock_release(&p->p_lock);
+}
+
+static
+bool
+pipe_readable(struct pipe* p)
+{
+    return PIPE_USED(p) > 0 || p->p_wclosed;
+}
+
+static
+bool
+pipe_writable(struct pipe* p)
+{
+    return PIPE_USED(p) < PIPE_SIZE || p->p_rclosed;
+}
+
+/* These take the turn when they say it's free */
+static
+bool
+pipe_rclaim(struct pipe* p)
+{
+    return spinlock_data_testandset(&p->p_rbusy) == 0;
+}
+
+static
+bool
+pipe_wclaim(struct pipe* p)
+{
+    return spinlock_data_testandset(&p->p_wbusy) == 0;
+}
+
+static
+int
+pipe_eachopen(struct vnode* vn, int openflags)
+{
+    /* Pipes have no names, so nothing opens them */
+    (void)vn;
+    (void)openflags;
+    return EINVAL;
+}
+
+static
+void
+pipe_destroy(struct pipe* p)
+{
+    wchan_destroy(p->p_rwc);
+    wchan_destroy(p->p_wwc);
+    spinlock_cleanup(&p->p_lock);
+    pollhead_cleanup(&p->p_rph);
+    pollhead_cleanup(&p->p_wph);
+    kfree_tagged(p->p_buf, KMT_FILE);
+    kfree_tagged(p, KMT_FILE);
+}
+
+/*
+ * Called when an end has no references left. The other end is told,
+ * and whichever end goes second frees the pipe.
+ */
+static
+int
+pipe_reclaim(struct vnode* vn)
+{
+    struct pipe* p = vn->vn_data;
+    bool last;
+
+    /* Someone may have taken a reference since the count went to one */
+    spinlock_acquire(&vn->vn_countlock);
+    if (vn->vn_refcount > 1)
+    {
+        vn->vn_refcount--;
+        spinlock_release(&vn->vn_countlock);
+        return EBUSY;
+    }
+    spinlock_release(&vn->vn_countlock);
+    vnode_cleanup(vn);
+
+    spinlock_acquire(&p->p_lock);
+    if (vn == &p->p_rvn)
+    {
+        /* Writers get EPIPE instead of waiting for room that won't come */
+        p->p_rclosed = true;
+        wchan_wakeall(p->p_wwc, &p->p_lock);
+        pollwakeup(&p->p_wph);
+    }
+    else
+    {
+        /* Readers get end of file once the ring is empty */
+        p->p_wclosed = true;
+        wchan_wakeall(p->p_rwc, &p->p_lock);
+        pollwakeup(&p->p_rph);
+    }
+    /* Past here the other end may free the pipe, unless it is gone already */
+    last = p->p_rclosed && p->p_wclosed;
+    spinlock_release(&p->p_lock);
+
+    if (last)
+    {
+        pipe_destroy(p);
+    }
+    return 0;
+}
+
+/*
+ * Reads whatever is in the ring, up to the size of the request, waiting
+ * only if it is empty. Returns nothing at all once it is empty and the
+ * write end is gone.
+ */
+static
+int
+pipe_read(struct vnode* vn, struct uio* uio)
+{
+    struct pipe* p = vn->vn_data;
+    unsigned int used, idx, n;
+    bool moved;
+    int result;
+
+    KASSERT(uio->uio_rw == UIO_READ);
+    if (vn != &p->p_rvn)
+    {
+        return EBADF;
+    }
+
+    if (!pipe_rclaim(p))
+    {
+        pipe_wait(p, p->p_rwc, &p->p_rwaiters, pipe_rclaim);
+    }
+    membar_any_any();
+
+    if (!pipe_readable(p))
+    {
+        pipe_wait(p, p->p_rwc, &p->p_rwaiters, pipe_readable);
+    }
+
+    /* The data was written before p_head was moved over it */
+    used = PIPE_USED(p);
+    membar_load_load();
+
+    result = 0;
+    moved = false;
+    while (used > 0 && uio->uio_resid > 0)
+    {
+        idx = p->p_tail & PIPE_MASK;
+        n = pipe_min(pipe_min(used, PIPE_SIZE - idx), uio->uio_resid);
+        result = uiomove(p->p_buf + idx, n, uio);
+        if (result)
+        {
+            break;
+        }
+
+        /* Done with the bytes before the writer may reuse them */
+        membar_any_store();
+        p->p_tail += n;
+        used -= n;
+        moved = true;
+    }
+
+    if (moved)
+    {
+        pipe_wake(p, p->p_wwc, &p->p_wwaiters);
+        pollwakeup(&p->p_wph);
+    }
+
+    membar_any_store();
+    spinlock_data_set(&p->p_rbusy, 0);
+    pipe_wake(p, p->p_rwc, &p->p_rwaiters);
+
+    return result;
+}
+
+/*
+ * Writes all of the request, waiting for room as needed and letting the
+ * reader at each piece as soon as it is in. Other writers wait their turn,
+ * so writes don't interleave. If the read end goes away part way through,
+ * what was written is reported and the next write gets EPIPE.
+ */
+static
+int
+pipe_write(struct vnode* vn, struct uio* uio)
+{
+    struct pipe* p = vn->vn_data;
+    unsigned int space, idx, n;
+    size_t resid;
+    int result;
+
+    KASSERT(uio->uio_rw == UIO_WRITE);
+    if (vn != &p->p_wvn)
+    {
+        return EBADF;
+    }
+
+    if (!pipe_wclaim(p))
+    {
+        pipe_wait(p, p->p_wwc, &p->p_wwaiters, pipe_wclaim);
+    }
+    membar_any_any();
+
+    resid = uio->uio_resid;
+    result = 0;
+    while (uio->uio_resid > 0)
+    {
+        if (!pipe_writable(p))
+        {
+            pipe_wait(p, p->p_wwc, &p->p_wwaiters, pipe_writable);
+        }
+        if (p->p_rclosed)
+        {
+            result = EPIPE;
+            break;
+        }
+
+        /* The reader was done with the bytes before p_tail was moved past them */
+        space = PIPE_SIZE - PIPE_USED(p);
+        membar_any_store();
+
+        while (space > 0 && uio->uio_resid > 0)
+        {
+            idx = p->p_head & PIPE_MASK;
+            n = pipe_min(pipe_min(space, PIPE_SIZE - idx), uio->uio_resid);
+            result = uiomove(p->p_buf + idx, n, uio);
+            if (result)
+            {
+                goto out;
+            }
+
+            membar_store_store();
+            p->p_head += n;
+            space -= n;
+        }
+
+        pipe_wake(p, p->p_rwc, &p->p_rwaiters);
+        pollwakeup(&p->p_rph);
+    }
+
+out:
+    /* Like other writes, report what got done */
+    if (uio->uio_resid < resid)
+    {
+        result = 0;
+    }
+
+    membar_any_store();
+    spinlock_data_set(&p->p_wbusy, 0);
+    pipe_wake(p, p->p_wwc, &p->p_wwaiters);
+
+    return result;
+}
+
+/*
+ * Reports what the end can do without waiting, which for the read end
+ * includes seeing end of file. PE goes on the end's own pollhead.
+ */
+static
+int
+pipe_poll(struct vnode* vn, int events, struct pollentry* pe)
+{
+    struct pipe* p = vn->vn_data;
+    int revents = 0;
+
+    /* Register first, so a change after we look still wakes us */
+    if (vn == &p->p_rvn)
+    {
+        if (pe != NULL)
+        {
+            pollhead_add(pe, &p->p_rph);
+        }
+        if (pipe_readable(p))
+        {
+            revents |= events & POLLIN;
+        }
+        if (p->p_wclosed)
+        {
+            revents |= POLLHUP;
+        }
+    }
+    else
+    {
+        if (pe != NULL)
+        {
+            pollhead_add(pe, &p->p_wph);
+        }
+        if (PIPE_USED(p) < PIPE_SIZE)
+        {
+            revents |= events & POLLOUT;
+        }
+        if (p->p_rclosed)
+        {
+            revents |= POLLERR;
+        }
+    }
+
+    return revents;
+}
+
+static
+int
+pipe_ioctl(struct vnode* vn, int op, userptr_t data)
+{
+    (void)vn;
+    (void)op;
+    (void)data;
+    return EINVAL;
+}
+
+static
+int
+pipe_stat(struct vnode* vn, struct stat* statbuf)
+{
+    struct pipe* p = vn->vn_data;
+
+    bzero(statbuf, sizeof(struct stat));
+    statbuf->st_mode = S_IFIFO | 0600;
+    statbuf->st_size = PIPE_USED(p);
+    statbuf->st_nlink = 1;
+    statbuf->st_blksize = PIPE_SIZE;
+
+    return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode* vn, mode_t* ret)
+{
+    (void)vn;
+    *ret = S_IFIFO;
+    return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode* vn)
+{
+    (void)vn;
+    return false;
+}
+
+static
+int
+pipe_fsync(struct vnode* vn)
+{
+    (void)vn;
+    return EINVAL;
+}
+
+static
+int
+pipe_truncate(struct vnode* vn, off_t len)
+{
+    (void)vn;
+    (void)len;
+    return EINVAL;
+}
+
+static const struct vnode_ops pipe_vnode_ops = {
+    .vop_magic = VOP_MAGIC,
+
+    .vop_eachopen = pipe_eachopen,
+    .vop_reclaim = pipe_reclaim,
+    .vop_read = pipe_read,
+    .vop_readlink = vopfail_uio_inval,
+    .vop_getdirentry = vopfail_uio_notdir,
+    .vop_write = pipe_write,
+    .vop_ioctl = pipe_ioctl,
+    .vop_stat = pipe_stat,
+    .vop_gettype = pipe_gettype,
+    .vop_isseekable = pipe_isseekable,
+    .vop_poll = pipe_poll,
+    .vop_fsync = pipe_fsync,
+    .vop_mmap = vopfail_mmap_nosys,
+    .vop_truncate = pipe_truncate,
+    .vop_namefile = vopfail_uio_notdir,
+    .vop_creat = vopfail_creat_notdir,
+    .vop_symlink = vopfail_symlink_notdir,
+    .vop_mkdir = vopfail_mkdir_notdir,
+    .vop_link = vopfail_link_notdir,
+    .vop_remove = vopfail_string_notdir,
+    .vop_rmdir = vopfail_string_notdir,
+    .vop_rename = vopfail_rename_notdir,
+    .vop_lookup = vopfail_lookup_notdir,
+    .vop_lookparent = vopfail_lookparent_notdir,
+};
+
+int
+pipe_create(struct vnode** rvn, struct vnode** wvn)
+{
+    struct pipe* p;
+
+    p = kmalloc_tagged(sizeof(struct pipe), KMT_FILE);
+    if (p == NULL)
+    {
+        return ENOMEM;
+    }
+    p->p_buf = kmalloc_tagged(PIPE_SIZE, KMT_FILE);
+    p->p_rwc = wchan_create("pipe reader");
+    p->p_wwc = wchan_create("pipe writer");
+    if (p->p_buf == NULL || p->p_rwc == NULL || p->p_wwc == NULL)
+    {
+        if (p->p_rwc != NULL)
+        {
+            wchan_destroy(p->p_rwc);
+        }
+        if (p->p_wwc != NULL)
+        {
+            wchan_destroy(p->p_wwc);
+        }
+        kfree_tagged(p->p_buf, KMT_FILE);
+        kfree_tagged(p, KMT_FILE);
+        return ENOMEM;
+    }
+
+    p->p_head = 0;
+    p->p_tail = 0;
+    spinlock_data_set(&p->p_rbusy, 0);
+    spinlock_data_set(&p->p_wbusy, 0);
+    spinlock_init(&p->p_lock);
+    p->p_rwaiters = 0;
+    p->p_wwaiters = 0;
+    p->p_rclosed = false;
+    p->p_wclosed = false;
+    pollhead_init(&p->p_rph);
+    pollhead_init(&p->p_wph);
+
+    vnode_init(&p->p_rvn, &pipe_vnode_ops, NULL, p);
+    vnode_init(&p->p_wvn, &pipe_vnode_ops, NULL, p);
+
+    *rvn = &p->p_rvn;
+    *wvn = &p->p_wvn;
+    return 0;
+}
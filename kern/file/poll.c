@@ -0,0 +1,170 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <membar.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <timer.h>
+#include <poll.h>
+
+void
+pollhead_init(struct pollhead* ph)
+{
+    spinlock_init(&ph->ph_lock);
+    ph->ph_first = NULL;
+}
+
+void
+pollhead_cleanup(struct pollhead* ph)
+{
+    KASSERT(ph->ph_first == NULL);
+    spinlock_cleanup(&ph->ph_lock);
+}
+
+void
+pollhead_add(struct pollentry* pe, struct pollhead* ph)
+{
+    KASSERT(pe->pe_head == NULL);
+
+    spinlock_acquire(&ph->ph_lock);
+    pe->pe_head = ph;
+    pe->pe_next = ph->ph_first;
+    pe->pe_prevp = &ph->ph_first;
+    if (ph->ph_first != NULL)
+    {
+        ph->ph_first->pe_prevp = &pe->pe_next;
+    }
+    ph->ph_first = pe;
+    spinlock_release(&ph->ph_lock);
+
+    /* Whatever the hook checks next is read after we are visible */
+    membar_any_any();
+}
+
+/*
+ * Marks a waiter woken and wakes it if it is asleep.
+ */
+static
+void
+pollwaiter_wake(struct pollwaiter* pw, bool timedout)
+{
+    spinlock_acquire(&pw->pw_lock);
+    pw->pw_woken = true;
+    if (timedout)
+    {
+        pw->pw_timedout = true;
+    }
+    wchan_wakeall(pw->pw_wchan, &pw->pw_lock);
+    spinlock_release(&pw->pw_lock);
+}
+
+void
+pollwakeup(struct pollhead* ph)
+{
+    struct pollentry* pe;
+
+    /* The change is visible before we look for pollers; see pollhead_add */
+    membar_any_any();
+    if (ph->ph_first == NULL)
+    {
+        return;
+    }
+
+    spinlock_acquire(&ph->ph_lock);
+    for (pe = ph->ph_first; pe != NULL; pe = pe->pe_next)
+    {
+        pollwaiter_wake(pe->pe_waiter, false);
+    }
+    spinlock_release(&ph->ph_lock);
+}
+
+static
+void
+pollwaiter_timeout(void* arg)
+{
+    pollwaiter_wake(arg, true);
+}
+
+int
+pollwaiter_init(struct pollwaiter* pw, struct pollentry* entries, unsigned nentries)
+{
+    unsigned i;
+
+    pw->pw_wchan = wchan_create("poll");
+    if (pw->pw_wchan == NULL)
+    {
+        return ENOMEM;
+    }
+    spinlock_init(&pw->pw_lock);
+    pw->pw_woken = false;
+    pw->pw_timedout = false;
+    pw->pw_armed = false;
+    timer_init(&pw->pw_timer, pollwaiter_timeout, pw);
+
+    for (i = 0; i < nentries; i++)
+    {
+        entries[i].pe_waiter = pw;
+        entries[i].pe_head = NULL;
+        entries[i].pe_next = NULL;
+        entries[i].pe_prevp = NULL;
+    }
+
+    return 0;
+}
+
+void
+pollwaiter_cleanup(struct pollwaiter* pw, struct pollentry* entries, unsigned nentries)
+{
+    struct pollhead* ph;
+    unsigned i;
+
+    if (pw->pw_armed)
+    {
+        /* Waits for it if it is firing right now */
+        timer_del(&pw->pw_timer);
+    }
+
+    for (i = 0; i < nentries; i++)
+    {
+        ph = entries[i].pe_head;
+        if (ph == NULL)
+        {
+            continue;
+        }
+        spinlock_acquire(&ph->ph_lock);
+        *entries[i].pe_prevp = entries[i].pe_next;
+        if (entries[i].pe_next != NULL)
+        {
+            entries[i].pe_next->pe_prevp = entries[i].pe_prevp;
+        }
+        spinlock_release(&ph->ph_lock);
+        entries[i].pe_head = NULL;
+    }
+
+    /* Nobody can find the waiter any more, so nobody is using its lock */
+    wchan_destroy(pw->pw_wchan);
+    spinlock_cleanup(&pw->pw_lock);
+}
+
+bool
+pollwaiter_sleep(struct pollwaiter* pw, unsigned ticks)
+{
+    bool timedout;
+
+    if (ticks > 0 && !pw->pw_armed)
+    {
+        pw->pw_armed = true;
+        timer_add(&pw->pw_timer, ticks);
+    }
+
+    spinlock_acquire(&pw->pw_lock);
+    while (!pw->pw_woken)
+    {
+        wchan_sleep(pw->pw_wchan, &pw->pw_lock);
+    }
+    pw->pw_woken = false;
+    timedout = pw->pw_timedout;
+    spinlock_release(&pw->pw_lock);
+
+    return timedout;
+}
@@ -9,6 +9,7 @@
 #include <kern/errno.h>
 #include <filetable.h>
 #include <proctable.h>
+#include <kmalloc_tag.h>
 
 
 // Make sure to destroy
@@ -18,14 +19,14 @@ pt_bootstrap(void)
 {
     KASSERT(kproc != NULL);
 
-    kproc_table = (struct proctable*)kmalloc(sizeof(struct proctable));
+    kproc_table = (struct proctable*)kmalloc_tagged(sizeof(struct proctable), KMT_PROC);
 
     if (kproc_table == NULL) 
     {
         panic("Could not create proccess table\n");
     }
 
-    kproc_table->processes = (struct proc**)kmalloc(BASE_PROC_AMOUNT*sizeof(struct proc*));
+    kproc_table->processes = (struct proc**)kmalloc_tagged(BASE_PROC_AMOUNT*sizeof(struct proc*), KMT_PROC);
     if (kproc_table->processes == NULL) 
     {
         panic("Could not create proccess table\n");
@@ -33,7 +34,7 @@ pt_bootstrap(void)
 
     for (int i=0; i < BASE_PROC_AMOUNT; i++) kproc_table->processes[i] = NULL;
 
-    kproc_table->pid_lk = lock_create("pt pid lk");
+    kproc_table->pid_lk = rw_create("pt pid lk");
     if(kproc_table->pid_lk == NULL)
     {
         panic("Could not create proccess table lock for pids\n");
@@ -63,7 +64,7 @@ pt_adjust_size(void)
         return; // Should never really get here as calling function should just return an error if max size reached
     }
     int new_size = kproc_table->curr_size + BASE_PROC_AMOUNT;
-    struct proc** new_proc_list = (struct proc**)kmalloc((new_size)*sizeof(struct proc*));
+    struct proc** new_proc_list = (struct proc**)kmalloc_tagged((new_size)*sizeof(struct proc*), KMT_PROC);
     if (new_proc_list == NULL)
     {
         panic("Could not adjust the size of the process table");
@@ -79,7 +80,7 @@ pt_adjust_size(void)
     for (int i=kproc_table->curr_size; i < new_size; i++) kproc_table->processes[i] = NULL;
 
     // release the memory allocated for the original list
-    kfree(kproc_table->processes);
+    kfree_tagged(kproc_table->processes, KMT_PROC);
 
 
     // assign the new list to the process table pointer
@@ -130,26 +131,6 @@ pt_remove_proc(int pid)
 
 }
 
-int 
-pt_find_free_fd(struct proc* pr, int* fd)
-{
-    if (pr->fdtable_num_entries == __OPEN_MAX)
-    {
-        return EMFILE;
-    }
-
-    for (int i = 0; i < __OPEN_MAX; i++)
-    {
-        if (pr->fdtable[i] == FDTABLE_EMPTY)
-        {
-            *fd = i;
-            return 0;
-        }
-    }
-
-    return EMFILE;
-}
-
 int
 pt_find_avail_pid(void)
 {
@@ -204,6 +204,39 @@ sfs_dir_unlink(struct sfs_vnode *sv, int slot)
 	return sfs_writedir(sv, slot, &sd);
 }
 
+/*
+ * Find the first entry in use at or after slot *SLOT and copy its name
+ * into NAME, which must have room for SFS_NAMELEN bytes. *SLOT is left
+ * just past the entry found, so repeated calls walk the directory.
+ * Returns ENOENT when there are no more entries.
+ */
+int
+sfs_dir_nextentry(struct sfs_vnode *sv, int *slot, char *name)
+{
+	struct sfs_direntry tsd;
+	int nentries, i, result;
+
+	KASSERT(*slot >= 0);
+
+	nentries = sfs_dir_nentries(sv);
+	for (i = *slot; i < nentries; i++) {
+		result = sfs_readdir(sv, i, &tsd);
+		if (result) {
+			return result;
+		}
+		if (tsd.sfd_ino != SFS_NOINO) {
+			/* Ensure null termination, just in case */
+			tsd.sfd_name[sizeof(tsd.sfd_name)-1] = 0;
+			strcpy(name, tsd.sfd_name);
+			*slot = i + 1;
+			return 0;
+		}
+	}
+
+	*slot = nentries;
+	return ENOENT;
+}
+
 /*
  * Look for a name in a directory and hand back a vnode for the
  * file, if there is one.
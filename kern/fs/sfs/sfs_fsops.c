@@ -42,6 +42,7 @@
 #include <vfs.h>
 #include <device.h>
 #include <sfs.h>
+#include <kmalloc_tag.h>
 #include "sfsprivate.h"
 
 
@@ -214,7 +215,7 @@ sfs_fs_destroy(struct sfs_fs *sfs)
 	}
 	vnodearray_destroy(sfs->sfs_vnodes);
 	KASSERT(sfs->sfs_device == NULL);
-	kfree(sfs);
+	kfree_tagged(sfs, KMT_SFS);
 }
 
 /*
@@ -280,7 +281,7 @@ sfs_fs_create(void)
 	COMPILE_ASSERT(SFS_BLOCKSIZE % sizeof(struct sfs_direntry) == 0);
 
 	/* Allocate object */
-	sfs = kmalloc(sizeof(struct sfs_fs));
+	sfs = kmalloc_tagged(sizeof(struct sfs_fs), KMT_SFS);
 	if (sfs==NULL) {
 		goto fail;
 	}
@@ -313,7 +314,7 @@ sfs_fs_create(void)
 	return sfs;
 
 cleanup_object:
-	kfree(sfs);
+	kfree_tagged(sfs, KMT_SFS);
 fail:
 	return NULL;
 }
@@ -128,6 +128,56 @@ sfs_write(struct vnode *v, struct uio *uio)
 	return result;
 }
 
+/*
+ * Called for getdirentry(). The offset is the directory slot to start
+ * looking at; afterwards it is the slot after the entry handed back.
+ * At the end of the directory nothing is transferred.
+ */
+static
+int
+sfs_getdirentry(struct vnode *v, struct uio *uio)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	char name[SFS_NAMELEN];
+	int slot, result;
+
+	KASSERT(uio->uio_rw==UIO_READ);
+
+	if (uio->uio_offset < 0) {
+		return EINVAL;
+	}
+
+	vfs_biglock_acquire();
+
+	/* The offset is a slot number; anything past the last slot is just the end */
+	if (uio->uio_offset >=
+	    (off_t)(sv->sv_i.sfi_size / sizeof(struct sfs_direntry))) {
+		vfs_biglock_release();
+		return 0;
+	}
+	slot = uio->uio_offset;
+
+	result = sfs_dir_nextentry(sv, &slot, name);
+	if (result == ENOENT) {
+		uio->uio_offset = slot;
+		vfs_biglock_release();
+		return 0;
+	}
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
+	/* A name longer than the buffer is cut short, as on other filesystems */
+	result = uiomove(name, strlen(name), uio);
+	if (result == 0) {
+		uio->uio_offset = slot;
+	}
+
+	vfs_biglock_release();
+	return result;
+}
+
 /*
  * Called for ioctl()
  */
@@ -594,6 +644,7 @@ const struct vnode_ops sfs_fileops = {
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
 	.vop_isseekable = sfs_isseekable,
+	.vop_poll = vnode_poll_ready,
 	.vop_fsync = sfs_fsync,
 	.vop_mmap = sfs_mmap,
 	.vop_truncate = sfs_truncate,
@@ -622,12 +673,13 @@ const struct vnode_ops sfs_dirops = {
 
 	.vop_read = vopfail_uio_isdir,
 	.vop_readlink = vopfail_uio_inval,
-	.vop_getdirentry = vopfail_uio_nosys,
+	.vop_getdirentry = sfs_getdirentry,
 	.vop_write = vopfail_uio_isdir,
 	.vop_ioctl = sfs_ioctl,
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
 	.vop_isseekable = sfs_isseekable,
+	.vop_poll = vnode_poll_ready,
 	.vop_fsync = sfs_fsync,
 	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = vopfail_truncate_isdir,
@@ -2,16 +2,28 @@
 #define _ABSTRACT_FILE_H_
 #include <types.h>
 #include <vnode.h>
+#include <spinlock.h>
 
 /*
  * @brief represents an open file
  */
 struct abstractfile
 {  
-    unsigned int ref_count;
+    /*
+     * Changed atomically with af_incref/af_decref, without any lock.
+     * kfile_table's location_lk is only taken once it drops to zero.
+     */
+    volatile spinlock_data_t ref_count;
     unsigned int status;    // Indicates how the file is open (i.e. read/write/etc)
     off_t offset;    // Indicates location of the curser in the file (what line to read/write next)
     struct vnode* vn;     // Pointer to the file in the virtual file system
+
+    /*
+     * Held across any I/O that uses and moves the offset, so reads and writes
+     * through the same open file are atomic with respect to each other.
+     * I/O on different open files never waits on each other.
+     */
+    struct lock* offset_lk;
 };
 
 
@@ -27,6 +39,24 @@ struct abstractfile
 int
 af_create(unsigned int status ,struct vnode* node, struct abstractfile** af);
 
+/**
+ * @brief Takes another reference to a file. The caller must already hold one.
+ * 
+ * @param af the file
+ */
+void
+af_incref(struct abstractfile* af);
+
+/**
+ * @brief Drops a reference to a file.
+ * 
+ * @param af the file
+ * 
+ * @return true if that was the last reference, and the file should be removed from the table
+ */
+bool
+af_decref(struct abstractfile* af);
+
 /**
  * @brief destroys a file, this should be called by the open file table when the reference count to the file is zero
  * @param af the file to destroy
@@ -36,4 +66,14 @@ af_create(unsigned int status ,struct vnode* node, struct abstractfile** af);
 int 
 af_destroy(struct abstractfile** af);
 
+/**
+ * @brief Closes and frees a file that was never put in kfile_table, dropping
+ *        the reference it was created with, which must be the only one.
+ *        For undoing af_create when a later step of opening fails.
+ *
+ * @param af the file; its vnode reference is released too
+ */
+void
+af_discard(struct abstractfile* af);
+
 #endif
\ No newline at end of file
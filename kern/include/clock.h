@@ -87,5 +87,11 @@ void timespec_sub(const struct timespec *t1,
  */
 void clocksleep(int seconds);
 
+/*
+ * clocksleep_ticks() suspends execution for at least the requested
+ * number of hardclock ticks; there are HZ of them a second.
+ */
+void clocksleep_ticks(unsigned ticks);
+
 
 #endif /* _CLOCK_H_ */
@@ -35,6 +35,12 @@
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
+/*
+ * Number of scheduler priority levels; each cpu has one run queue per
+ * level. Level 0 is the highest. See schedule() in thread.c.
+ */
+#define CPU_NPRIORITIES 4
+
 
 /*
  * Per-cpu structure
@@ -59,15 +65,22 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_deadthreads; /* Exited threads kept for reuse */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
+	unsigned c_steals;		/* Threads stolen while idle */
+	unsigned c_migrations;		/* Threads pushed to other cpus */
+	unsigned c_wakeups_kept;	/* Wakeups placed on previous cpu */
+	unsigned c_wakeups_moved;	/* Wakeups placed on an idle cpu */
+	unsigned c_threads_reused;	/* Forks served from c_deadthreads */
+	unsigned c_threads_created;	/* Forks that had to allocate */
 
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the runqueue lock.
 	 */
 	bool c_isidle;			/* True if this cpu is idle */
-	struct threadlist c_runqueue;	/* Run queue for this cpu */
+	struct threadlist c_runqueue[CPU_NPRIORITIES]; /* Run queues */
 	struct spinlock c_runqueue_lock;
 
 	/*
@@ -141,6 +154,12 @@ void cpu_irqon(void);
 void cpu_idle(void);
 void cpu_halt(void);
 
+/*
+ * Read the processor's free-running cycle counter. It wraps, so only
+ * differences between two readings on the same cpu mean anything.
+ */
+uint32_t cpu_cycles(void);
+
 /*
  * Interprocessor interrupts.
  *
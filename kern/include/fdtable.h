@@ -0,0 +1,127 @@
+#ifndef _FDTABLE_H_
+#define _FDTABLE_H_
+
+#include <types.h>
+#include <spinlock.h>
+
+/*
+ * Per-process file descriptor tables.
+ *
+ * A descriptor table maps a process's fds to indexes in the system open
+ * file table (kfile_table). Each fd in a table holds one reference to its
+ * file, whoever the table belongs to.
+ *
+ * A table starts with FDTABLE_INIT_SIZE slots and doubles when an fd past
+ * the end is needed, up to __OPEN_MAX. A bitmap of the fds in use, with a
+ * hint to the first word that may have a free bit, finds the lowest free
+ * fd without looking at every slot.
+ *
+ * fork shares the parent's table with the child instead of copying it, so
+ * forking costs the same however many files are open. A shared table is
+ * never changed: whichever process wants to change it first calls
+ * fdtable_unshare, which gives it a copy of its own.
+ *
+ * Apart from the reference count, a table is protected by the fdtable_lk
+ * of the process using it. Shared tables need no more than that, since
+ * nobody writes to them.
+ */
+
+#define FDTABLE_EMPTY -1
+#define FDTABLE_INIT_SIZE 32
+
+struct fdtable
+{
+    int* fdt_map;                   // fd -> kfile_table index, or FDTABLE_EMPTY
+    uint32_t* fdt_bitmap;           // bit set for each fd in use
+    unsigned int fdt_size;          // slots in fdt_map, a multiple of 32
+    unsigned int fdt_count;         // fds in use
+    unsigned int fdt_hint;          // no free fd in bitmap words before this one
+
+    struct spinlock fdt_reflock;    // protects fdt_refcount
+    unsigned int fdt_refcount;      // processes using this table
+};
+
+/**
+ * @brief Creates an empty descriptor table.
+ *
+ * @return the table, or NULL if out of memory
+ */
+struct fdtable*
+fdtable_create(void);
+
+/**
+ * @brief Takes another reference to a table, for a process that is going to share it.
+ *
+ * @param fdt the table
+ *
+ * @return fdt
+ */
+struct fdtable*
+fdtable_share(struct fdtable* fdt);
+
+/**
+ * @brief Drops a reference to a table. The last one closes every fd in it and frees it.
+ *
+ * @param fdt the table
+ */
+void
+fdtable_release(struct fdtable* fdt);
+
+/**
+ * @brief Makes sure a table is not shared before it is changed, replacing it with a
+ *        private copy if it is. Must hold the process's fdtable_lk for writing.
+ *
+ * @param fdtp where the process keeps its table; updated if it is copied
+ *
+ * @return 0 on success, ENOMEM
+ */
+int
+fdtable_unshare(struct fdtable** fdtp);
+
+/**
+ * @brief Looks up an fd.
+ *
+ * @param fdt the table
+ * @param fd the fd, which need not be valid
+ *
+ * @return its index in kfile_table, or FDTABLE_EMPTY if it is out of range or not open
+ */
+int
+fdtable_get(struct fdtable* fdt, int fd);
+
+/**
+ * @brief Finds the lowest unused fd, growing the table if it is full.
+ *
+ * @param fdt the table, which must not be shared
+ * @param fd the fd, used as a return value
+ *
+ * @return 0 on success, EMFILE if __OPEN_MAX fds are open, ENOMEM
+ */
+int
+fdtable_find_free(struct fdtable* fdt, int* fd);
+
+/**
+ * @brief Points an unused fd at a file, growing the table if fd is past its end.
+ *        The caller hands over its reference to the file.
+ *
+ * @param fdt the table, which must not be shared
+ * @param fd an unused fd less than __OPEN_MAX
+ * @param ft_index the file's index in kfile_table
+ *
+ * @return 0 on success, ENOMEM
+ */
+int
+fdtable_set(struct fdtable* fdt, int fd, int ft_index);
+
+/**
+ * @brief Marks an fd unused. Its reference to the file now belongs to the caller.
+ *
+ * @param fdt the table, which must not be shared
+ * @param fd an fd in use
+ *
+ * @return the file's index in kfile_table
+ */
+int
+fdtable_clear(struct fdtable* fdt, int fd);
+
+#endif
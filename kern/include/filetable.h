@@ -1,29 +1,68 @@
 #ifndef _FILE_TABLE_H_
 #define _FILE_TABLE_H_
 
-/* 
- * For now this is the amount of  total files we are allowing in our system. 
- * would be better to dynamiclly change the size of the table.
+struct proc;
+struct abstractfile;
+
+/*
+ * The open file table grows a chunk of FT_CHUNK_SIZE slots at a time,
+ * up to FT_MAX_CHUNKS chunks, and gives chunks back when the files at
+ * the end of it are closed. Chunks never move once allocated, so a file
+ * can be looked up by index without holding location_lk as long as the
+ * caller holds a reference to it (through an fd, say).
+ *
+ * Free slots are kept on a doubly linked list threaded through the
+ * chunks, so adding and removing a file never has to scan the table.
  */
-#define FILETABLE_INIT_SIZE 18
+#define FT_CHUNK_SHIFT 6
+#define FT_CHUNK_SIZE (1 << FT_CHUNK_SHIFT)
+#define FT_MAX_CHUNKS 128
+
+#define FT_NO_SLOT -1
+
+/* The file at index I of filetable FT, as an lvalue. I must be in a chunk that exists. */
+#define FT_FILE(ft, i) \
+    ((ft)->chunks[(unsigned)(i) >> FT_CHUNK_SHIFT]->files[(unsigned)(i) & (FT_CHUNK_SIZE - 1)])
 
 struct filetable* kfile_table;
 
+/*
+ * @brief A chunk of slots in the open files table
+ */
+struct
+ft_chunk
+{
+    struct abstractfile* files[FT_CHUNK_SIZE];
+
+    int next_free[FT_CHUNK_SIZE];     // free list links; only meaningful for empty slots
+    int prev_free[FT_CHUNK_SIZE];
+
+    unsigned int used;                // slots in this chunk holding a file
+};
+
 /*
  * @brief represents the open files table
  */
 struct 
 filetable
 {  
-    struct abstractfile** files;      // All files open on the file table
+    struct ft_chunk* chunks[FT_MAX_CHUNKS];
+
+    unsigned int num_chunks;
 
-    unsigned int curr_size;
+    unsigned int curr_size;           // num_chunks * FT_CHUNK_SIZE
 
     unsigned int files_counter;
 
-    //struct lock** files_lk;
+    int free_head;                    // first free slot, or FT_NO_SLOT
+    int free_tail;
 
-    struct lock* location_lk; // This will only be used by open 
+    /*
+     * Protects the table itself: the chunks, the free list and the counts.
+     * Reference counts of the files are atomic and don't need it.
+     * Never held across a vnode operation; see abstractfile offset_lk.
+     */
+    struct lock* location_lk;
 };
 
 /**
@@ -36,9 +75,13 @@ void
 ft_destroy(struct filetable* ft);
 
 /**
- * @brief Dynamiclly changes the size of kfile_talbe to allow for more open files
+ * @brief Grows kfile_table by a chunk if it has no free slot left, and gives back
+ *        trailing chunks that are empty while there is slack elsewhere.
+ *        Must hold location_lk.
+ * 
+ * @return 0 on success, ENFILE if the table is at FT_MAX_CHUNKS, ENOMEM
  */
-void 
+int 
 ft_adjust_size(void);
 
 /**
@@ -66,6 +109,26 @@ ft_add_file(struct abstractfile** file, int* location);
 void 
 ft_remove_file(unsigned int index);
 
+/**
+ * @brief Takes an extra reference to an open file (and its vnode), so it stays valid after
+ *        the caller lets go of its process's fd table lock. Drop it with ft_release_file.
+ * 
+ * @param index index of the file in the open file table, which must hold a file
+ * 
+ * @return the file
+ */
+struct abstractfile* 
+ft_hold_file(unsigned int index);
+
+/**
+ * @brief Drops a reference to an open file and its vnode, removing the file from the table
+ *        if it was the last one. Used by close and to undo ft_hold_file.
+ * 
+ * @param index index of the file in the open file table
+ */
+void 
+ft_release_file(unsigned int index);
+
 
 /** 
  * @brief this is a helper function to open file internally in the kernel. the systemcall for open
@@ -82,6 +145,18 @@ ft_remove_file(unsigned int index);
 int 
 __open(char* kpath, int flags, struct abstractfile** af);
 
+/**
+ * @brief Copies a path in from user space into kmalloc'd memory, for the
+ *        system calls that take paths.
+ *
+ * @param path the user's path
+ * @param kpath the copy, used as a return value; the caller frees it
+ *
+ * @return 0 on success, ENOMEM, or the errors of copyinstr
+ */
+int
+__copyin_path(userptr_t path, char** kpath);
+
 /** 
  * @brief this is a helper function to close file internally in the kernel. the systemcall for open
  * will reuse this code so make sure it is safe to use in the kernel before calling it.
@@ -0,0 +1,27 @@
+#ifndef _KERN_DIRENT_H_
+#define _KERN_DIRENT_H_
+
+/*
+ * Directory entries as returned by getdirentries().
+ *
+ * getdirentries() fills a buffer with as many whole entries as fit, one
+ * after another. Each carries the entry's name and what fstat() on it
+ * would return, so listing a directory with sizes and types takes one
+ * call per buffer instead of an open, fstat and close per entry.
+ *
+ * Entries vary in length; d_reclen is the distance to the next one.
+ * struct stat must be defined before including this file.
+ */
+struct dirent
+{
+    struct stat d_stat;         // the entry's attributes
+    unsigned short d_reclen;    // bytes from this entry to the next
+    unsigned short d_namlen;    // length of d_name, not counting the NUL
+    char d_name[];              // the name, NUL-terminated
+};
+
+/* Bytes taken by an entry whose name is NAMLEN long; keeps d_stat aligned */
+#define DIRENT_RECLEN(namlen) \
+    ((sizeof(struct dirent) + (namlen) + 1 + 7) & ~(size_t)7)
+
+#endif /* _KERN_DIRENT_H_ */
@@ -0,0 +1,24 @@
+#ifndef _KERN_POLL_H_
+#define _KERN_POLL_H_
+
+/*
+ * Definitions for poll().
+ */
+
+struct pollfd
+{
+    int fd;             // descriptor to look at; negative ones are skipped
+    short events;       // what the caller wants to know about
+    short revents;      // what is so, filled in by poll
+};
+
+/* Can be asked for in events */
+#define POLLIN      0x0001  // a read won't block
+#define POLLOUT     0x0004  // a write won't block
+
+/* Always reported when so, whether asked for or not */
+#define POLLERR     0x0008  // the descriptor is in error; for a pipe, no reader is left
+#define POLLHUP     0x0010  // the other end is gone; for a pipe, no writer is left
+#define POLLNVAL    0x0020  // fd is not open
+
+#endif /* _KERN_POLL_H_ */
@@ -0,0 +1,77 @@
+#ifndef _KMALLOC_TAG_H_
+#define _KMALLOC_TAG_H_
+
+#include <types.h>
+
+/*
+ * Tagged kernel memory accounting.
+ *
+ * Every kmalloc is charged to a tag naming the subsystem that owns the
+ * memory, so that during a leak or a spike we can see who is holding
+ * it. Plain kmalloc/kfree are charged to KMT_UNTAGGED.
+ *
+ * Counters are kept per cpu (bytes, allocations and frees), so that
+ * accounting doesn't add a shared cache line to every kmalloc. The
+ * totals and the peak are only computed when sampled: on every
+ * hardclock on cpu 0, and whenever the stats are printed. A short
+ * spike between two samples can therefore be missed by the peak.
+ *
+ * Bytes are counted in allocator units (block or page size), not in
+ * requested sizes, since that is what the memory actually costs.
+ */
+
+typedef enum
+{
+    KMT_UNTAGGED = 0,   // plain kmalloc/kfree
+    KMT_VM,             // address spaces and VM bookkeeping
+    KMT_PAGETABLE,      // page table pages (from alloc_kpages)
+    KMT_FILE,           // open file objects and the file table
+    KMT_PROC,           // processes and the process table
+    KMT_THREAD,         // threads, stacks, cpus, wait channels, synch primitives
+    KMT_SFS,            // SFS vnodes and file system structures
+    KMT_NTAGS
+} kmalloc_tag_t;
+
+/**
+ * @brief kmalloc, charging the memory to TAG.
+ *
+ * @param sz number of bytes
+ * @param tag the subsystem the memory belongs to
+ *
+ * @return the memory, or NULL if out of memory
+ */
+void *
+kmalloc_tagged(size_t sz, kmalloc_tag_t tag);
+
+/**
+ * @brief kfree for memory from kmalloc_tagged. TAG must be the tag it was allocated with.
+ *
+ * @param ptr the memory, may be NULL
+ * @param tag the tag passed to kmalloc_tagged
+ */
+void
+kfree_tagged(void *ptr, kmalloc_tag_t tag);
+
+/**
+ * @brief Charge (or with a negative BYTES, credit) TAG for memory not obtained through kmalloc,
+ * e.g. page table pages taken directly from alloc_kpages.
+ *
+ * @param tag the tag to charge
+ * @param bytes the number of bytes allocated (positive) or freed (negative)
+ */
+void
+kmalloc_tag_account(kmalloc_tag_t tag, long bytes);
+
+/**
+ * @brief Update the peak usage of every tag. Called from hardclock.
+ */
+void
+kmalloc_tag_sample(void);
+
+/**
+ * @brief Print current bytes, peak bytes, allocations and frees for every tag, largest first.
+ */
+void
+kmalloc_tag_printstats(void);
+
+#endif
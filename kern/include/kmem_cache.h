@@ -0,0 +1,91 @@
+#ifndef _KMEM_CACHE_H_
+#define _KMEM_CACHE_H_
+
+#include <types.h>
+#include <spinlock.h>
+#include <kmalloc_tag.h>
+
+/*
+ * Object caches layered on kmalloc.
+ *
+ * Hot kernel objects (processes, open files, locks) are created and
+ * destroyed constantly, and every time we used to kmalloc them and
+ * then set up every field, including creating the locks and wait
+ * channels they embed. An object cache keeps a bounded number of freed
+ * objects around in their *constructed* state, so the common path
+ * only has to fill in the per-instance fields.
+ *
+ * The contract is the usual slab one:
+ *   - kc_ctor runs once, when an object is first taken from kmalloc,
+ *     and sets up the expensive invariant state.
+ *   - kmem_cache_free must be handed an object that is back in that
+ *     constructed state (locks unlocked, lists empty, ...).
+ *   - kc_dtor runs only when an object leaves the cache for good.
+ *
+ * Caches are meant to be static and set up with KMEM_CACHE_INITIALIZER,
+ * so they can be used before any bootstrap function has run (locks are
+ * created in proc_bootstrap, before the thread system exists).
+ */
+
+/* Number of constructed objects a cache holds on to */
+#define KMEM_CACHE_SIZE 32
+
+struct kmem_cache
+{
+    const char *kc_name;
+    size_t kc_objsize;
+    kmalloc_tag_t kc_tag;           // what the objects are charged to
+    int (*kc_ctor)(void *obj);      // returns 0 or an errno value
+    void (*kc_dtor)(void *obj);
+
+    struct spinlock kc_lock;        // protects everything below
+    void *kc_objs[KMEM_CACHE_SIZE]; // constructed, free objects
+    unsigned int kc_nfree;
+
+    /* statistics */
+    unsigned int kc_hits;           // allocations served from kc_objs
+    unsigned int kc_misses;         // allocations that had to construct
+    unsigned int kc_releases;       // frees that had to destruct
+
+    bool kc_registered;             // on the list printed by kmem_cache_printstats
+    struct kmem_cache *kc_next;
+};
+
+#define KMEM_CACHE_INITIALIZER(name, type, tag, ctor, dtor) \
+    { (name), sizeof(type), (tag), (ctor), (dtor), SPINLOCK_INITIALIZER, \
+      { NULL }, 0, 0, 0, 0, false, NULL }
+
+/**
+ * @brief Get an object from the cache, constructing a new one if the cache is empty.
+ *
+ * @param kc the cache
+ *
+ * @return a constructed object, or NULL if out of memory or the constructor failed
+ */
+void *
+kmem_cache_alloc(struct kmem_cache *kc);
+
+/**
+ * @brief Return an object to the cache. If the cache is full, the object is destructed and freed.
+ *
+ * @param kc the cache the object came from
+ * @param obj the object, which must be back in its constructed state
+ */
+void
+kmem_cache_free(struct kmem_cache *kc, void *obj);
+
+/**
+ * @brief Destruct and free every object held by the cache.
+ *
+ * @param kc the cache
+ */
+void
+kmem_cache_reap(struct kmem_cache *kc);
+
+/**
+ * @brief Print hit/miss statistics for every cache that has been used.
+ */
+void
+kmem_cache_printstats(void);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+#include <types.h>
+#include <spinlock.h>
+#include "opt-lockstat.h"
+
+/*
+ * Lock contention statistics.
+ *
+ * With "options lockstat" in the kernel config, every sleep lock, every
+ * rwlock and every spinlock that has been given a name with
+ * spinlock_setname() is charged to a record keyed by its name. All the locks of the same
+ * name (e.g. every process's "fd lk") share one record. For each name
+ * we keep the number of acquisitions, how many of them had to wait,
+ * and the total and longest wait and hold times in cpu cycles.
+ *
+ * Times come from cpu_cycles(). A thread can wait for or hold a sleep
+ * lock on one cpu and get it or let go of it on another, so this
+ * assumes the cpus' cycle counters run roughly in step (on System/161
+ * they do); an occasional negative difference is counted as zero.
+ *
+ * Without the option none of this is compiled in: the lock structures
+ * don't grow and the lock functions have no extra code.
+ */
+
+#define LOCKSTAT_NAMELEN 24
+
+struct lockstat
+{
+    char ls_name[LOCKSTAT_NAMELEN];
+    bool ls_spin;                   // spinlock rather than sleep lock or rwlock
+
+    struct spinlock ls_lock;        // protects the counters below
+    uint64_t ls_acquires;
+    uint64_t ls_contended;          // acquisitions that found the lock held
+    uint64_t ls_wait_cycles;        // total time spent waiting
+    uint32_t ls_wait_max;
+    uint64_t ls_hold_cycles;        // total time the lock was held
+    uint32_t ls_hold_max;
+};
+
+#if OPT_LOCKSTAT
+
+/**
+ * @brief Find the record for locks named NAME, creating it if needed.
+ *
+ * @param name the lock name; it is copied (and truncated if long)
+ * @param spin true for spinlocks, false for sleep locks and rwlocks
+ *
+ * @return the record, or NULL if the table is full (the lock then isn't tracked)
+ */
+struct lockstat *
+lockstat_get(const char *name, bool spin);
+
+/**
+ * @brief Charge an acquisition to LS.
+ *
+ * @param ls the record, may be NULL
+ * @param contended whether the lock was held when we first tried
+ * @param waited cycles from the first try until the lock was ours
+ */
+void
+lockstat_acquired(struct lockstat *ls, bool contended, uint32_t waited);
+
+/**
+ * @brief Charge a release to LS.
+ *
+ * @param ls the record, may be NULL
+ * @param held cycles from acquisition to release
+ */
+void
+lockstat_released(struct lockstat *ls, uint32_t held);
+
+/**
+ * @brief Print the TOPN most contended locks, by total wait time.
+ *
+ * @param topn how many to print, 0 for all
+ */
+void
+lockstat_print(unsigned topn);
+
+/**
+ * @brief Zero all the counters, keeping the records.
+ */
+void
+lockstat_reset(void);
+
+#endif /* OPT_LOCKSTAT */
+
+#endif
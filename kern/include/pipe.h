@@ -0,0 +1,71 @@
+#ifndef _PIPE_H_
+#define _PIPE_H_
+
+#include <types.h>
+#include <spinlock.h>
+#include <vnode.h>
+#include <poll.h>
+
+/*
+ * Pipes.
+ *
+ * A pipe is a ring buffer with a vnode for each end. The read end only
+ * reads and the write end only writes; when the last reference to an
+ * end goes away its vnode is reclaimed, which is how the other end
+ * finds out. The pipe itself is freed with the second end.
+ *
+ * p_head and p_tail count every byte ever written and read, so the ring
+ * holds p_head - p_tail bytes, and each is only written by one side:
+ * p_head by the writer and p_tail by the reader. While the ring is
+ * neither full nor empty a read and a write can copy at the same time,
+ * and neither takes any lock.
+ *
+ * Several processes can share an end after fork, so each end has an
+ * owner flag that makes one reader and one writer at a time. Taking
+ * it is a single test-and-set unless someone else has it.
+ *
+ * p_lock is only taken to sleep, and to wake sleepers when the
+ * p_rwaiters or p_wwaiters count says there are any. Pollers of each
+ * end are on that end's pollhead, which is only locked when there are
+ * some.
+ */
+
+/* Must be a power of two */
+#define PIPE_SIZE (16 * 1024)
+
+struct pipe
+{
+    char* p_buf;                            // PIPE_SIZE bytes of ring
+    volatile unsigned int p_head;           // bytes written; only the writer changes it
+    volatile unsigned int p_tail;           // bytes read; only the reader changes it
+
+    volatile spinlock_data_t p_rbusy;       // a reader is in pipe_read
+    volatile spinlock_data_t p_wbusy;       // a writer is in pipe_write
+
+    struct spinlock p_lock;                 // for the wait channels and the closed flags
+    struct wchan* p_rwc;                    // readers waiting for data or their turn
+    struct wchan* p_wwc;                    // writers waiting for room or their turn
+    volatile unsigned int p_rwaiters;       // threads on or about to go on p_rwc
+    volatile unsigned int p_wwaiters;       // threads on or about to go on p_wwc
+    volatile bool p_rclosed;                // the read end has been reclaimed
+    volatile bool p_wclosed;                // the write end has been reclaimed
+
+    struct pollhead p_rph;                  // polling the read end
+    struct pollhead p_wph;                  // polling the write end
+
+    struct vnode p_rvn;                     // the read end
+    struct vnode p_wvn;                     // the write end
+};
+
+/**
+ * @brief Creates a pipe. Each end comes with one reference, for the caller.
+ *
+ * @param rvn the read end, used as a return value
+ * @param wvn the write end, used as a return value
+ *
+ * @return 0 on success, ENOMEM
+ */
+int
+pipe_create(struct vnode** rvn, struct vnode** wvn);
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef _POLL_H_
+#define _POLL_H_
+
+#include <types.h>
+#include <spinlock.h>
+#include <timer.h>
+#include <kern/poll.h>
+
+/*
+ * Readiness notification for poll.
+ *
+ * Anything whose readiness can change -- a pipe end, the console --
+ * keeps a pollhead, the list of pollers waiting on it. Its poll hook
+ * (VOP_POLL, or DEVOP_POLL for devices) is handed a pollentry. If the
+ * entry is not NULL, the hook adds it to the pollhead with
+ * pollhead_add *before* working out what is ready, so anything that
+ * changes after the check finds the entry there. Whatever changes the
+ * readiness calls pollwakeup on the same pollhead afterwards.
+ *
+ * pollwakeup only goes through the entries on the one pollhead, so a
+ * change to one pipe wakes the pollers of that pipe and nobody else.
+ * It costs one load when nobody is polling, and can be called from an
+ * interrupt handler.
+ *
+ * Each poll call has one pollwaiter, which it sleeps on, and one
+ * pollentry for each fd.
+ */
+
+struct pollwaiter
+{
+    struct spinlock pw_lock;        // protects the flags and the wchan
+    struct wchan* pw_wchan;
+    volatile bool pw_woken;         // something changed since the last look
+    volatile bool pw_timedout;      // the timeout ran out
+    bool pw_armed;                  // pw_timer has been started
+    struct timer pw_timer;          // for the timeout
+};
+
+struct pollentry
+{
+    struct pollwaiter* pe_waiter;           // who to wake
+    struct pollhead* pe_head;               // what it's on, or NULL
+    struct pollentry* pe_next;              // next on the same pollhead
+    struct pollentry* volatile* pe_prevp;   // what points to us
+};
+
+struct pollhead
+{
+    struct spinlock ph_lock;
+    struct pollentry* volatile ph_first;
+};
+
+/**
+ * @brief Sets up an empty pollhead.
+ */
+void
+pollhead_init(struct pollhead* ph);
+
+/**
+ * @brief Cleans up a pollhead, which must have nobody on it.
+ */
+void
+pollhead_cleanup(struct pollhead* ph);
+
+/**
+ * @brief Puts an entry on a pollhead. Called by poll hooks when handed an entry.
+ *
+ * @param pe the entry, which must not be on any pollhead
+ * @param ph the pollhead of the object being polled
+ */
+void
+pollhead_add(struct pollentry* pe, struct pollhead* ph);
+
+/**
+ * @brief Wakes everyone polling on a pollhead. Call after changing the readiness.
+ *
+ * @param ph the pollhead
+ */
+void
+pollwakeup(struct pollhead* ph);
+
+/**
+ * @brief Sets up a waiter and one entry for it per descriptor.
+ *
+ * @param pw the waiter
+ * @param entries its entries
+ * @param nentries how many there are
+ *
+ * @return 0 on success, ENOMEM
+ */
+int
+pollwaiter_init(struct pollwaiter* pw, struct pollentry* entries, unsigned nentries);
+
+/**
+ * @brief Takes every entry off the pollhead it is on and cleans up the waiter.
+ *        Everything polled must still be alive.
+ *
+ * @param pw the waiter
+ * @param entries its entries
+ * @param nentries how many there are
+ */
+void
+pollwaiter_cleanup(struct pollwaiter* pw, struct pollentry* entries, unsigned nentries);
+
+/**
+ * @brief Sleeps until a pollwakeup on one of the waiter's entries, or the timeout.
+ *        Returns straight away if there was one since the last call.
+ *
+ * @param pw the waiter
+ * @param ticks the timeout, or 0 for none; only the first call arms it
+ *
+ * @return true if the timeout has run out
+ */
+bool
+pollwaiter_sleep(struct pollwaiter* pw, unsigned ticks);
+
+#endif
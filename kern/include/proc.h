@@ -38,13 +38,14 @@
 
 #include <spinlock.h>
 #include <thread.h> /* required for struct threadarray */
+#include <workqueue.h>
+#include <fdtable.h>
 
 #include <limits.h>
 
 /**	
  * Constants
  */
-#define FDTABLE_EMPTY -1
 #define MAX_CHILDREN_PER_PERSON 32
 
 struct addrspace;
@@ -78,17 +79,14 @@ struct proc {
 	/* 
 	 * Open File Descriptor table 
 	 * maps a process's file decriptor (fd) to its actual index in the
-	 * open file table of the whole system
+	 * open file table of the whole system. May be shared with other
+	 * processes after a fork; see fdtable.h.
 	 * 
-	 * Comes with a lock to avoid race conditions on fd during open/close/read/etc operations
+	 * Comes with a lock to avoid race conditions on fd during open/close/read/etc operations.
+	 * Lookups (read, write, lseek) take it shared, anything that changes the table exclusive.
 	 */
-	int fdtable[__OPEN_MAX];		
-	struct lock* fdtable_lk;
-
-	//struct lock** fdtable_index_lks; TBD if needed
-
-	/* Amount of currently opened files for this proccess */	
-	unsigned int fdtable_num_entries;
+	struct fdtable* p_fdtable;
+	struct rwlock* fdtable_lk;
 
 	int p_pid;
 
@@ -102,6 +100,9 @@ struct proc {
 
 	procstate_t state;
 	volatile int exit_status;
+
+	/* Runs proc_destroy on a worker thread; see proc_destroy_later */
+	struct work p_reapwork;
 };
 
 /* This is the process structure for the kernel and for kernel-only threads. */
@@ -116,6 +117,13 @@ struct proc *proc_create_runprogram(const char *name);
 /* Destroy a process. */
 void proc_destroy(struct proc *proc);
 
+/*
+ * Destroy a dead process on a worker thread instead of in the caller.
+ * The caller must not hold its children_lk, and must not touch it
+ * afterwards.
+ */
+void proc_destroy_later(struct proc *proc);
+
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
@@ -27,7 +27,7 @@ struct proctable
 
     // will probably need a lock her for assignment 5
 
-    struct lock* pid_lk;
+    struct rwlock* pid_lk;
 
     unsigned int curr_size;         // Current size of the table, dynamically allocated
 
@@ -59,7 +59,7 @@ pt_adjust_size(void);
  * @param pr the new process
  * @param pid the new pid for this process
  * 
- * @warning pt_find_free_fd() should be called before to allow the parent function to check if its even relavent to call this function.
+ * @warning pt_find_avail_pid() should be called before to allow the parent function to check if its even relavent to call this function.
  * this function will still return an error if the pid is invalid
  * @return returns the pid of the added process
  */
@@ -74,16 +74,6 @@ pt_add_proc(struct proc* pr, int pid);
 void 
 pt_remove_proc(int pid);
 
-/**
- * @brief helper function to find a free location in a process's file descriptor table
- * 
- * @param fd a free index, used as a return value
- * 
- * @return compliance with errno, 0 on success
- */
-int 
-pt_find_free_fd(struct proc* pr, int* fd);
-
 /**
  * @brief finds available pid
  * 
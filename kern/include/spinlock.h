@@ -36,6 +36,7 @@
  */
 
 #include <cdefs.h>
+#include "opt-lockstat.h"
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -50,33 +51,76 @@
  *
  * Note that spinlocks are held by CPUs, not by threads.
  *
+ * There are two kinds, chosen when the lock is initialized:
+ *
+ *   - test-and-set (the default): waiters poll the lock word and race
+ *     to grab it when it is released, backing off exponentially after
+ *     each lost race. Cheapest when uncontended, but not fair; under
+ *     heavy contention one cpu can lose over and over.
+ *
+ *   - ticket: each waiter atomically takes a number from splk_next and
+ *     waits until splk_lock (now serving) reaches it, polling less
+ *     often the further back in line it is. First come, first served,
+ *     for locks that many cpus fight over.
+ *
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
  */
+struct lockstat;
+
 struct spinlock {
 	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
+	volatile spinlock_data_t splk_next; /* Next ticket (ticket locks). */
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
+	bool splk_ticket;		    /* True for a ticket lock. */
+#if OPT_LOCKSTAT
+	const char *splk_name;		    /* Name for lockstat, or NULL. */
+	struct lockstat *splk_stat;	    /* Its lockstat record. */
+	uint32_t splk_acquired_at;	    /* Cycle count when acquired. */
+#endif
 };
 
 /*
- * Initializer for cases where a spinlock needs to be static or global.
+ * Initializers for cases where a spinlock needs to be static or global.
+ * The _NAMED version also gives it a name for lock statistics; the
+ * _TICKET version makes a (named) ticket lock.
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#if OPT_LOCKSTAT
+#define SPINLOCK_INITIALIZER_KIND(ticket, name) \
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL, \
+	  (ticket), (name), NULL, 0 }
+#else
+#define SPINLOCK_INITIALIZER_KIND(ticket, name) \
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL, \
+	  (ticket) }
+#endif
+#define SPINLOCK_INITIALIZER	SPINLOCK_INITIALIZER_KIND(false, NULL)
+#define SPINLOCK_INITIALIZER_NAMED(name) \
+	SPINLOCK_INITIALIZER_KIND(false, name)
+#define SPINLOCK_INITIALIZER_TICKET(name) \
+	SPINLOCK_INITIALIZER_KIND(true, name)
 
 /*
  * Spinlock functions.
  *
  * init		Initialize the contents of a spinlock.
+ * init_ticket	Same, but make it a ticket lock.
  * cleanup	Opposite of init. Lock must be unlocked.
  *
  * acquire	Get the lock, spinning as necessary. Also disables interrupts.
  * release	Release the lock. May re-enable interrupts.
  *
  * do_i_hold	Check if the current CPU holds the lock.
+ *
+ * setname	Name the lock, so it shows up in lock statistics when
+ *		the kernel is built with "options lockstat". NAME must
+ *		stay valid for as long as the lock is used; it is
+ *		usually a string constant.
  */
 
 void spinlock_init(struct spinlock *lk);
+void spinlock_init_ticket(struct spinlock *lk);
 void spinlock_cleanup(struct spinlock *lk);
 
 void spinlock_acquire(struct spinlock *lk);
@@ -84,5 +128,7 @@ void spinlock_release(struct spinlock *lk);
 
 bool spinlock_do_i_hold(struct spinlock *lk);
 
+void spinlock_setname(struct spinlock *lk, const char *name);
+
 
 #endif /* _SPINLOCK_H_ */
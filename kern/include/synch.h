@@ -36,6 +36,7 @@
 
 
 #include <spinlock.h>
+#include "opt-lockstat.h"
 #include <thread.h>
 #include <stdbool.h>
 
@@ -89,6 +90,10 @@ struct lock {
         struct wchan *lk_wchan;
         struct spinlock lk_spinlock;
         volatile int lk_lock;
+#if OPT_LOCKSTAT
+        struct lockstat *lk_stat;       /* statistics record for lk_name */
+        uint32_t lk_acquired_at;        /* cycle count when acquired */
+#endif
 };
 
 struct lock *lock_create(const char *name);
@@ -98,6 +103,8 @@ void lock_destroy(struct lock *);
  * Operations:
  *    lock_acquire - Get the lock. Only one thread can hold the lock at the
  *                   same time.
+ *                   While the holder is running on another cpu, a
+ *                   waiter spins for a bounded time before sleeping.
  *    lock_release - Free the lock. Only the thread holding the lock may do
  *                   this.
  *    lock_do_i_hold - Return true if the current thread holds the lock;
@@ -137,6 +144,9 @@ void cv_destroy(struct cv *);
  * Operations:
  *    cv_wait      - Release the supplied lock, go to sleep, and, after
  *                   waking up again, re-acquire the lock.
+ *    cv_timedwait - Like cv_wait, but give up after TICKS hardclock
+ *                   ticks. Returns 0 if signalled, or ETIMEDOUT; the
+ *                   lock is re-acquired either way.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
  *
@@ -147,8 +157,59 @@ void cv_destroy(struct cv *);
  * These operations must be atomic. You get to write them.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
+int cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers can hold the lock at once, or a single writer.
+ * Writers are preferred: once a writer is waiting, new readers wait
+ * behind it, so a steady stream of readers can't starve it. As a
+ * consequence a thread must not take the read lock recursively.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ *
+ * The spinlock protects everything else.
+ */
+struct rwlock {
+        char *rw_name;
+        struct wchan *rw_rwchan;        /* readers waiting */
+        struct wchan *rw_wwchan;        /* writers waiting */
+        struct spinlock rw_spinlock;
+        unsigned rw_readers;            /* readers holding the lock */
+        unsigned rw_wwaiting;           /* writers waiting for the lock */
+        struct thread *rw_writer;       /* writer holding the lock */
+#if OPT_LOCKSTAT
+        struct lockstat *rw_stat;       /* statistics record for rw_name */
+        uint32_t rw_acquired_at;        /* cycle count when the writer or
+                                           the first of the readers got it */
+#endif
+};
+
+struct rwlock *rw_create(const char *name);
+void rw_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rw_rlock      - Get the lock for reading, waiting while a writer
+ *                    holds it or is waiting for it.
+ *    rw_runlock    - Release a read hold.
+ *    rw_wlock      - Get the lock for writing, waiting until there are
+ *                    no readers and no other writer.
+ *    rw_wunlock    - Release the write hold. Waiting writers go first,
+ *                    otherwise all waiting readers are woken.
+ *    rw_wlock_do_i_hold - Return true if the current thread holds the
+ *                    lock for writing; false otherwise.
+ */
+void rw_rlock(struct rwlock *);
+void rw_runlock(struct rwlock *);
+void rw_wlock(struct rwlock *);
+void rw_wunlock(struct rwlock *);
+bool rw_wlock_do_i_hold(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
@@ -32,6 +32,7 @@
 
 
 #include <cdefs.h> /* for __DEAD */
+#include <uio.h> /* for enum uio_rw */
 struct trapframe; /* from <machine/trapframe.h> */
 
 /*
@@ -58,6 +59,7 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(userptr_t user_req, userptr_t user_rem);
 
 
 /* 
@@ -151,6 +153,101 @@ sys_read(int filehandle, userptr_t buf, size_t size, int *retval);
 ssize_t 
 sys_write(int filehandle, userptr_t buf, size_t size, int *retval);
 
+/**
+ * @brief Reads from a file into several buffers, filling each before moving to the next.
+ *        The file offset is read and updated once, so no other I/O on the file lands in between.
+ *
+ * @param filehandle: Process-local file descriptor as returned from open()
+ * @param iov: User array of iovcnt struct iovec
+ * @param iovcnt: Number of buffers, at most IOV_MAX
+ * @param retval: The total number of bytes read
+ *
+ * @return 0 on success, otherwise the errors of read, and -
+ * EINVAL 	iovcnt is out of range, or the lengths add up to more than fits in the return value.
+ * ENOMEM 	Out of memory for a copy of a long iov array.
+ */
+int
+sys_readv(int filehandle, userptr_t iov, int iovcnt, int *retval);
+
+/**
+ * @brief Writes several buffers to a file, in order, as one write.
+ *
+ * @param filehandle: Process-local file descriptor as returned from open()
+ * @param iov: User array of iovcnt struct iovec
+ * @param iovcnt: Number of buffers, at most IOV_MAX
+ * @param retval: The total number of bytes written
+ *
+ * @return 0 on success, otherwise the errors of write, and those of readv
+ */
+int
+sys_writev(int filehandle, userptr_t iov, int iovcnt, int *retval);
+
+/**
+ * @brief Reads from a file at a given position, without using or moving its offset.
+ *
+ * @param filehandle: Process-local file descriptor as returned from open()
+ * @param buf: User buffer
+ * @param size: Number of bytes to read
+ * @param sp: User stack pointer; the 64-bit position is at sp+16, as for lseek
+ * @param retval: The number of bytes read
+ *
+ * @return 0 on success, otherwise the errors of read, and -
+ * ESPIPE 	fd refers to an object that can't seek, like the console.
+ * EINVAL 	The position is negative.
+ */
+int
+sys_pread(int filehandle, userptr_t buf, size_t size, int sp, int *retval);
+
+/**
+ * @brief Writes to a file at a given position, without using or moving its offset.
+ *        O_APPEND is ignored.
+ *
+ * @param filehandle: Process-local file descriptor as returned from open()
+ * @param buf: User buffer
+ * @param size: Number of bytes to write
+ * @param sp: User stack pointer; the 64-bit position is at sp+16, as for lseek
+ * @param retval: The number of bytes written
+ *
+ * @return 0 on success, otherwise the errors of write, and those of pread
+ */
+int
+sys_pwrite(int filehandle, userptr_t buf, size_t size, int sp, int *retval);
+
+/**
+ * @brief Copies data from one open file to another inside the kernel, without
+ *        passing it through user space. Reads at infd's offset and writes at
+ *        outfd's (or the end, with O_APPEND), advancing both.
+ *
+ * @param infd: File descriptor open for reading
+ * @param outfd: File descriptor open for writing, on a different file
+ * @param len: Most bytes to copy
+ * @param retval: The number of bytes copied; 0 at end of file
+ *
+ * @return 0 on success, otherwise the errors of read and write, and -
+ * EINVAL 	Both descriptors refer to the same file.
+ * ENOMEM 	Out of memory for the copy buffer.
+ */
+int
+sys_copy_file_range(int infd, int outfd, size_t len, int *retval);
+
+/**
+ * @brief The I/O part of read, write, readv, writev, pread and pwrite, for an iov
+ *        array already in the kernel whose buffers are in user space.
+ *
+ * @param filehandle process-local file descriptor
+ * @param iov the buffers
+ * @param iovcnt how many there are
+ * @param size their total length
+ * @param rw UIO_READ or UIO_WRITE
+ * @param pos where in the file to do the I/O, or NULL to use and update the file's offset
+ * @param retval the number of bytes transferred
+ *
+ * @return 0 on success, on error comply with errno
+ */
+int
+__file_io(int filehandle, struct iovec *iov, int iovcnt, size_t size, enum uio_rw rw,
+          const off_t *pos, int *retval);
+
 /**
  * @brief Closes a file in a processes file descriptor table. Will also take care of removing any reference counters.
  * 
@@ -221,6 +318,131 @@ sys_lseek(int fd, off_t pos, int sp, int64_t *retval64);
 int 
 sys_dup2(int oldfd, int newfd, int *retval);
 
+/**
+ * @brief Gets the attributes of an open file.
+ *
+ * @param filehandle: Process-local file descriptor
+ * @param statbuf: User struct stat to fill in
+ *
+ * @return 0 on success, otherwise one of the following errors -
+ * EBADF 	fd is not a valid file handle.
+ * EIO 	    A hard I/O error occurred.
+ * EFAULT 	statbuf points to an invalid address.
+ */
+int
+sys_fstat(int filehandle, userptr_t statbuf);
+
+/**
+ * @brief Reads the name of the next entry of a directory, without a NUL.
+ *        The file offset remembers where the listing is up to.
+ *
+ * @param filehandle: Process-local file descriptor of a directory open for reading
+ * @param buf: User buffer for the name
+ * @param buflen: Size of buf; a longer name is cut short
+ * @param retval: The length of the name; 0 at the end of the directory
+ *
+ * @return 0 on success, otherwise one of the following errors -
+ * EBADF 	fd is not a valid file handle, or was not opened for reading.
+ * ENOTDIR 	fd does not refer to a directory.
+ * EIO 	    A hard I/O error occurred.
+ * EFAULT 	buf points to an invalid address.
+ */
+int
+sys_getdirentry(int filehandle, userptr_t buf, size_t buflen, int *retval);
+
+/**
+ * @brief Reads as many whole entries of a directory as fit in a buffer, each a
+ *        struct dirent with the entry's name and attributes (see kern/dirent.h).
+ *
+ * @param filehandle: Process-local file descriptor of a directory open for reading
+ * @param buf: User buffer for the entries
+ * @param buflen: Size of buf; no more than 16K of it is used per call
+ * @param retval: The number of bytes of entries; 0 at the end of the directory
+ *
+ * @return 0 on success, otherwise the errors of getdirentry, and -
+ * EINVAL 	buf is too small for the next entry.
+ * ENOMEM 	Out of memory for the kernel's copy of the entries.
+ */
+int
+sys_getdirentries(int filehandle, userptr_t buf, size_t buflen, int *retval);
+
+/**
+ * @brief Creates a directory.
+ *
+ * @param path: Path of the new directory
+ * @param mode: Permissions, which are ignored
+ *
+ * @return 0 on success, otherwise the errors of vfs_mkdir, and -
+ * ENOMEM 	Out of memory for the kernel's copy of the path.
+ * EFAULT 	path points to an invalid address.
+ */
+int
+sys_mkdir(userptr_t path, mode_t mode);
+
+/**
+ * @brief Removes an empty directory.
+ *
+ * @param path: Path of the directory
+ *
+ * @return 0 on success, otherwise the errors of vfs_rmdir, and those of mkdir
+ */
+int
+sys_rmdir(userptr_t path);
+
+/**
+ * @brief Removes a name for a file, and the file with it if that was its last.
+ *
+ * @param path: Path of the file
+ *
+ * @return 0 on success, otherwise the errors of vfs_remove, and those of mkdir
+ */
+int
+sys_remove(userptr_t path);
+
+/**
+ * @brief Renames a file, replacing anything with the new name.
+ *
+ * @param oldpath: Current path of the file
+ * @param newpath: New path, on the same filesystem
+ *
+ * @return 0 on success, otherwise the errors of vfs_rename, and those of mkdir
+ */
+int
+sys_rename(userptr_t oldpath, userptr_t newpath);
+
+/**
+ * @brief Creates a pipe and opens both ends of it.
+ *
+ * @param fds: User array of two ints; the read end's fd goes in fds[0] and the
+ *             write end's in fds[1]
+ * @param retval: 0
+ *
+ * @return 0 on success, otherwise one of the following errors -
+ * EMFILE 	The process's file table was full.
+ * ENFILE 	The system's file table was full.
+ * ENOMEM 	Out of memory for the pipe.
+ * EFAULT 	fds points to an invalid address.
+ */
+int
+sys_pipe(userptr_t fds, int *retval);
+
+/**
+ * @brief Waits until one of a set of fds can be read or written without
+ *        blocking, or the timeout runs out.
+ *
+ * @param fds: User array of struct pollfd; revents is filled in for each
+ * @param nfds: How many there are
+ * @param timeout: In milliseconds; 0 only looks, negative waits for good
+ * @param retval: The number of fds with something in revents, 0 on timeout
+ *
+ * @return 0 on success, otherwise one of the following errors -
+ * EINVAL 	nfds is more than OPEN_MAX.
+ * ENOMEM 	Out of memory for the copy of fds.
+ * EFAULT 	fds points to an invalid address.
+ */
+int
+sys_poll(userptr_t fds, unsigned nfds, int timeout, int *retval);
+
 /* Assignment 5 - Processes */
 /**
  * @brief duplicates the current running process
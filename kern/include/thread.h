@@ -65,6 +65,12 @@ typedef enum {
 	S_ZOMBIE,	/* zombie; exited but not yet deleted */
 } threadstate_t;
 
+/*
+ * Names shorter than this are kept in the thread itself instead of
+ * being kstrdup'd, so thread_fork does not need to allocate for them.
+ */
+#define THREAD_NAMELEN 24
+
 /* Thread structure. */
 struct thread {
 	/*
@@ -84,6 +90,8 @@ struct thread {
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
+	struct wchan *t_wchan;		/* Wchan we're on, while sleeping */
+	char t_namebuf[THREAD_NAMELEN];	/* t_name, if it is short enough */
 
 	/*
 	 * Interrupt state fields.
@@ -102,6 +110,16 @@ struct thread {
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
 
+	/*
+	 * Scheduler fields. Only touched by the cpu the thread is
+	 * running on, or by whoever holds the thread off-cpu (the run
+	 * queue lock or the lock of the wchan it sleeps on).
+	 */
+	unsigned t_priority;		/* Run queue level, 0 is highest */
+	unsigned t_ticks;		/* Hardclocks used at this level */
+	unsigned t_lastrun;		/* t_cpu's c_hardclocks when last run */
+	bool t_pinned;			/* never moved off t_cpu */
+
 	/*
 	 * Public fields
 	 */
@@ -125,6 +143,9 @@ void thread_bootstrap(void);
 /* Call late in system startup to get secondary CPUs running. */
 void thread_start_cpus(void);
 
+/* Number of CPUs in the system. */
+unsigned thread_numcpus(void);
+
 /* Call during panic to stop other threads in their tracks */
 void thread_panic(void);
 
@@ -145,6 +166,15 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Like thread_fork, but the new thread starts on the cpu numbered
+ * CPUNUM and stays there: migration, work stealing and wakeup
+ * placement all leave it alone. For per-cpu kernel threads.
+ */
+int thread_fork_on(const char *name, struct proc *proc, unsigned cpunum,
+                   void (*func)(void *, unsigned long),
+                   void *data1, unsigned long data2);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -163,6 +193,26 @@ void thread_yield(void);
  */
 void schedule(void);
 
+/*
+ * Charge the current thread for one hardclock, and preempt it if it
+ * has used up its quantum or a higher-priority thread is waiting.
+ * Called from hardclock().
+ */
+void thread_tick(void);
+
+/*
+ * Print per-cpu scheduler statistics: run queue lengths by priority,
+ * steals and migrations.
+ */
+void thread_printstats(void);
+
+/*
+ * Turn the per-cpu cache of exited threads on or off. With it off,
+ * every thread_fork allocates a new thread and stack, and every exit
+ * frees them. On by default; switched off only to measure the cache.
+ */
+void thread_cache_enable(bool enable);
+
 /*
  * Potentially migrate ready threads to other CPUs. Called from the
  * timer interrupt.
@@ -0,0 +1,75 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#include <types.h>
+
+/*
+ * Kernel timers.
+ *
+ * A timer calls a function once, a given number of ticks from now. A
+ * tick is one hardclock on cpu 0, so there are HZ of them a second.
+ * The function is called from hardclock, in interrupt context, and
+ * must not sleep.
+ *
+ * Armed timers live in a timer wheel of TIMER_WHEEL_SIZE buckets
+ * indexed by expiry tick. Each bucket is kept sorted by expiry, so a
+ * tick only looks at the timers that actually expire on it (plus one
+ * that doesn't), however many timers are armed.
+ *
+ * Timers are meant to be embedded in the structure they act on and set
+ * up with timer_init or TIMER_INITIALIZER.
+ */
+
+struct timer
+{
+    void (*tm_func)(void *arg);
+    void *tm_arg;
+    unsigned tm_expires;            // tick it fires on
+    struct timer *tm_next;          // next in its bucket
+    struct timer **tm_prevp;        // what points to us; NULL if not armed
+};
+
+#define TIMER_INITIALIZER(func, arg) { (func), (arg), 0, NULL, NULL }
+
+/**
+ * @brief Set up a timer.
+ *
+ * @param t the timer
+ * @param func the function to call when it expires
+ * @param arg its argument
+ */
+void
+timer_init(struct timer *t, void (*func)(void *), void *arg);
+
+/**
+ * @brief Arm a timer. It must not already be armed.
+ *
+ * @param t the timer
+ * @param ticks how many ticks from now it should fire; at least 1
+ */
+void
+timer_add(struct timer *t, unsigned ticks);
+
+/**
+ * @brief Disarm a timer. If its function is running right now, wait for it to return.
+ *
+ * @param t the timer, which must not be the one whose function is calling this
+ *
+ * @return true if the timer was armed and now will not fire, false otherwise
+ */
+bool
+timer_del(struct timer *t);
+
+/**
+ * @brief The number of ticks since boot. Wraps around; compare with (int)(a - b).
+ */
+unsigned
+timer_now(void);
+
+/**
+ * @brief Advance the timer wheel by one tick and run what expired. Called from hardclock on cpu 0.
+ */
+void
+timer_tick(void);
+
+#endif
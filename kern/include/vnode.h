@@ -33,6 +33,7 @@
 #include <spinlock.h>
 struct uio;
 struct stat;
+struct pollentry;
 
 
 /*
@@ -117,6 +118,14 @@ struct vnode {
  *                      and directories are seekable, but some devices are
  *                      not.
  *
+ *    vop_poll        - Return which of EVENTS (POLLIN, POLLOUT; see
+ *                      kern/poll.h) would not block right now, plus
+ *                      POLLERR or POLLHUP if they apply. If PE is not
+ *                      NULL, first add it with pollhead_add to the
+ *                      pollhead that gets a pollwakeup when the answer
+ *                      changes; see poll.h. Objects that never block can
+ *                      use vnode_poll_ready.
+ *
  *    vop_fsync       - Force any dirty buffers associated with this file
  *                      to stable storage.
  *
@@ -192,6 +201,8 @@ struct vnode_ops {
 	int (*vop_stat)(struct vnode *object, struct stat *statbuf);
 	int (*vop_gettype)(struct vnode *object, mode_t *result);
 	bool (*vop_isseekable)(struct vnode *object);
+	int (*vop_poll)(struct vnode *object, int events,
+			struct pollentry *pe);
 	int (*vop_fsync)(struct vnode *object);
 	int (*vop_mmap)(struct vnode *file /* add stuff */);
 	int (*vop_truncate)(struct vnode *file, off_t len);
@@ -236,6 +247,7 @@ struct vnode_ops {
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_ISSEEKABLE(vn)              (__VOP(vn, isseekable)(vn))
+#define VOP_POLL(vn, events, pe)        (__VOP(vn, poll)(vn, events, pe))
 #define VOP_FSYNC(vn)                   (__VOP(vn, fsync)(vn))
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
 #define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
@@ -279,6 +291,12 @@ int vnode_init(struct vnode *, const struct vnode_ops *ops,
  */
 void vnode_cleanup(struct vnode *);
 
+/*
+ * vop_poll for objects that never block: regular files and directories
+ * are always ready for whatever is asked.
+ */
+int vnode_poll_ready(struct vnode *vn, int events, struct pollentry *pe);
+
 /*
  * Common stubs for vnode functions that just fail, in various ways.
  */
@@ -0,0 +1,110 @@
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+#include <types.h>
+#include <spinlock.h>
+
+/*
+ * Deferred work.
+ *
+ * A work item is a function and an argument to be called later by a
+ * kernel worker thread, so that work that does not have to happen in
+ * the caller (zeroing pages, tearing down dead processes, ...) can be
+ * taken off its critical path.
+ *
+ * There is one queue per cpu, each served by its own worker thread in
+ * kproc, which is pinned to that cpu. work_queue puts an item on the current cpu's queue. Delayed
+ * items sit on the queue's delayed list and are moved to the queue by
+ * hardclock on that cpu once their delay has run out.
+ *
+ * An item is either idle, pending (queued or delayed), or running,
+ * and may be pending and running at once if it was requeued while it
+ * ran; it is then run again, on the same worker, afterwards. Queueing
+ * an item that is already pending does nothing. The worker does not
+ * touch the item after calling its function, so the function may free
+ * the memory the item lives in.
+ *
+ * Work items are meant to be embedded in the structure they work on
+ * and set up with work_init or WORK_INITIALIZER.
+ */
+
+struct workqueue;
+
+struct work
+{
+    void (*w_func)(void *arg);
+    void *w_arg;
+
+    volatile spinlock_data_t w_pending; // set while queued or delayed
+    struct workqueue *w_queue;      // queue it is on, or last ran on
+    struct work *w_next;            // protected by w_queue's lock
+    unsigned w_delay;               // hardclocks left, if delayed
+};
+
+#define WORK_INITIALIZER(func, arg) \
+    { (func), (arg), SPINLOCK_DATA_INITIALIZER, NULL, NULL, 0 }
+
+/**
+ * @brief Set up a work item.
+ *
+ * @param w the work item
+ * @param func the function to call
+ * @param arg its argument
+ */
+void
+work_init(struct work *w, void (*func)(void *), void *arg);
+
+/**
+ * @brief Queue a work item to be run as soon as possible.
+ *
+ * @param w the work item
+ *
+ * @return true if it was queued, false if it was already pending or the
+ * workqueues have not been started yet
+ */
+bool
+work_queue(struct work *w);
+
+/**
+ * @brief Queue a work item to be run after a delay.
+ *
+ * @param w the work item
+ * @param hardclocks how many hardclocks to wait; 0 queues it right away
+ *
+ * @return true if it was queued, false if it was already pending or the
+ * workqueues have not been started yet
+ */
+bool
+work_queue_delayed(struct work *w, unsigned hardclocks);
+
+/**
+ * @brief Take a pending work item off its queue. Does not wait for it if it is running.
+ *
+ * @param w the work item
+ *
+ * @return true if it was pending and will now not run, false otherwise
+ */
+bool
+work_cancel(struct work *w);
+
+/**
+ * @brief Wait until a work item is neither pending nor running. May sleep.
+ *
+ * @param w the work item, which must not be freed by its own function
+ */
+void
+work_flush(struct work *w);
+
+/**
+ * @brief Create the per-cpu queues and their worker threads. Call after thread_start_cpus.
+ */
+void
+workqueue_bootstrap(void);
+
+/**
+ * @brief Count down this cpu's delayed work. Called from hardclock.
+ */
+void
+workqueue_tick(void);
+
+#endif
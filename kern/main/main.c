@@ -52,6 +52,7 @@
 #include <syscall.h>
 #include <test.h>
 #include <version.h>
+#include <workqueue.h>
 #include "autoconf.h"  // for pseudoconfig
 
 
@@ -135,6 +136,7 @@ boot(void)
 	/* Late phase of initialization. */
 	kprintf_bootstrap();
 	thread_start_cpus();
+	workqueue_bootstrap();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
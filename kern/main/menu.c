@@ -45,6 +45,9 @@
 #include "opt-sfs.h"
 #include "opt-net.h"
 #include <vm.h>
+#include <kmem_cache.h>
+#include <kmalloc_tag.h>
+#include <lockstat.h>
 #include <current.h>
 
 /*
@@ -414,6 +417,72 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_kmalloctagstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kmalloc_tag_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+#if OPT_LOCKSTAT
+	if (nargs == 1) {
+		lockstat_print(10);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "all")) {
+		lockstat_print(0);
+	}
+	else if (nargs == 2 && atoi(args[1]) > 0) {
+		lockstat_print(atoi(args[1]));
+	}
+	else {
+		kprintf("Usage: lockstat [n | all | reset]\n");
+	}
+#else
+	(void)nargs;
+	(void)args;
+
+	kprintf("lockstat: kernel not built with options lockstat\n");
+#endif
+
+	return 0;
+}
+
+static
+int
+cmd_schedstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_kmemcachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kmem_cache_printstats();
+
+	return 0;
+}
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -481,6 +550,7 @@ static const char *testmenu[] = {
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tt4] Thread creation rate          ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
@@ -488,6 +558,8 @@ static const char *testmenu[] = {
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
 	"[sy4] CV test #2            (1)     ",
+	"[sy5] RW lock test                  ",
+	"[sl1] Spinlock fairness test        ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress                ",
 	"[fs3] FS write stress               ",
@@ -521,6 +593,10 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[kc] Kernel object cache stats      ",
+	"[kt] Kernel heap usage by tag       ",
+	"[ss] Scheduler stats                ",
+	"[lockstat] Lock contention stats    ",
 	"[q] Quit and shut down              ",
 	"[pn] Another shrubbery!",
 	NULL
@@ -657,6 +733,10 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "kc",         cmd_kmemcachestats },
+	{ "kt",         cmd_kmalloctagstats },
+	{ "ss",         cmd_schedstats },
+	{ "lockstat",   cmd_lockstat },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -673,12 +753,15 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tt4",	threadtest4 },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "sy5",	rwtest },
+	{ "sl1",	spinlocktest },
 
 	/* file system assignment tests */
 	{ "fs1",	fstest },
@@ -52,6 +52,7 @@
 #include <abstractfile.h>
 #include <addrspace.h>
 #include <vnode.h>
+#include <kmem_cache.h>
 #include <kern/errno.h>
 
 /*
@@ -59,6 +60,70 @@
  */
 struct proc *kproc;
 
+/*
+ * Processes are recycled through an object cache. A cached proc keeps
+ * its thread array, p_lock, fdtable_lk, children_lk and waiting_on_me,
+ * so fork does not have to create three synchronization primitives
+ * every time. proc_destroy must leave those in their initial state.
+ */
+static int proc_ctor(void *obj);
+static void proc_dtor(void *obj);
+static void proc_reap(void *obj);
+
+static struct kmem_cache proc_cache =
+	KMEM_CACHE_INITIALIZER("proc", struct proc, KMT_PROC,
+			       proc_ctor, proc_dtor);
+
+static
+int
+proc_ctor(void *obj)
+{
+	struct proc *proc = obj;
+
+	threadarray_init(&proc->p_threads);
+	spinlock_init(&proc->p_lock);
+	work_init(&proc->p_reapwork, proc_reap, proc);
+
+	proc->fdtable_lk = rw_create("fd lk");
+	if (proc->fdtable_lk == NULL) {
+		goto fail_fdtable_lk;
+	}
+
+	proc->children_lk = lock_create("children lk");
+	if (proc->children_lk == NULL) {
+		goto fail_children_lk;
+	}
+
+	proc->waiting_on_me = cv_create("Proc conditional variable");
+	if (proc->waiting_on_me == NULL) {
+		goto fail_waiting_on_me;
+	}
+
+	return 0;
+
+fail_waiting_on_me:
+	lock_destroy(proc->children_lk);
+fail_children_lk:
+	rw_destroy(proc->fdtable_lk);
+fail_fdtable_lk:
+	spinlock_cleanup(&proc->p_lock);
+	threadarray_cleanup(&proc->p_threads);
+	return ENOMEM;
+}
+
+static
+void
+proc_dtor(void *obj)
+{
+	struct proc *proc = obj;
+
+	cv_destroy(proc->waiting_on_me);
+	lock_destroy(proc->children_lk);
+	rw_destroy(proc->fdtable_lk);
+	spinlock_cleanup(&proc->p_lock);
+	threadarray_cleanup(&proc->p_threads);
+}
+
 /*
  * Create a proc structure.
  */
@@ -68,18 +133,18 @@ proc_create(const char *name)
 {
 	struct proc *proc;
 
-	proc = kmalloc(sizeof(*proc));
+	proc = kmem_cache_alloc(&proc_cache);
 	if (proc == NULL) {
 		return NULL;
 	}
 	proc->p_name = kstrdup(name);
 	if (proc->p_name == NULL) {
-		kfree(proc);
+		kmem_cache_free(&proc_cache, proc);
 		return NULL;
 	}
 
-	threadarray_init(&proc->p_threads);
-	spinlock_init(&proc->p_lock);
+	/* Not in the process table yet */
+	proc->p_pid = MAX_PID_REACHED;
 
 	/* VM fields */
 	proc->p_addrspace = NULL;
@@ -87,66 +152,47 @@ proc_create(const char *name)
 	/* VFS fields */
 	proc->p_cwd = NULL;
 
-	/* 
-	 * Added for Assignment 4
-	 * When a process is created it should always have three file descriptors for it
-	 */
-	proc->fdtable_num_entries = 3;
-
-	/*
-	 * If the file table already exists 
-	 * i.e. the vfs is initilized too
-	 */
-	proc->fdtable_lk = lock_create("fd lk");
-	
+	proc->children_size = 0;
 	for (int i = 0; i< MAX_CHILDREN_PER_PERSON; i++)
 	{
 		proc->children[i] = NULL;
 	}
 
-	/*
-	 * The file descriptor table will only be bootstraped after 
-	 * the kernel. So we cannot and should not increase the ref_count
-	 * before it is created.
+	/* 
+	 * Added for Assignment 4
+	 * When a process is created it should always have three file descriptors for it
 	 */
-	// this is not needed as the only was to create a process is to fork it
-	if (kfile_table != NULL)
-	{
-		// more for next assignment
-		//lock_acquire(kfile_table->files_lk[0]);
-		kfile_table->files[0]->ref_count++;
-		//lock_release(kfile_table->files_lk[0]);
-
-		//lock_acquire(kfile_table->files_lk[1]);
-		kfile_table->files[1]->ref_count++;
-		//lock_release(kfile_table->files_lk[1]);
-
-		//lock_acquire(kfile_table->files_lk[2]);
-		kfile_table->files[2]->ref_count++;
-		//lock_release(kfile_table->files_lk[2]);
-		
+	proc->p_fdtable = fdtable_create();
+	if (proc->p_fdtable == NULL) {
+		kfree(proc->p_name);
+		kmem_cache_free(&proc_cache, proc);
+		return NULL;
 	}
 
 	/*
-	 * IMPORTANT NOTE - the main open file descriptor table 
-	 * is in-charge of creating these files in reality.
-	 */
-	proc->fdtable[0] = 0;
-    proc->fdtable[1] = 1;
-    proc->fdtable[2] = 2;
-
-	/*
-	 * Make sure that all file descripors indicate that they are empty 
+	 * The file table will only be bootstraped after the kernel, so the
+	 * kernel process gets no std files.
+	 *
+	 * IMPORTANT NOTE - the main open file table is in-charge of creating
+	 * these files in reality; each fd takes its own reference to them.
 	 */
-	for (int i = 3; i < __OPEN_MAX; i++)
+	if (kfile_table != NULL)
 	{
-		proc->fdtable[i] = FDTABLE_EMPTY;
+		for (int fd = 0; fd < 3; fd++)
+		{
+			ft_hold_file(fd);
+			if (fdtable_set(proc->p_fdtable, fd, fd))
+			{
+				/* Can't happen; the table starts big enough */
+				panic("proc_create: fdtable_set failed\n");
+			}
+		}
 	}
 
 	if (kfile_table != NULL) // Will only be false for the kernel
 	{
 		/* For Assignment 5 - add pid functionality */
-		lock_acquire(kproc_table->pid_lk);
+		rw_wlock(kproc_table->pid_lk);
 
 		/*
 		 * Find an available pid in the process table, this should have probably
@@ -157,7 +203,8 @@ proc_create(const char *name)
 		int pid = pt_find_avail_pid(); 
 		if (pid == MAX_PID_REACHED)
 		{
-			lock_release(kproc_table->pid_lk);
+			rw_wunlock(kproc_table->pid_lk);
+			lock_acquire(proc->children_lk);
 			proc_destroy(proc);
 			return NULL;
 		}
@@ -169,19 +216,12 @@ proc_create(const char *name)
 		 */
 		if (pt_add_proc(proc, pid)) 
 		{
-			lock_release(kproc_table->pid_lk);
+			rw_wunlock(kproc_table->pid_lk);
+			lock_acquire(proc->children_lk);
 			proc_destroy(proc);
 		    return NULL;
 		}
-		lock_release(kproc_table->pid_lk);
-
-		proc->waiting_on_me = cv_create("Proc conditional variable");
-		if (proc->waiting_on_me == NULL)
-		{
-			lock_release(kproc_table->pid_lk);
-			proc_destroy(proc);
-			return NULL;
-		}
+		rw_wunlock(kproc_table->pid_lk);
 
 		proc->parent = curproc;
 
@@ -196,14 +236,6 @@ proc_create(const char *name)
 	}
 
 	proc->state = CREATED;
-	proc->children_lk = lock_create("children lk");
-	if (proc->children_lk == NULL)
-	{
-		lock_release(kproc_table->pid_lk);
-		proc_destroy(proc);
-		return NULL;
-	}
-	proc->children_size = 0;
 
 	return proc;
 }
@@ -292,25 +324,24 @@ proc_destroy(struct proc *proc)
 
 
 
-	threadarray_cleanup(&proc->p_threads);
-	spinlock_cleanup(&proc->p_lock);
+	/* p_threads and p_lock stay set up for the next user of this proc */
+	KASSERT(threadarray_num(&proc->p_threads) == 0);
 
 
 	/* Assignment 4 - File related clearnups */
 
 	// Make sure to close all references to the files once the process is done.
-	for (unsigned int i = 0; i < proc->fdtable_num_entries; i++)
+	if (proc->p_fdtable != NULL)
 	{
-		__close(proc ,proc->fdtable[i]);
+		fdtable_release(proc->p_fdtable);
+		proc->p_fdtable = NULL;
 	}
-	lock_destroy(proc->fdtable_lk);
-
 
 	/* Assignment 5 */
 	// TODO - must remove itself from process table!!!
-	lock_acquire(kproc_table->pid_lk);
+	rw_wlock(kproc_table->pid_lk);
 	pt_remove_proc(proc->p_pid);
-	lock_release(kproc_table->pid_lk);
+	rw_wunlock(kproc_table->pid_lk);
 
 
 	// tell all our children we are dead
@@ -318,27 +349,44 @@ proc_destroy(struct proc *proc)
 	// {
 	// 	proc->children[i]->parent = NULL;
 	// }
-	/* 
-	 * Check we are not called because one of these failed
+	/*
+	 * Only exit (and proc_create) calls this, meaning we normally
+	 * hold the children_lk. It goes back into the proc cache, so it
+	 * must be released rather than destroyed.
 	 */
-	if (proc->children_lk != NULL)
+	if (lock_do_i_hold(proc->children_lk))
 	{
-		/*
-		 * Only exit (and proc_create) calls this,
-		 * we are either destroying because these are null or when exiting, 
-		 * meaning we *MUST* hold the children_lk
-		 */
 		lock_release(proc->children_lk);
-		lock_destroy(proc->children_lk);
-	}
-
-	if (proc->waiting_on_me != NULL)
-	{
-		cv_destroy(proc->waiting_on_me);
 	}
 
 	kfree(proc->p_name);
-	kfree(proc);
+	proc->p_name = NULL;
+	kmem_cache_free(&proc_cache, proc);
+}
+
+/*
+ * Work function for proc_destroy_later. Taking children_lk waits for
+ * the process's last thread to let go of it on its way out.
+ */
+static
+void
+proc_reap(void *obj)
+{
+	struct proc *proc = obj;
+
+	lock_acquire(proc->children_lk);
+	proc_destroy(proc);
+}
+
+void
+proc_destroy_later(struct proc *proc)
+{
+	KASSERT(!lock_do_i_hold(proc->children_lk));
+
+	if (!work_queue(&proc->p_reapwork)) {
+		/* Workqueues aren't running yet */
+		proc_reap(proc);
+	}
 }
 
 /*
@@ -516,20 +564,15 @@ __copy_fd_table(struct proc* from, struct proc* to)
 	{
 		return EINVAL;
 	}
-	// First three are created by proc_create and are the same
-	int fd = 0;
-	for (unsigned int i=3; i < from->fdtable_num_entries; i++)
-	{
-		fd = from->fdtable[i];
-		to->fdtable[i] = fd;
-		//lock_acquire(kfile_table->files_lk[fd]);
-		lock_acquire(kfile_table->location_lk);
-		kfile_table->files[fd]->ref_count++; // Remeber to add the reference
-		lock_release(kfile_table->location_lk);
-		//lock_release(kfile_table->files_lk[fd]);
-
-		VOP_INCREF(kfile_table->files[fd]->vn); // To the vnode too~!!!!
-	}
+	/*
+	 * Share the parent's table rather than copying it; whichever of the
+	 * two changes it first gets its own copy. Drop the std files
+	 * proc_create gave the child.
+	 */
+	rw_rlock(from->fdtable_lk);
+	fdtable_release(to->p_fdtable);
+	to->p_fdtable = fdtable_share(from->p_fdtable);
+	rw_runlock(from->fdtable_lk);
 
 	return 0;
-}
\ No newline at end of file
+}
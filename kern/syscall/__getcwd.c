@@ -19,7 +19,7 @@ sys___getcwd(userptr_t buf, size_t buflen, int * retval)
 
     char kbuf[buflen];
     
-    lock_acquire(curproc->fdtable_lk);
+    rw_rlock(curproc->fdtable_lk);
 
     copyin(buf, kbuf, sizeof(kbuf));
 	uio_kinit(&iov, &ku, kbuf, sizeof(kbuf), 0, UIO_READ);
@@ -27,7 +27,7 @@ sys___getcwd(userptr_t buf, size_t buflen, int * retval)
     result = vfs_getcwd(&ku);
     if (result)
     {
-        lock_release(curproc->fdtable_lk);
+        rw_runlock(curproc->fdtable_lk);
         return result;
     }
 
@@ -36,10 +36,10 @@ sys___getcwd(userptr_t buf, size_t buflen, int * retval)
     result = copyout(kbuf, buf, sizeof(ku));
     if (result)
     {
-        lock_release(curproc->fdtable_lk);
+        rw_runlock(curproc->fdtable_lk);
         return result;
     }
-    lock_release(curproc->fdtable_lk);
+    rw_runlock(curproc->fdtable_lk);
 
     return 0;
 }
\ No newline at end of file
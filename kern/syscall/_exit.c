@@ -40,14 +40,14 @@ __exit(int exitcode)
     for (int i = 0; i < calling_proc->children_size; i++)
     {
         /* 
-         * When the child is a zombie destroy it.
+         * When the child is a zombie destroy it, on a worker thread so
+         * we don't pay for it here.
          * destroy will also remove itself from the proc_table
          */
         if (calling_proc->children[i]!=NULL){
             if (calling_proc->children[i]->state == ZOMBIE)
             {
-                lock_acquire(calling_proc->children[i]->children_lk);
-                proc_destroy(calling_proc->children[i]);
+                proc_destroy_later(calling_proc->children[i]);
                 calling_proc->children[i] = NULL;
             }
             /*
@@ -67,7 +67,8 @@ __exit(int exitcode)
     {
         proc_remthread(curthread);
 
-        proc_destroy(calling_proc);
+        lock_release(calling_proc->children_lk);
+        proc_destroy_later(calling_proc);
         thread_exit();
     }
 
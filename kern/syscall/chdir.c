@@ -16,22 +16,22 @@ sys_chdir(userptr_t pathname)
     int result;
     char kpath[__PATH_MAX];
     
-    lock_acquire(curproc->fdtable_lk);
+    rw_wlock(curproc->fdtable_lk);
 
     result = copyinstr(pathname, kpath, __PATH_MAX, NULL);
     if (result)
     {
-        lock_release(curproc->fdtable_lk);
+        rw_wunlock(curproc->fdtable_lk);
         return result;
     }
 
     result = vfs_chdir(kpath);
     if (result)
     {
-        lock_release(curproc->fdtable_lk);
+        rw_wunlock(curproc->fdtable_lk);
         return result;
     }
 
-    lock_release(curproc->fdtable_lk);
+    rw_wunlock(curproc->fdtable_lk);
     return 0;
 }
\ No newline at end of file
@@ -21,16 +21,16 @@ int
 sys_close(int fd)
 {
     int result;
-    lock_acquire(curproc->fdtable_lk);
+    rw_wlock(curproc->fdtable_lk);
 
     result = __close(curproc, fd);
     if (result)
     {
-        lock_release(curproc->fdtable_lk);
+        rw_wunlock(curproc->fdtable_lk);
         return result;
     }
 
-    lock_release(curproc->fdtable_lk);
+    rw_wunlock(curproc->fdtable_lk);
 
     return 0;
 }
@@ -0,0 +1,194 @@
+#include <types.h>
+#include <stat.h>
+#include <vnode.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/iovec.h>
+#include <lib.h>
+#include <synch.h>
+#include <proc.h>
+#include <current.h>
+#include <abstractfile.h>
+#include <filetable.h>
+#include <vfs.h>
+#include <syscall.h>
+#include <uio.h>
+
+/* Bytes moved per VOP_READ/VOP_WRITE pair */
+#define COPY_CHUNK (16 * 1024)
+
+/* The byte count is returned in an int */
+#define COPY_MAX 0x7fffffff
+
+/*
+ * Takes the offset lock of every seekable file of the two, always in
+ * the same order so two copies going opposite ways can't deadlock.
+ */
+static
+void
+copy_lock(struct abstractfile* a, bool a_seekable, struct abstractfile* b, bool b_seekable)
+{
+    if (a > b)
+    {
+        copy_lock(b, b_seekable, a, a_seekable);
+        return;
+    }
+    if (a_seekable)
+    {
+        lock_acquire(a->offset_lk);
+    }
+    if (b_seekable)
+    {
+        lock_acquire(b->offset_lk);
+    }
+}
+
+int
+sys_copy_file_range(int infd, int outfd, size_t len, int* retval)
+{
+    int in_idx, out_idx;
+    struct abstractfile *in, *out;
+    struct iovec iov;
+    struct uio uio;
+    struct stat st;
+    void* buf;
+    size_t bufsize, chunk, got, total;
+    off_t inpos, outpos;
+    bool in_seekable, out_seekable;
+    int result;
+
+    if (len > COPY_MAX)
+    {
+        len = COPY_MAX;
+    }
+
+    rw_rlock(curproc->fdtable_lk);
+    in_idx = fdtable_get(curproc->p_fdtable, infd);
+    out_idx = fdtable_get(curproc->p_fdtable, outfd);
+    if (in_idx == FDTABLE_EMPTY || out_idx == FDTABLE_EMPTY)
+    {
+        rw_runlock(curproc->fdtable_lk);
+        return EBADF;
+    }
+    in = ft_hold_file(in_idx);
+    out = ft_hold_file(out_idx);
+    rw_runlock(curproc->fdtable_lk);
+
+    int in_mode = in->status & O_ACCMODE;
+    int out_mode = out->status & O_ACCMODE;
+    if ((in_mode != O_RDONLY && in_mode != O_RDWR) ||
+        (out_mode != O_WRONLY && out_mode != O_RDWR))
+    {
+        result = EBADF;
+        goto out_files;
+    }
+
+    /* Copying a file onto itself would read back what we just wrote */
+    if (in->vn == out->vn)
+    {
+        result = EINVAL;
+        goto out_files;
+    }
+
+    /* Prefer a big buffer but get by with a page */
+    bufsize = COPY_CHUNK;
+    buf = kmalloc(bufsize);
+    if (buf == NULL)
+    {
+        bufsize = PAGE_SIZE;
+        buf = kmalloc(bufsize);
+        if (buf == NULL)
+        {
+            result = ENOMEM;
+            goto out_files;
+        }
+    }
+
+    in_seekable = VOP_ISSEEKABLE(in->vn);
+    out_seekable = VOP_ISSEEKABLE(out->vn);
+    copy_lock(in, in_seekable, out, out_seekable);
+
+    total = 0;
+    inpos = in->offset;
+    outpos = out->offset;
+    if (out->status & O_APPEND)
+    {
+        result = VOP_STAT(out->vn, &st);
+        if (result)
+        {
+            /* Nothing was copied, so neither offset moves */
+            goto out_unlock;
+        }
+        outpos = st.st_size;
+    }
+
+    /*
+     * The data only ever passes through buf: one uiomove in from the
+     * source, one out to the destination, and no trips to user space.
+     */
+    result = 0;
+    while (total < len)
+    {
+        chunk = len - total < bufsize ? len - total : bufsize;
+
+        uio_kinit(&iov, &uio, buf, chunk, inpos, UIO_READ);
+        result = VOP_READ(in->vn, &uio);
+        if (result)
+        {
+            break;
+        }
+        got = chunk - uio.uio_resid;
+        if (got == 0)
+        {
+            /* End of file */
+            break;
+        }
+        inpos += got;
+
+        uio_kinit(&iov, &uio, buf, got, outpos, UIO_WRITE);
+        result = VOP_WRITE(out->vn, &uio);
+        if (result)
+        {
+            /* Nothing of this chunk counts, so the source offset shouldn't move past it */
+            inpos -= got;
+            break;
+        }
+        outpos += got - uio.uio_resid;
+        total += got - uio.uio_resid;
+        if (uio.uio_resid > 0)
+        {
+            /* Short write; the destination is full */
+            inpos -= uio.uio_resid;
+            break;
+        }
+    }
+
+    in->offset = inpos;
+    out->offset = outpos;
+
+out_unlock:
+    if (out_seekable)
+    {
+        lock_release(out->offset_lk);
+    }
+    if (in_seekable)
+    {
+        lock_release(in->offset_lk);
+    }
+    kfree(buf);
+
+    /* Like write, report what got done and save the error for next time */
+    if (total > 0)
+    {
+        result = 0;
+    }
+    if (result == 0)
+    {
+        *retval = total;
+    }
+
+out_files:
+    ft_release_file(out_idx);
+    ft_release_file(in_idx);
+    return result;
+}
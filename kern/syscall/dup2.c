@@ -20,71 +20,72 @@ sys_dup2(int oldfd, int newfd, int* retval)
 
 
     // acquire lock for process' fd table - first layer of file structure
-    lock_acquire(curproc->fdtable_lk); // acquire lock for process' fd table.
+    rw_wlock(curproc->fdtable_lk); // acquire lock for process' fd table.
 
     result = __check_fd(oldfd);
     if (result)
     {
-        lock_release(curproc->fdtable_lk);
+        rw_wunlock(curproc->fdtable_lk);
         return result;
     }
     result = __check_fd(newfd);
     if (result)
     {
-        lock_release(curproc->fdtable_lk);
+        rw_wunlock(curproc->fdtable_lk);
         return result;
     }
     
 
-    int acttual_index = curproc->fdtable[oldfd];
+    int acttual_index = fdtable_get(curproc->p_fdtable, oldfd);
 
     // check oldfd is a valid file descriptor
     if (acttual_index == FDTABLE_EMPTY) 
     {
-        lock_release(curproc->fdtable_lk);
+        rw_wunlock(curproc->fdtable_lk);
         return EBADF;
     }
 
-    // check we have at least one space in process fdtable 
-    if (curproc->fdtable_num_entries >= OPEN_MAX) 
+    // Nothing to do, and closing newfd would close oldfd too
+    if (oldfd == newfd)
     {
-        lock_release(curproc->fdtable_lk);
-        return EMFILE;
+        *retval = newfd;
+        rw_wunlock(curproc->fdtable_lk);
+        return 0;
+    }
+
+    // We are about to change the fd table, get a copy if it is shared since fork
+    result = fdtable_unshare(&curproc->p_fdtable);
+    if (result)
+    {
+        rw_wunlock(curproc->fdtable_lk);
+        return result;
     }
 
     // TODO: Is there a global limit on open files? if so, check it here and return EMFILE
 
     // if newfd is an already opened file, close it
-    if (curproc->fdtable[newfd] != FDTABLE_EMPTY) 
+    if (fdtable_get(curproc->p_fdtable, newfd) != FDTABLE_EMPTY) 
     {
-        // THIS IS MAYBE JANK
-        // THIS IS TRASH - ELDAD
-        //sys_close(newfd); - this was trash
         __close(curproc ,newfd);
     }
 
-    // copy oldfd to newfd
-    curproc->fdtable[newfd] = acttual_index;
-
     /* 
      * Don't forget to indicate that another thing is now using this file 
      * One of few cases we want to do this manually and not in open
      */
-    curproc->fdtable_num_entries++;
-    
-    // Protect!!!!
-    //lock_acquire(kfile_table->files_lk[acttual_index]);
-    lock_acquire(kfile_table->location_lk);
-    kfile_table->files[acttual_index]->ref_count++;
-    lock_release(kfile_table->location_lk);
-    //lock_release(kfile_table->files_lk[acttual_index]);
-    
+    ft_hold_file(acttual_index);
 
-    VOP_INCREF(kfile_table->files[acttual_index]->vn); 
-    
+    // copy oldfd to newfd
+    result = fdtable_set(curproc->p_fdtable, newfd, acttual_index);
+    if (result)
+    {
+        ft_release_file(acttual_index);
+        rw_wunlock(curproc->fdtable_lk);
+        return result;
+    }
 
     *retval = newfd; 
-    lock_release(curproc->fdtable_lk);
+    rw_wunlock(curproc->fdtable_lk);
     return 0;
 
 
@@ -86,9 +86,9 @@ sys_fork(struct trapframe *tf, int *retval)
                 0);
 
     if (err) {
-        lock_acquire(kproc_table->pid_lk);
+        rw_wlock(kproc_table->pid_lk);
         pt_remove_proc(new_proc->p_pid);
-        lock_release(kproc_table->pid_lk);
+        rw_wunlock(kproc_table->pid_lk);
         
         lock_acquire(new_proc->children_lk);
         proc_destroy(new_proc);
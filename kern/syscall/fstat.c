@@ -0,0 +1,39 @@
+#include <types.h>
+#include <stat.h>
+#include <vnode.h>
+#include <kern/errno.h>
+#include <synch.h>
+#include <proc.h>
+#include <current.h>
+#include <abstractfile.h>
+#include <filetable.h>
+#include <syscall.h>
+#include <copyinout.h>
+
+int
+sys_fstat(int filehandle, userptr_t statbuf)
+{
+    int ft_idx;
+    int result;
+    struct abstractfile* af;
+    struct stat st;
+
+    rw_rlock(curproc->fdtable_lk);
+    ft_idx = fdtable_get(curproc->p_fdtable, filehandle);
+    if (ft_idx == FDTABLE_EMPTY)
+    {
+        rw_runlock(curproc->fdtable_lk);
+        return EBADF;
+    }
+    af = ft_hold_file(ft_idx);
+    rw_runlock(curproc->fdtable_lk);
+
+    result = VOP_STAT(af->vn, &st);
+    ft_release_file(ft_idx);
+    if (result)
+    {
+        return result;
+    }
+
+    return copyout(&st, statbuf, sizeof(struct stat));
+}
@@ -0,0 +1,227 @@
+#include <types.h>
+#include <stat.h>
+#include <vnode.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/dirent.h>
+#include <limits.h>
+#include <lib.h>
+#include <synch.h>
+#include <proc.h>
+#include <current.h>
+#include <abstractfile.h>
+#include <filetable.h>
+#include <syscall.h>
+#include <copyinout.h>
+#include <uio.h>
+
+/* getdirentries fills at most this much per call */
+#define DIRENT_BUF_MAX (16 * 1024)
+
+/*
+ * Takes a reference to the file behind an fd for reading a directory
+ * and its offset lock, if it has one.
+ */
+static
+int
+dir_hold(int filehandle, int* ft_idx, struct abstractfile** afp)
+{
+    struct abstractfile* af;
+    int access_mode;
+
+    rw_rlock(curproc->fdtable_lk);
+    *ft_idx = fdtable_get(curproc->p_fdtable, filehandle);
+    if (*ft_idx == FDTABLE_EMPTY)
+    {
+        rw_runlock(curproc->fdtable_lk);
+        return EBADF;
+    }
+    af = ft_hold_file(*ft_idx);
+    rw_runlock(curproc->fdtable_lk);
+
+    access_mode = af->status & O_ACCMODE;
+    if (access_mode != O_RDONLY && access_mode != O_RDWR)
+    {
+        ft_release_file(*ft_idx);
+        return EBADF;
+    }
+
+    /* The offset is where the last listing left off, so reads of it mustn't overlap */
+    if (VOP_ISSEEKABLE(af->vn))
+    {
+        lock_acquire(af->offset_lk);
+    }
+
+    *afp = af;
+    return 0;
+}
+
+static
+void
+dir_release(int ft_idx, struct abstractfile* af)
+{
+    if (VOP_ISSEEKABLE(af->vn))
+    {
+        lock_release(af->offset_lk);
+    }
+    ft_release_file(ft_idx);
+}
+
+int
+sys_getdirentry(int filehandle, userptr_t buf, size_t buflen, int* retval)
+{
+    struct abstractfile* af;
+    struct iovec iov;
+    struct uio uio;
+    int ft_idx;
+    int result;
+
+    result = dir_hold(filehandle, &ft_idx, &af);
+    if (result)
+    {
+        return result;
+    }
+
+    iov.iov_ubase = buf;
+    iov.iov_len = buflen;
+    uio.uio_iov = &iov;
+    uio.uio_iovcnt = 1;
+    uio.uio_offset = af->offset;
+    uio.uio_resid = buflen;
+    uio.uio_segflg = UIO_USERSPACE;
+    uio.uio_rw = UIO_READ;
+    uio.uio_space = proc_getas();
+
+    result = VOP_GETDIRENTRY(af->vn, &uio);
+    if (result == 0)
+    {
+        af->offset = uio.uio_offset;
+        *retval = buflen - uio.uio_resid;
+    }
+
+    dir_release(ft_idx, af);
+    return result;
+}
+
+/*
+ * Fills in the attributes of the entry NAME in directory DIR. If it can't
+ * be looked up, say because it was removed a moment ago, they are all zero.
+ */
+static
+void
+dirent_stat(struct vnode* dir, const char* name, struct stat* st)
+{
+    char path[NAME_MAX + 1];
+    struct vnode* vn;
+
+    bzero(st, sizeof(struct stat));
+
+    /* Lookup may scribble on the path it is given */
+    strcpy(path, name);
+    if (VOP_LOOKUP(dir, path, &vn))
+    {
+        return;
+    }
+    if (VOP_STAT(vn, st))
+    {
+        bzero(st, sizeof(struct stat));
+    }
+    VOP_DECREF(vn);
+}
+
+int
+sys_getdirentries(int filehandle, userptr_t buf, size_t buflen, int* retval)
+{
+    struct abstractfile* af;
+    struct dirent* d;
+    struct iovec iov;
+    struct uio uio;
+    char name[NAME_MAX + 1];
+    char* kbuf;
+    size_t namlen, reclen, used;
+    off_t pos;
+    int ft_idx;
+    int result;
+
+    if (buflen > DIRENT_BUF_MAX)
+    {
+        buflen = DIRENT_BUF_MAX;
+    }
+    kbuf = kmalloc(buflen);
+    if (kbuf == NULL)
+    {
+        return ENOMEM;
+    }
+
+    result = dir_hold(filehandle, &ft_idx, &af);
+    if (result)
+    {
+        kfree(kbuf);
+        return result;
+    }
+
+    /*
+     * Entries are gathered one at a time in the kernel and go out in a
+     * single copyout. pos only moves past an entry once it is in kbuf,
+     * so one that doesn't fit is the first of the next call.
+     */
+    pos = af->offset;
+    used = 0;
+    while (1)
+    {
+        uio_kinit(&iov, &uio, name, NAME_MAX, pos, UIO_READ);
+        result = VOP_GETDIRENTRY(af->vn, &uio);
+        if (result)
+        {
+            break;
+        }
+        namlen = NAME_MAX - uio.uio_resid;
+        if (namlen == 0)
+        {
+            /* End of the directory */
+            break;
+        }
+        name[namlen] = '\0';
+
+        reclen = DIRENT_RECLEN(namlen);
+        if (used + reclen > buflen)
+        {
+            if (used == 0)
+            {
+                /* Not even one entry fits */
+                result = EINVAL;
+            }
+            break;
+        }
+
+        d = (struct dirent*)(kbuf + used);
+        dirent_stat(af->vn, name, &d->d_stat);
+        d->d_reclen = reclen;
+        d->d_namlen = namlen;
+        memcpy(d->d_name, name, namlen + 1);
+
+        used += reclen;
+        pos = uio.uio_offset;
+    }
+
+    /* Like read, hand back what we have and save the error for next time */
+    if (used > 0)
+    {
+        result = 0;
+    }
+
+    /* The offset only moves past entries the user actually got */
+    if (result == 0)
+    {
+        result = copyout(kbuf, buf, used);
+    }
+    if (result == 0)
+    {
+        af->offset = pos;
+        *retval = used;
+    }
+    dir_release(ft_idx, af);
+
+    kfree(kbuf);
+    return result;
+}
@@ -9,8 +9,8 @@
 int
 sys_getpid(int* retval)
 {
-    lock_acquire(kproc_table->pid_lk);
+    rw_rlock(kproc_table->pid_lk);
     *retval = curproc->p_pid;
-    lock_release(kproc_table->pid_lk);
+    rw_runlock(kproc_table->pid_lk);
     return 0;
 }
\ No newline at end of file
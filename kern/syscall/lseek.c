@@ -20,12 +20,12 @@ sys_lseek(int fd, off_t pos, int sp, int64_t *retval_64)
     int whence_val;
     int result;
 
-    lock_acquire(curproc->fdtable_lk);
+    rw_rlock(curproc->fdtable_lk);
 
     result = __check_fd(fd);
     if (result) 
     {
-        lock_release(curproc->fdtable_lk);
+        rw_runlock(curproc->fdtable_lk);
         return result;
     }
 
@@ -33,66 +33,73 @@ sys_lseek(int fd, off_t pos, int sp, int64_t *retval_64)
     result = copyin((userptr_t)(sp + 16), &whence_val, sizeof(int32_t));
     if (result)
     {
-        lock_release(curproc->fdtable_lk);
+        rw_runlock(curproc->fdtable_lk);
         return result;
     }
 
 
-    int actual_index = curproc->fdtable[fd];
+    int actual_index = fdtable_get(curproc->p_fdtable, fd);
     
     if (actual_index== FDTABLE_EMPTY)
     {
-        lock_release(curproc->fdtable_lk);
+        rw_runlock(curproc->fdtable_lk);
         return EBADF;
     }
 
     ;
 
-    if (!VOP_ISSEEKABLE(kfile_table->files[actual_index]->vn))
+    if (!VOP_ISSEEKABLE(FT_FILE(kfile_table, actual_index)->vn))
     {
-        lock_release(curproc->fdtable_lk);
+        rw_runlock(curproc->fdtable_lk);
         return ESPIPE;
     }
     
     off_t actual_pos = 0;
     struct stat file_stat;
+
+    /*
+     * Other threads can be using the same file table (and other processes the same file),
+     * so hold the file's offset lock from reading the current offset until the new one is set.
+     * Our descriptor holds a reference, so the file can't go away while we hold the fd table lock.
+     */
+    struct abstractfile *af = FT_FILE(kfile_table, actual_index);
+    lock_acquire(af->offset_lk);
     switch (whence_val)
     {
     case SEEK_SET:
         actual_pos = pos;
         break;
     case SEEK_CUR:
-        actual_pos = kfile_table->files[actual_index]->offset + pos;
+        actual_pos = af->offset + pos;
         break;
     case SEEK_END:
-        if (VOP_STAT(kfile_table->files[actual_index]->vn, &file_stat)) 
+        if (VOP_STAT(af->vn, &file_stat)) 
         {
-            lock_release(curproc->fdtable_lk);
+            lock_release(af->offset_lk);
+            rw_runlock(curproc->fdtable_lk);
             return EIO;
         }
         actual_pos = file_stat.st_size + pos;
         break; 
     default:
-        lock_release(curproc->fdtable_lk);
+        lock_release(af->offset_lk);
+        rw_runlock(curproc->fdtable_lk);
         return EINVAL;
         break;
     }
 
     if (actual_pos < 0)
     {
-        lock_release(curproc->fdtable_lk);
+        lock_release(af->offset_lk);
+        rw_runlock(curproc->fdtable_lk);
         return EINVAL;
     }
 
-    // Protect!!!!
-   // lock_acquire(kfile_table->files_lk[actual_index]);
-    lock_acquire(kfile_table->location_lk);
-    kfile_table->files[actual_index]->offset = actual_pos;
-    lock_release(kfile_table->location_lk);
-    //lock_release(kfile_table->files_lk[actual_index]);
+    af->offset = actual_pos;
+    lock_release(af->offset_lk);
     *retval_64 = actual_pos;
 
-    lock_release(curproc->fdtable_lk);
+    rw_runlock(curproc->fdtable_lk);
 
     return 0;
 }
\ No newline at end of file
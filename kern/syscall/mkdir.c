@@ -0,0 +1,41 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <vfs.h>
+#include <syscall.h>
+#include <filetable.h>
+
+int
+sys_mkdir(userptr_t path, mode_t mode)
+{
+    char* kpath;
+    int result;
+
+    result = __copyin_path(path, &kpath);
+    if (result)
+    {
+        return result;
+    }
+
+    result = vfs_mkdir(kpath, mode);
+    kfree(kpath);
+    return result;
+}
+
+int
+sys_rmdir(userptr_t path)
+{
+    char* kpath;
+    int result;
+
+    result = __copyin_path(path, &kpath);
+    if (result)
+    {
+        return result;
+    }
+
+    result = vfs_rmdir(kpath);
+    kfree(kpath);
+    return result;
+}
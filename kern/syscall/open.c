@@ -38,7 +38,7 @@ sys_open(userptr_t path, int flags, int* retval)
     struct abstractfile* af = NULL;
     (void)actual;
 
-    lock_acquire(curproc->fdtable_lk);
+    rw_wlock(curproc->fdtable_lk);
 
     /*
      * Main flags for file opening, others are addons.
@@ -49,7 +49,7 @@ sys_open(userptr_t path, int flags, int* retval)
     int access_mode = flags & O_ACCMODE;
     if (access_mode == 3) 
     {
-        lock_release(curproc->fdtable_lk);
+        rw_wunlock(curproc->fdtable_lk);
         return EINVAL;
     }
 
@@ -58,23 +58,31 @@ sys_open(userptr_t path, int flags, int* retval)
     //result = copyin(path, kpath, sizeof(kpath));
     if (result)
     {
-        lock_release(curproc->fdtable_lk);
+        rw_wunlock(curproc->fdtable_lk);
         return result;
     }
 
     result = __open(kpath, flags, &af);
     if (result)
     {
-        lock_release(curproc->fdtable_lk);
+        rw_wunlock(curproc->fdtable_lk);
         return result;
     }
 
-    result = pt_find_free_fd(curproc, &fd);
+    // We are about to change the fd table, get a copy if it is shared since fork
+    result = fdtable_unshare(&curproc->p_fdtable);
     if (result)
     {
-        vfs_close(af->vn);
-        af_destroy(&af);
-        lock_release(curproc->fdtable_lk);
+        af_discard(af);
+        rw_wunlock(curproc->fdtable_lk);
+        return result;
+    }
+
+    result = fdtable_find_free(curproc->p_fdtable, &fd);
+    if (result)
+    {
+        af_discard(af);
+        rw_wunlock(curproc->fdtable_lk);
         return result;
     }
 
@@ -82,24 +90,21 @@ sys_open(userptr_t path, int flags, int* retval)
     result = ft_add_file(&af, &file_location);
     if(result)
     {
-        vfs_close(af->vn);
-        af_destroy(&af);
-        lock_release(curproc->fdtable_lk);
+        af_discard(af);
+        rw_wunlock(curproc->fdtable_lk);
         return result;
     }
 
-    curproc->fdtable[fd] = file_location;
-
     /*
-     * both vfs_open and vfs_lookup that open up a vnode file use VOP_DECREF  
-     * Increase the reference count of the v-ndode
-     * Increase the amount of open file descriptors for the process table 
+     * Can't fail, fdtable_find_free already made room.
+     * The reference the file was created with is now the fd's.
      */
-    curproc->fdtable_num_entries ++;
+    result = fdtable_set(curproc->p_fdtable, fd, file_location);
+    KASSERT(result == 0);
     
     *retval = fd;
 
-    lock_release(curproc->fdtable_lk);
+    rw_wunlock(curproc->fdtable_lk);
 
     return 0;
 }
@@ -0,0 +1,113 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <synch.h>
+#include <proc.h>
+#include <current.h>
+#include <abstractfile.h>
+#include <filetable.h>
+#include <vfs.h>
+#include <pipe.h>
+#include <syscall.h>
+#include <copyinout.h>
+
+/*
+ * Makes an open file for one end of a pipe and puts it in kfile_table.
+ * The end's vnode reference goes to the file, even on failure.
+ */
+static
+int
+pipe_addend(struct vnode* vn, int flags, int* location)
+{
+    struct abstractfile* af;
+    int result;
+
+    result = af_create(flags, vn, &af);
+    if (result)
+    {
+        vfs_close(vn);
+        return result;
+    }
+
+    result = ft_add_file(&af, location);
+    if (result)
+    {
+        af_discard(af);
+        return result;
+    }
+
+    return 0;
+}
+
+int
+sys_pipe(userptr_t fds, int* retval)
+{
+    struct vnode *rvn, *wvn;
+    int rloc, wloc;
+    int kfds[2];
+    int result;
+
+    result = pipe_create(&rvn, &wvn);
+    if (result)
+    {
+        return result;
+    }
+
+    result = pipe_addend(rvn, O_RDONLY, &rloc);
+    if (result)
+    {
+        vfs_close(wvn);
+        return result;
+    }
+    result = pipe_addend(wvn, O_WRONLY, &wloc);
+    if (result)
+    {
+        ft_release_file(rloc);
+        return result;
+    }
+
+    rw_wlock(curproc->fdtable_lk);
+
+    result = fdtable_unshare(&curproc->p_fdtable);
+    if (result)
+    {
+        goto fail;
+    }
+
+    /* Each fd is taken before looking for the next, so they differ */
+    result = fdtable_find_free(curproc->p_fdtable, &kfds[0]);
+    if (result)
+    {
+        goto fail;
+    }
+    result = fdtable_set(curproc->p_fdtable, kfds[0], rloc);
+    KASSERT(result == 0);
+
+    result = fdtable_find_free(curproc->p_fdtable, &kfds[1]);
+    if (result)
+    {
+        fdtable_clear(curproc->p_fdtable, kfds[0]);
+        goto fail;
+    }
+    result = fdtable_set(curproc->p_fdtable, kfds[1], wloc);
+    KASSERT(result == 0);
+
+    result = copyout(kfds, fds, sizeof(kfds));
+    if (result)
+    {
+        fdtable_clear(curproc->p_fdtable, kfds[1]);
+        fdtable_clear(curproc->p_fdtable, kfds[0]);
+        goto fail;
+    }
+
+    rw_wunlock(curproc->fdtable_lk);
+
+    *retval = 0;
+    return 0;
+
+fail:
+    rw_wunlock(curproc->fdtable_lk);
+    ft_release_file(wloc);
+    ft_release_file(rloc);
+    return result;
+}
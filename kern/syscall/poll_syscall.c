@@ -0,0 +1,190 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/limits.h>
+#include <kern/poll.h>
+#include <lib.h>
+#include <clock.h>
+#include <synch.h>
+#include <proc.h>
+#include <current.h>
+#include <vnode.h>
+#include <abstractfile.h>
+#include <filetable.h>
+#include <fdtable.h>
+#include <poll.h>
+#include <syscall.h>
+#include <copyinout.h>
+
+/* Calls with at most this many fds keep everything on the stack */
+#define POLL_SMALL 8
+
+/* In place of a kfile_table index for a negative fd, which is skipped; not FDTABLE_EMPTY */
+#define POLL_SKIP -2
+
+/*
+ * Converts a timeout in milliseconds to ticks for pollwaiter_sleep, the
+ * way nanosleep does: rounded up, plus one for the partial tick we are
+ * in. Negative means wait forever, which is 0.
+ */
+static
+unsigned
+poll_ticks(int timeout)
+{
+    uint64_t ticks;
+
+    if (timeout < 0)
+    {
+        return 0;
+    }
+    ticks = ((uint64_t)timeout * HZ + 999) / 1000 + 1;
+    return ticks > 0x7fffffff ? 0x7fffffff : ticks;
+}
+
+/*
+ * Looks at each fd once. On the first pass of a call that may sleep, each
+ * vnode is handed its entry, so whatever changes it from then on wakes us.
+ * Returns how many fds have something to report.
+ */
+static
+int
+poll_scan(struct pollfd* kfds, unsigned nfds, int* ft_idx, struct abstractfile** afs,
+          struct pollentry* entries, bool enqueue)
+{
+    unsigned i;
+    int ready = 0;
+
+    for (i = 0; i < nfds; i++)
+    {
+        if (ft_idx[i] == POLL_SKIP)
+        {
+            continue;
+        }
+        if (ft_idx[i] == FDTABLE_EMPTY)
+        {
+            kfds[i].revents = POLLNVAL;
+        }
+        else
+        {
+            kfds[i].revents = VOP_POLL(afs[i]->vn, kfds[i].events,
+                                       enqueue ? &entries[i] : NULL);
+            kfds[i].revents &= kfds[i].events | POLLERR | POLLHUP;
+        }
+        if (kfds[i].revents != 0)
+        {
+            ready++;
+        }
+    }
+
+    return ready;
+}
+
+int
+sys_poll(userptr_t fds, unsigned nfds, int timeout, int* retval)
+{
+    struct pollfd small_fds[POLL_SMALL];
+    struct pollentry small_entries[POLL_SMALL];
+    struct abstractfile* small_afs[POLL_SMALL];
+    int small_idx[POLL_SMALL];
+    struct pollfd* kfds;
+    struct pollentry* entries;
+    struct abstractfile** afs;
+    int* ft_idx;
+    struct pollwaiter pw;
+    unsigned ticks, i;
+    bool timedout;
+    int ready;
+    int result;
+
+    if (nfds > __OPEN_MAX)
+    {
+        return EINVAL;
+    }
+
+    if (nfds <= POLL_SMALL)
+    {
+        kfds = small_fds;
+        entries = small_entries;
+        afs = small_afs;
+        ft_idx = small_idx;
+    }
+    else
+    {
+        kfds = kmalloc(nfds * sizeof(struct pollfd));
+        entries = kmalloc(nfds * sizeof(struct pollentry));
+        afs = kmalloc(nfds * sizeof(struct abstractfile*));
+        ft_idx = kmalloc(nfds * sizeof(int));
+        if (kfds == NULL || entries == NULL || afs == NULL || ft_idx == NULL)
+        {
+            result = ENOMEM;
+            goto out_free;
+        }
+    }
+
+    result = copyin(fds, kfds, nfds * sizeof(struct pollfd));
+    if (result)
+    {
+        goto out_free;
+    }
+
+    result = pollwaiter_init(&pw, entries, nfds);
+    if (result)
+    {
+        goto out_free;
+    }
+
+    /* Hold every file, so none of them goes away while we are on its pollhead */
+    rw_rlock(curproc->fdtable_lk);
+    for (i = 0; i < nfds; i++)
+    {
+        kfds[i].revents = 0;
+        if (kfds[i].fd < 0)
+        {
+            ft_idx[i] = POLL_SKIP;
+            continue;
+        }
+        ft_idx[i] = fdtable_get(curproc->p_fdtable, kfds[i].fd);
+        if (ft_idx[i] != FDTABLE_EMPTY)
+        {
+            afs[i] = ft_hold_file(ft_idx[i]);
+        }
+    }
+    rw_runlock(curproc->fdtable_lk);
+
+    /*
+     * Only the first pass registers. After that we are on every pollhead,
+     * so each wakeup is for a change to one of ours, and we just look again.
+     */
+    ticks = poll_ticks(timeout);
+    ready = poll_scan(kfds, nfds, ft_idx, afs, entries, timeout != 0);
+    timedout = false;
+    while (ready == 0 && timeout != 0 && !timedout)
+    {
+        timedout = pollwaiter_sleep(&pw, ticks);
+        ready = poll_scan(kfds, nfds, ft_idx, afs, entries, false);
+    }
+
+    pollwaiter_cleanup(&pw, entries, nfds);
+    for (i = 0; i < nfds; i++)
+    {
+        if (ft_idx[i] != POLL_SKIP && ft_idx[i] != FDTABLE_EMPTY)
+        {
+            ft_release_file(ft_idx[i]);
+        }
+    }
+
+    result = copyout(kfds, fds, nfds * sizeof(struct pollfd));
+    if (result == 0)
+    {
+        *retval = ready;
+    }
+
+out_free:
+    if (nfds > POLL_SMALL)
+    {
+        kfree(kfds);
+        kfree(entries);
+        kfree(afs);
+        kfree(ft_idx);
+    }
+    return result;
+}
@@ -0,0 +1,47 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/iovec.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include <uio.h>
+
+/*
+ * Positional I/O. The file's offset is neither used nor moved, so
+ * workers sharing one open file (after fork, say) don't have to take
+ * turns on it or lseek before every transfer.
+ */
+static
+int
+file_pio(int filehandle, userptr_t buf, size_t size, int sp, enum uio_rw rw, int* retval)
+{
+    struct iovec iov;
+    off_t pos;
+    int result;
+
+    // The position doesn't fit in the registers; it is on the stack at sp+16, like lseek's whence
+    result = copyin((userptr_t)(sp + 16), &pos, sizeof(off_t));
+    if (result)
+    {
+        return result;
+    }
+    if (pos < 0)
+    {
+        return EINVAL;
+    }
+
+    iov.iov_ubase = buf;
+    iov.iov_len = size;
+    return __file_io(filehandle, &iov, 1, size, rw, &pos, retval);
+}
+
+int
+sys_pread(int filehandle, userptr_t buf, size_t size, int sp, int* retval)
+{
+    return file_pio(filehandle, buf, size, sp, UIO_READ, retval);
+}
+
+int
+sys_pwrite(int filehandle, userptr_t buf, size_t size, int sp, int* retval)
+{
+    return file_pio(filehandle, buf, size, sp, UIO_WRITE, retval);
+}
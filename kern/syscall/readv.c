@@ -0,0 +1,195 @@
+#include <types.h>
+#include <stat.h>
+#include <vnode.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/iovec.h>
+#include <limits.h>
+#include <lib.h>
+#include <synch.h>
+#include <proc.h>
+#include <current.h>
+#include <abstractfile.h>
+#include <filetable.h>
+#include <vfs.h>
+#include <syscall.h>
+#include <copyinout.h>
+#include <uio.h>
+
+/* Vectors up to this long are copied onto the stack, longer ones into kmalloc'd memory */
+#define IOV_ONSTACK 8
+
+/* The byte count is returned in an int */
+#define IO_MAX 0x7fffffff
+
+int
+__file_io(int filehandle, struct iovec* iov, int iovcnt, size_t size, enum uio_rw rw,
+          const off_t* pos, int* retval)
+{
+    int result;
+    int ft_idx;
+    struct uio uio;
+    struct abstractfile *af;
+    struct stat file_stat;
+
+    // acquire lock for process' fd table - first layer of file structure
+    rw_rlock(curproc->fdtable_lk);
+
+    ft_idx = fdtable_get(curproc->p_fdtable, filehandle);
+    if (ft_idx == FDTABLE_EMPTY)
+    {
+        rw_runlock(curproc->fdtable_lk);
+        return EBADF;
+    }
+
+    /* Our own reference keeps the file alive without holding the fd table lock over the I/O */
+    af = ft_hold_file(ft_idx);
+    rw_runlock(curproc->fdtable_lk);
+
+    int status = af->status;
+    struct vnode *vn = af->vn;
+    int access_mode = status & O_ACCMODE;
+
+    if (rw == UIO_READ && access_mode != O_RDONLY && access_mode != O_RDWR)
+    {
+        ft_release_file(ft_idx);
+        return EBADF;
+    }
+    if (rw == UIO_WRITE && access_mode != O_WRONLY && access_mode != O_RDWR)
+    {
+        ft_release_file(ft_idx);
+        return EBADF;
+    }
+
+    /*
+     * The offset is read once and written back once, with the offset lock
+     * held the whole time, so all the vectors go out as one piece. I/O at
+     * an explicit position doesn't touch the offset, so it needs no lock.
+     */
+    bool seekable = VOP_ISSEEKABLE(vn);
+    bool use_offset = seekable && pos == NULL;
+    if (pos != NULL && !seekable)
+    {
+        ft_release_file(ft_idx);
+        return ESPIPE;
+    }
+    if (use_offset)
+    {
+        lock_acquire(af->offset_lk);
+    }
+
+    uio.uio_iov = iov;
+    uio.uio_iovcnt = iovcnt;
+    uio.uio_offset = pos != NULL ? *pos : af->offset;
+    uio.uio_resid = size;
+    uio.uio_segflg = UIO_USERSPACE;
+    uio.uio_rw = rw;
+    uio.uio_space = proc_getas();
+
+    if (rw == UIO_READ)
+    {
+        result = VOP_READ(vn, &uio);
+    }
+    else
+    {
+        result = 0;
+        if ((status & O_APPEND) && pos == NULL)
+        {
+            result = VOP_STAT(vn, &file_stat);
+            if (result == 0)
+            {
+                uio.uio_offset = file_stat.st_size;
+            }
+        }
+        if (result == 0)
+        {
+            result = VOP_WRITE(vn, &uio);
+        }
+    }
+    if (result == 0 && pos == NULL)
+    {
+        af->offset = uio.uio_offset;
+    }
+
+    if (use_offset)
+    {
+        lock_release(af->offset_lk);
+    }
+    ft_release_file(ft_idx);
+
+    if (result)
+    {
+        return result;
+    }
+
+    *retval = size - uio.uio_resid;
+    return 0;
+}
+
+/*
+ * Copies in the user's iovec array and does the I/O.
+ */
+static
+int
+file_iov(int filehandle, userptr_t user_iov, int iovcnt, enum uio_rw rw, int* retval)
+{
+    struct iovec stack_iov[IOV_ONSTACK];
+    struct iovec* iov;
+    size_t size;
+    int result;
+    int i;
+
+    if (iovcnt <= 0 || iovcnt > IOV_MAX)
+    {
+        return EINVAL;
+    }
+
+    iov = stack_iov;
+    if (iovcnt > IOV_ONSTACK)
+    {
+        iov = kmalloc(iovcnt * sizeof(struct iovec));
+        if (iov == NULL)
+        {
+            return ENOMEM;
+        }
+    }
+
+    /* All of it in one go; the user's and the kernel's iovecs are laid out the same */
+    result = copyin(user_iov, iov, iovcnt * sizeof(struct iovec));
+    if (result)
+    {
+        goto out;
+    }
+
+    size = 0;
+    for (i = 0; i < iovcnt; i++)
+    {
+        if (iov[i].iov_len > IO_MAX - size)
+        {
+            result = EINVAL;
+            goto out;
+        }
+        size += iov[i].iov_len;
+    }
+
+    result = __file_io(filehandle, iov, iovcnt, size, rw, NULL, retval);
+
+out:
+    if (iov != stack_iov)
+    {
+        kfree(iov);
+    }
+    return result;
+}
+
+int
+sys_readv(int filehandle, userptr_t iov, int iovcnt, int* retval)
+{
+    return file_iov(filehandle, iov, iovcnt, UIO_READ, retval);
+}
+
+int
+sys_writev(int filehandle, userptr_t iov, int iovcnt, int* retval)
+{
+    return file_iov(filehandle, iov, iovcnt, UIO_WRITE, retval);
+}
@@ -0,0 +1,46 @@
+#include <types.h>
+#include <lib.h>
+#include <vfs.h>
+#include <filetable.h>
+#include <syscall.h>
+
+int
+sys_remove(userptr_t path)
+{
+    char* kpath;
+    int result;
+
+    result = __copyin_path(path, &kpath);
+    if (result)
+    {
+        return result;
+    }
+
+    result = vfs_remove(kpath);
+    kfree(kpath);
+    return result;
+}
+
+int
+sys_rename(userptr_t oldpath, userptr_t newpath)
+{
+    char *koldpath, *knewpath;
+    int result;
+
+    result = __copyin_path(oldpath, &koldpath);
+    if (result)
+    {
+        return result;
+    }
+    result = __copyin_path(newpath, &knewpath);
+    if (result)
+    {
+        kfree(koldpath);
+        return result;
+    }
+
+    result = vfs_rename(koldpath, knewpath);
+    kfree(knewpath);
+    kfree(koldpath);
+    return result;
+}
@@ -28,6 +28,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <clock.h>
 #include <copyinout.h>
 #include <syscall.h>
@@ -56,3 +57,49 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Sleep for at least the requested time. There are no signals, so the
+ * sleep is never cut short and the remaining time is always zero.
+ */
+int
+sys_nanosleep(userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec req, rem;
+	uint64_t ticks;
+	int result;
+
+	result = copyin(user_req, &req, sizeof(req));
+	if (result) {
+		return result;
+	}
+	if (req.tv_sec < 0 || req.tv_nsec < 0 || req.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	/*
+	 * Round up to whole ticks, plus one because we may be partway
+	 * through the current tick.
+	 */
+	ticks = (uint64_t)req.tv_sec * HZ +
+		((uint64_t)req.tv_nsec * HZ + 999999999) / 1000000000;
+	if (ticks > 0) {
+		ticks++;
+	}
+	while (ticks > 0) {
+		unsigned chunk = ticks > 0x7fffffff ? 0x7fffffff : ticks;
+
+		clocksleep_ticks(chunk);
+		ticks -= chunk;
+	}
+
+	if (user_rem != NULL) {
+		rem.tv_sec = 0;
+		rem.tv_nsec = 0;
+		result = copyout(&rem, user_rem, sizeof(rem));
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
@@ -46,11 +46,11 @@ __waitpid(int pid, int* status, int options)
     struct proc* child;
     //int* status_i = (int*) &status;
 
-    lock_acquire(kproc_table->pid_lk);
+    rw_rlock(kproc_table->pid_lk);
 
     if (options != 0)
     {
-        lock_release(kproc_table->pid_lk);
+        rw_runlock(kproc_table->pid_lk);
         return EINVAL;
     }
 
@@ -58,7 +58,7 @@ __waitpid(int pid, int* status, int options)
 
     if (result) 
     {
-        lock_release(kproc_table->pid_lk);
+        rw_runlock(kproc_table->pid_lk);
         return result;
     }
 
@@ -78,7 +78,7 @@ __waitpid(int pid, int* status, int options)
         //     break;
         // }
     }
-    lock_release(kproc_table->pid_lk);
+    rw_runlock(kproc_table->pid_lk);
 
     if(!result)
     {
@@ -33,6 +33,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <clock.h>
 #include <thread.h>
 #include <synch.h>
 #include <vm.h> /* for PAGE_SIZE */
@@ -40,6 +41,31 @@
 
 #include "opt-dumbvm.h"
 
+/*
+ * Print how fast a timed run allocated, along with the number of cpus,
+ * so that the same test can be compared across cpu counts and kernels.
+ */
+static
+void
+report_rate(const char *name, unsigned long nallocs,
+	    const struct timespec *start, const struct timespec *end)
+{
+	struct timespec diff;
+	uint64_t ns;
+
+	timespec_sub(end, start, &diff);
+	ns = (uint64_t)diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+	if (ns == 0) {
+		ns = 1;
+	}
+
+	kprintf("%s: %lu allocations in %llu.%09lu seconds on %u cpu(s): "
+		"%llu allocations/sec\n", name, nallocs,
+		(unsigned long long)diff.tv_sec, (unsigned long)diff.tv_nsec,
+		thread_numcpus(),
+		(unsigned long long)(nallocs * 1000000000ULL / ns));
+}
+
 ////////////////////////////////////////////////////////////
 // km1/km2
 
@@ -114,6 +140,7 @@ int
 mallocstress(int nargs, char **args)
 {
 	struct semaphore *sem;
+	struct timespec start, end;
 	int i, result;
 
 	(void)nargs;
@@ -126,6 +153,7 @@ mallocstress(int nargs, char **args)
 
 	kprintf("Starting kmalloc stress test...\n");
 
+	gettime(&start);
 	for (i=0; i<NTHREADS; i++) {
 		result = thread_fork("mallocstress", NULL,
 				     mallocthread, sem, i);
@@ -138,8 +166,10 @@ mallocstress(int nargs, char **args)
 	for (i=0; i<NTHREADS; i++) {
 		P(sem);
 	}
+	gettime(&end);
 
 	sem_destroy(sem);
+	report_rate("mallocstress", NTHREADS * NTRIES, &start, &end);
 	kprintf("kmalloc stress test done\n");
 
 	return 0;
@@ -183,6 +213,7 @@ malloctest3(int nargs, char **args)
 	size_t totalsize;
 	unsigned i, j;
 	unsigned char *ptr;
+	struct timespec start, end;
 
 	if (nargs != 2) {
 		kprintf("malloctest3: usage: malloctest3 numobjects\n");
@@ -214,6 +245,7 @@ malloctest3(int nargs, char **args)
 	}
 
 	/* Allocate the objects. */
+	gettime(&start);
 	curblock = 0;
 	curpos = 0;
 	cursizeindex = 0;
@@ -279,6 +311,10 @@ malloctest3(int nargs, char **args)
 		cursizeindex = (cursizeindex + 1) % NUM_KM3_SIZES;
 	}
 	KASSERT(totalsize == 0);
+	gettime(&end);
+
+	/* Each object was also filled and checked, so this is a lower bound. */
+	report_rate("malloctest3", numptrs, &start, &end);
 
 	/* Free the lower tier. */
 	for (i=0; i<numptrblocks; i++) {
@@ -0,0 +1,149 @@
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <thread.h>
+#include <test.h>
+
+/*
+ * Spinlock stress test.
+ *
+ * One thread per cpu (at least two) hammers a single spinlock for
+ * SLT_SECS seconds, doing a little work inside and outside the lock,
+ * first with a test-and-set lock and then with a ticket lock. For
+ * each kind we print the throughput (acquisitions per second), the
+ * fewest and most acquisitions any one thread got, and Jain's fairness
+ * index (1000 is perfectly fair, 1000/n means one thread got it all).
+ * The shared counter is checked against the per-thread counts to make
+ * sure the lock actually excluded.
+ */
+
+#define SLT_SECS        1
+#define SLT_MAXTHREADS  32
+#define SLT_HOLD        50      /* busy loop while holding the lock */
+#define SLT_GAP         20      /* busy loop between acquisitions */
+
+static struct spinlock slt_lock;
+static volatile bool slt_stop;
+static volatile unsigned long slt_counter;
+static unsigned long slt_counts[SLT_MAXTHREADS];
+static struct semaphore *slt_donesem;
+
+static
+void
+slt_thread(void *junk, unsigned long num)
+{
+	unsigned long count;
+	volatile int j;
+
+	(void)junk;
+
+	count = 0;
+	while (!slt_stop) {
+		spinlock_acquire(&slt_lock);
+		slt_counter++;
+		for (j=0; j<SLT_HOLD; j++);
+		spinlock_release(&slt_lock);
+		count++;
+		for (j=0; j<SLT_GAP; j++);
+	}
+	slt_counts[num] = count;
+
+	V(slt_donesem);
+}
+
+static
+void
+slt_run(const char *kind, bool ticket, unsigned nthreads)
+{
+	struct timespec ts1, ts2;
+	uint64_t ns, sum, sumsq;
+	unsigned long min, max;
+	unsigned i;
+	int result;
+
+	if (ticket) {
+		spinlock_init_ticket(&slt_lock);
+	}
+	else {
+		spinlock_init(&slt_lock);
+	}
+	slt_stop = false;
+	slt_counter = 0;
+
+	gettime(&ts1);
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("spinlocktest", NULL, slt_thread,
+				     NULL, i);
+		if (result) {
+			panic("spinlocktest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	clocksleep(SLT_SECS);
+	slt_stop = true;
+	for (i=0; i<nthreads; i++) {
+		P(slt_donesem);
+	}
+	gettime(&ts2);
+	spinlock_cleanup(&slt_lock);
+
+	sum = sumsq = 0;
+	min = max = slt_counts[0];
+	for (i=0; i<nthreads; i++) {
+		sum += slt_counts[i];
+		sumsq += (uint64_t)slt_counts[i] * slt_counts[i];
+		if (slt_counts[i] < min) {
+			min = slt_counts[i];
+		}
+		if (slt_counts[i] > max) {
+			max = slt_counts[i];
+		}
+	}
+	if (sum != slt_counter) {
+		panic("spinlocktest: %s: counter %lu, threads counted %llu\n",
+		      kind, slt_counter, (unsigned long long)sum);
+	}
+
+	timespec_sub(&ts2, &ts1, &ts2);
+	ns = ts2.tv_nsec + (uint64_t)ts2.tv_sec * 1000000000;
+	kprintf("%-6s %2u threads: %llu acquires/sec, "
+		"per thread min %lu max %lu, fairness %llu/1000\n",
+		kind, nthreads,
+		(unsigned long long)(sum * 1000000000 / ns), min, max,
+		(unsigned long long)(sumsq == 0 ? 1000 :
+				     sum * sum * 1000 / (nthreads * sumsq)));
+}
+
+int
+spinlocktest(int nargs, char **args)
+{
+	unsigned nthreads;
+
+	(void)nargs;
+	(void)args;
+
+	slt_donesem = sem_create("spinlocktest", 0);
+	if (slt_donesem == NULL) {
+		panic("spinlocktest: sem_create failed\n");
+	}
+
+	nthreads = thread_numcpus();
+	if (nthreads < 2) {
+		nthreads = 2;
+	}
+	if (nthreads > SLT_MAXTHREADS) {
+		nthreads = SLT_MAXTHREADS;
+	}
+
+	kprintf("Starting spinlock test...\n");
+	slt_run("tas", false, nthreads);
+	slt_run("ticket", true, nthreads);
+
+	sem_destroy(slt_donesem);
+	slt_donesem = NULL;
+
+	kprintf("Spinlock test done.\n");
+	return 0;
+}
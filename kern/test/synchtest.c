@@ -37,6 +37,7 @@
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
+#include <lockstat.h>
 
 #define NSEMLOOPS     63
 #define NLOCKLOOPS    120
@@ -51,6 +52,11 @@ static struct lock *testlock;
 static struct cv *testcv;
 static struct semaphore *donesem;
 
+/* lock_acquire latency, totalled over all threads in locktest */
+static uint64_t lockwait_total_ns;
+static uint64_t lockwait_max_ns;
+static unsigned long lockwait_count;
+
 static
 void
 inititems(void)
@@ -154,10 +160,23 @@ void
 locktestthread(void *junk, unsigned long num)
 {
 	int i;
+	struct timespec ts1, ts2;
+	uint64_t ns, total_ns, max_ns;
 	(void)junk;
 
+	total_ns = 0;
+	max_ns = 0;
+
 	for (i=0; i<NLOCKLOOPS; i++) {
+		gettime(&ts1);
 		lock_acquire(testlock);
+		gettime(&ts2);
+		timespec_sub(&ts2, &ts1, &ts2);
+		ns = ts2.tv_nsec + (uint64_t)ts2.tv_sec * 1000000000;
+		total_ns += ns;
+		if (ns > max_ns) {
+			max_ns = ns;
+		}
 		testval1 = num;
 		testval2 = num*num;
 		testval3 = num%3;
@@ -188,6 +207,15 @@ locktestthread(void *junk, unsigned long num)
 
 		lock_release(testlock);
 	}
+
+	lock_acquire(testlock);
+	lockwait_total_ns += total_ns;
+	lockwait_count += NLOCKLOOPS;
+	if (max_ns > lockwait_max_ns) {
+		lockwait_max_ns = max_ns;
+	}
+	lock_release(testlock);
+
 	V(donesem);
 }
 
@@ -203,6 +231,10 @@ locktest(int nargs, char **args)
 	inititems();
 	kprintf("Starting lock test...\n");
 
+	lockwait_total_ns = 0;
+	lockwait_max_ns = 0;
+	lockwait_count = 0;
+
 	for (i=0; i<NTHREADS; i++) {
 		result = thread_fork("synchtest", NULL, locktestthread,
 				     NULL, i);
@@ -215,6 +247,10 @@ locktest(int nargs, char **args)
 		P(donesem);
 	}
 
+	kprintf("lock_acquire latency: %lu acquires, avg %llu ns, max %llu ns\n",
+		lockwait_count,
+		(unsigned long long)(lockwait_total_ns / lockwait_count),
+		(unsigned long long)lockwait_max_ns);
 	kprintf("Lock test done.\n");
 
 	return 0;
@@ -399,3 +435,192 @@ cvtest2(int nargs, char **args)
 	kprintf("cvtest2 done\n");
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Reader-writer lock test.
+ *
+ * Run a growing number of reader threads, from one up to twice the
+ * number of cpus, against a single writer that updates the test values
+ * every so often. Readers check that they never see a half-done
+ * update. Each round runs for RWTEST_SECS seconds and prints the total
+ * reads per second, which should grow with the number of readers as
+ * long as there are cpus for them.
+ */
+
+#define RWTEST_SECS      1
+#define RWTEST_MAXREADERS 32
+#define RWTEST_WRITEGAP  2000   /* busy loop between writes */
+
+static struct rwlock *testrw;
+static volatile bool rwtest_stop;
+static struct spinlock rwtest_lock = SPINLOCK_INITIALIZER;
+static uint64_t rwtest_reads;
+static unsigned long rwtest_writes;
+
+static
+void
+rwreaderthread(void *junk, unsigned long num)
+{
+	unsigned long t1, t2, t3;
+	uint64_t reads;
+
+	(void)junk;
+
+	reads = 0;
+	while (!rwtest_stop) {
+		rw_rlock(testrw);
+		t1 = testval1;
+		t2 = testval2;
+		t3 = testval3;
+		if (t2 != t1*t1) {
+			fail(num, "rw testval2/testval1");
+		}
+		if (t3 != t1%3) {
+			fail(num, "rw testval3/testval1");
+		}
+		rw_runlock(testrw);
+		reads++;
+	}
+
+	spinlock_acquire(&rwtest_lock);
+	rwtest_reads += reads;
+	spinlock_release(&rwtest_lock);
+
+	V(donesem);
+}
+
+static
+void
+rwwriterthread(void *junk, unsigned long num)
+{
+	unsigned long writes;
+	volatile int j;
+
+	(void)junk;
+	(void)num;
+
+	writes = 0;
+	while (!rwtest_stop) {
+		rw_wlock(testrw);
+		testval1 = writes;
+		testval2 = writes*writes;
+		testval3 = writes%3;
+		rw_wunlock(testrw);
+		writes++;
+
+		for (j=0; j<RWTEST_WRITEGAP; j++);
+	}
+
+	spinlock_acquire(&rwtest_lock);
+	rwtest_writes += writes;
+	spinlock_release(&rwtest_lock);
+
+	V(donesem);
+}
+
+#if OPT_LOCKSTAT
+/* Acquisitions lockstat has charged to testrw so far */
+static
+uint64_t
+rwtest_lockstat_acquires(void)
+{
+	struct lockstat *ls;
+	uint64_t ret;
+
+	ls = lockstat_get("testrw", false);
+	if (ls == NULL) {
+		return 0;
+	}
+	spinlock_acquire(&ls->ls_lock);
+	ret = ls->ls_acquires;
+	spinlock_release(&ls->ls_lock);
+	return ret;
+}
+#endif
+
+int
+rwtest(int nargs, char **args)
+{
+	unsigned nreaders, maxreaders, i;
+	struct timespec ts1, ts2;
+	uint64_t ns;
+	int result;
+#if OPT_LOCKSTAT
+	uint64_t acquires;
+#endif
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	testrw = rw_create("testrw");
+	if (testrw == NULL) {
+		panic("rwtest: rw_create failed\n");
+	}
+
+	maxreaders = 2 * thread_numcpus();
+	if (maxreaders > RWTEST_MAXREADERS) {
+		maxreaders = RWTEST_MAXREADERS;
+	}
+
+	kprintf("Starting rwlock test...\n");
+	testval1 = testval2 = testval3 = 0;
+
+	for (nreaders = 1; nreaders <= maxreaders; nreaders *= 2) {
+		rwtest_stop = false;
+		rwtest_reads = 0;
+		rwtest_writes = 0;
+#if OPT_LOCKSTAT
+		acquires = rwtest_lockstat_acquires();
+#endif
+
+		gettime(&ts1);
+		for (i=0; i<nreaders; i++) {
+			result = thread_fork("rwtest", NULL, rwreaderthread,
+					     NULL, i);
+			if (result) {
+				panic("rwtest: thread_fork failed: %s\n",
+				      strerror(result));
+			}
+		}
+		result = thread_fork("rwtest", NULL, rwwriterthread, NULL, 0);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+
+		clocksleep(RWTEST_SECS);
+		rwtest_stop = true;
+		for (i=0; i<nreaders+1; i++) {
+			P(donesem);
+		}
+		gettime(&ts2);
+
+		timespec_sub(&ts2, &ts1, &ts2);
+		ns = ts2.tv_nsec + (uint64_t)ts2.tv_sec * 1000000000;
+		kprintf("%2u readers on %u cpus: %llu reads/sec, %lu writes\n",
+			nreaders, thread_numcpus(),
+			(unsigned long long)(rwtest_reads * 1000000000 / ns),
+			rwtest_writes);
+
+#if OPT_LOCKSTAT
+		/* Every read and write hold should have been counted */
+		acquires = rwtest_lockstat_acquires() - acquires;
+		if (acquires != rwtest_reads + rwtest_writes) {
+			panic("rwtest: lockstat counted %llu acquisitions "
+			      "of testrw, expected %llu\n",
+			      (unsigned long long)acquires,
+			      (unsigned long long)(rwtest_reads +
+						   rwtest_writes));
+		}
+#endif
+	}
+
+	rw_destroy(testrw);
+	testrw = NULL;
+
+	kprintf("rwlock test done.\n");
+	return 0;
+}
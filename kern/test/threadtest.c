@@ -32,12 +32,16 @@
  */
 #include <types.h>
 #include <lib.h>
+#include <clock.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
 
 #define NTHREADS  8
 
+#define CREATE_BATCH   16
+#define CREATE_ROUNDS  64
+
 static struct semaphore *tsem = NULL;
 
 static
@@ -144,3 +148,68 @@ threadtest2(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Thread creation rate: fork batches of threads that exit right away,
+ * first with the thread cache off and then with it on.
+ */
+static
+void
+emptythread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	V(tsem);
+}
+
+static
+void
+createrate(const char *what)
+{
+	struct timespec before, after;
+	uint64_t ns;
+	int i, j, result;
+
+	gettime(&before);
+	for (i=0; i<CREATE_ROUNDS; i++) {
+		for (j=0; j<CREATE_BATCH; j++) {
+			result = thread_fork("createtest", NULL, emptythread,
+					     NULL, j);
+			if (result) {
+				panic("threadtest4: thread_fork failed %s)\n",
+				      strerror(result));
+			}
+		}
+		for (j=0; j<CREATE_BATCH; j++) {
+			P(tsem);
+		}
+	}
+	gettime(&after);
+
+	timespec_sub(&after, &before, &after);
+	ns = after.tv_nsec + (uint64_t)after.tv_sec * 1000000000;
+	kprintf("%-8s %d threads in %llu.%09lu seconds (%llu threads/sec)\n",
+		what, CREATE_ROUNDS * CREATE_BATCH,
+		(unsigned long long)after.tv_sec,
+		(unsigned long)after.tv_nsec,
+		(unsigned long long)((uint64_t)CREATE_ROUNDS * CREATE_BATCH *
+				     1000000000 / ns));
+}
+
+int
+threadtest4(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	init_sem();
+	kprintf("Starting thread test 4...\n");
+	thread_cache_enable(false);
+	createrate("uncached");
+	thread_cache_enable(true);
+	createrate("cached");
+	kprintf("Thread test 4 done.\n");
+
+	return 0;
+}
@@ -34,6 +34,9 @@
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <kmalloc_tag.h>
+#include <workqueue.h>
+#include <timer.h>
 
 /*
  * Time handling.
@@ -59,6 +62,13 @@
 static struct wchan *lbolt;
 static struct spinlock lbolt_lock;
 
+/*
+ * Threads in clocksleep_ticks. Nobody wakes this up; its sleepers
+ * leave by timing out.
+ */
+static struct wchan *naps;
+static struct spinlock naps_lock;
+
 /*
  * Setup.
  */
@@ -66,10 +76,16 @@ void
 hardclock_bootstrap(void)
 {
 	spinlock_init(&lbolt_lock);
+	spinlock_setname(&lbolt_lock, "lbolt");
 	lbolt = wchan_create("lbolt");
 	if (lbolt == NULL) {
 		panic("Couldn't create lbolt\n");
 	}
+	spinlock_init(&naps_lock);
+	naps = wchan_create("nap");
+	if (naps == NULL) {
+		panic("Couldn't create naps\n");
+	}
 }
 
 /*
@@ -97,13 +113,18 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+	if (curcpu->c_number == 0) {
+		kmalloc_tag_sample();
+		timer_tick();
+	}
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
-	thread_yield();
+	workqueue_tick();
+	thread_tick();
 }
 
 /*
@@ -119,3 +140,19 @@ clocksleep(int num_secs)
 	}
 	spinlock_release(&lbolt_lock);
 }
+
+/*
+ * Suspend execution for at least n ticks (1/HZ seconds each).
+ */
+void
+clocksleep_ticks(unsigned num_ticks)
+{
+	unsigned deadline;
+
+	deadline = timer_now() + num_ticks;
+	spinlock_acquire(&naps_lock);
+	while ((int)(deadline - timer_now()) > 0) {
+		wchan_sleep_timeout(naps, &naps_lock, deadline - timer_now());
+	}
+	spinlock_release(&naps_lock);
+}
@@ -0,0 +1,207 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <lockstat.h>
+
+/*
+ * The records. They are never freed, so a lock can keep a pointer to
+ * its record for its whole life. Records are only looked up when a
+ * lock is created (or a spinlock named), which is far less often than
+ * they are updated, so a linear search is good enough.
+ */
+#define LOCKSTAT_MAX 128
+
+static struct lockstat lockstats[LOCKSTAT_MAX];
+static unsigned num_lockstats = 0;
+static struct spinlock lockstats_lock = SPINLOCK_INITIALIZER;
+
+struct lockstat *
+lockstat_get(const char *name, bool spin)
+{
+    struct lockstat *ls;
+    char key[LOCKSTAT_NAMELEN];
+    unsigned i;
+
+    KASSERT(name != NULL);
+
+    /* Long names are truncated, both when stored and when looked up */
+    for (i = 0; i < LOCKSTAT_NAMELEN - 1 && name[i] != '\0'; i++)
+    {
+        key[i] = name[i];
+    }
+    key[i] = '\0';
+
+    spinlock_acquire(&lockstats_lock);
+    for (i = 0; i < num_lockstats; i++)
+    {
+        ls = &lockstats[i];
+        if (ls->ls_spin == spin && !strcmp(ls->ls_name, key))
+        {
+            spinlock_release(&lockstats_lock);
+            return ls;
+        }
+    }
+
+    if (num_lockstats == LOCKSTAT_MAX)
+    {
+        spinlock_release(&lockstats_lock);
+        return NULL;
+    }
+
+    ls = &lockstats[num_lockstats];
+    strcpy(ls->ls_name, key);
+    ls->ls_spin = spin;
+    spinlock_init(&ls->ls_lock);
+    ls->ls_acquires = 0;
+    ls->ls_contended = 0;
+    ls->ls_wait_cycles = 0;
+    ls->ls_wait_max = 0;
+    ls->ls_hold_cycles = 0;
+    ls->ls_hold_max = 0;
+    num_lockstats++;
+    spinlock_release(&lockstats_lock);
+
+    return ls;
+}
+
+void
+lockstat_acquired(struct lockstat *ls, bool contended, uint32_t waited)
+{
+    if (ls == NULL)
+    {
+        return;
+    }
+
+    /* Readings from two cpus that aren't quite in step */
+    if ((int32_t)waited < 0)
+    {
+        waited = 0;
+    }
+
+    spinlock_acquire(&ls->ls_lock);
+    ls->ls_acquires++;
+    if (contended)
+    {
+        ls->ls_contended++;
+        ls->ls_wait_cycles += waited;
+        if (waited > ls->ls_wait_max)
+        {
+            ls->ls_wait_max = waited;
+        }
+    }
+    spinlock_release(&ls->ls_lock);
+}
+
+void
+lockstat_released(struct lockstat *ls, uint32_t held)
+{
+    if (ls == NULL)
+    {
+        return;
+    }
+
+    if ((int32_t)held < 0)
+    {
+        held = 0;
+    }
+
+    spinlock_acquire(&ls->ls_lock);
+    ls->ls_hold_cycles += held;
+    if (held > ls->ls_hold_max)
+    {
+        ls->ls_hold_max = held;
+    }
+    spinlock_release(&ls->ls_lock);
+}
+
+/* The counters of one record, copied out for printing */
+struct lockstat_row
+{
+    uint64_t acquires;
+    uint64_t contended;
+    uint64_t wait_cycles;
+    uint32_t wait_max;
+    uint64_t hold_cycles;
+    uint32_t hold_max;
+};
+
+void
+lockstat_print(unsigned topn)
+{
+    struct lockstat *sorted[LOCKSTAT_MAX];
+    struct lockstat *ls;
+    struct lockstat_row row;
+    unsigned i, j, n;
+
+    spinlock_acquire(&lockstats_lock);
+    n = num_lockstats;
+    spinlock_release(&lockstats_lock);
+
+    /* Insertion sort by total wait, most first. */
+    for (i = 0; i < n; i++)
+    {
+        ls = &lockstats[i];
+        for (j = i; j > 0 && sorted[j - 1]->ls_wait_cycles < ls->ls_wait_cycles; j--)
+        {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = ls;
+    }
+
+    if (topn == 0 || topn > n)
+    {
+        topn = n;
+    }
+
+    kprintf("%-24s %5s %10s %10s %12s %10s %12s %10s\n",
+        "lock", "type", "acquires", "contended", "wait_cyc", "wait_max",
+        "hold_cyc", "hold_max");
+    for (i = 0; i < topn; i++)
+    {
+        ls = sorted[i];
+
+        /*
+         * Every acquisition of the lock being counted takes ls_lock, and
+         * kprintf is slow with a spinlock held, so copy the row out first.
+         */
+        spinlock_acquire(&ls->ls_lock);
+        row.acquires = ls->ls_acquires;
+        row.contended = ls->ls_contended;
+        row.wait_cycles = ls->ls_wait_cycles;
+        row.wait_max = ls->ls_wait_max;
+        row.hold_cycles = ls->ls_hold_cycles;
+        row.hold_max = ls->ls_hold_max;
+        spinlock_release(&ls->ls_lock);
+
+        kprintf("%-24s %5s %10llu %10llu %12llu %10u %12llu %10u\n",
+            ls->ls_name, ls->ls_spin ? "spin" : "sleep",
+            (unsigned long long)row.acquires,
+            (unsigned long long)row.contended,
+            (unsigned long long)row.wait_cycles, row.wait_max,
+            (unsigned long long)row.hold_cycles, row.hold_max);
+    }
+}
+
+void
+lockstat_reset(void)
+{
+    struct lockstat *ls;
+    unsigned i, n;
+
+    spinlock_acquire(&lockstats_lock);
+    n = num_lockstats;
+    spinlock_release(&lockstats_lock);
+
+    for (i = 0; i < n; i++)
+    {
+        ls = &lockstats[i];
+        spinlock_acquire(&ls->ls_lock);
+        ls->ls_acquires = 0;
+        ls->ls_contended = 0;
+        ls->ls_wait_cycles = 0;
+        ls->ls_wait_max = 0;
+        ls->ls_hold_cycles = 0;
+        ls->ls_hold_max = 0;
+        spinlock_release(&ls->ls_lock);
+    }
+}
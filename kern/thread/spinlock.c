@@ -38,11 +38,22 @@
 #include <spinlock.h>
 #include <membar.h>
 #include <current.h>	/* for curcpu */
+#include <lockstat.h>
 
 /*
  * Spinlocks.
  */
 
+/*
+ * Backoff, in iterations of an empty loop. A test-and-set lock waits
+ * SPINLOCK_BACKOFF_MIN after losing the race for the lock the first
+ * time, doubling every time it loses again up to SPINLOCK_BACKOFF_MAX.
+ * A ticket lock waits SPINLOCK_TICKET_BACKOFF for each holder ahead of
+ * it between looks at the lock, again up to SPINLOCK_BACKOFF_MAX.
+ */
+#define SPINLOCK_BACKOFF_MIN	4
+#define SPINLOCK_BACKOFF_MAX	256
+#define SPINLOCK_TICKET_BACKOFF	16
 
 /*
  * Initialize spinlock.
@@ -51,7 +62,40 @@ void
 spinlock_init(struct spinlock *splk)
 {
 	spinlock_data_set(&splk->splk_lock, 0);
+	spinlock_data_set(&splk->splk_next, 0);
 	splk->splk_holder = NULL;
+	splk->splk_ticket = false;
+#if OPT_LOCKSTAT
+	splk->splk_name = NULL;
+	splk->splk_stat = NULL;
+	splk->splk_acquired_at = 0;
+#endif
+}
+
+/*
+ * Initialize a ticket spinlock.
+ */
+void
+spinlock_init_ticket(struct spinlock *splk)
+{
+	spinlock_init(splk);
+	splk->splk_ticket = true;
+}
+
+/*
+ * Name spinlock, for lock statistics. The lockstat record is looked
+ * up the next time the lock is acquired.
+ */
+void
+spinlock_setname(struct spinlock *splk, const char *name)
+{
+#if OPT_LOCKSTAT
+	splk->splk_name = name;
+	splk->splk_stat = NULL;
+#else
+	(void)splk;
+	(void)name;
+#endif
 }
 
 /*
@@ -61,7 +105,91 @@ void
 spinlock_cleanup(struct spinlock *splk)
 {
 	KASSERT(splk->splk_holder == NULL);
-	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+	if (splk->splk_ticket) {
+		KASSERT(spinlock_data_get(&splk->splk_lock) ==
+			spinlock_data_get(&splk->splk_next));
+	}
+	else {
+		KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+	}
+}
+
+/*
+ * Wait a little while, without touching the lock.
+ */
+static
+void
+spinlock_backoff(unsigned n)
+{
+	volatile unsigned i;
+
+	if (n > SPINLOCK_BACKOFF_MAX) {
+		n = SPINLOCK_BACKOFF_MAX;
+	}
+	for (i=0; i<n; i++) {
+		/* nothing */
+	}
+}
+
+/*
+ * Wait for and take a test-and-set lock. Returns true if the lock
+ * wasn't free right away.
+ */
+static
+bool
+spinlock_wait_tas(struct spinlock *splk)
+{
+	unsigned delay = SPINLOCK_BACKOFF_MIN;
+	bool contended = false;
+
+	while (1) {
+		/*
+		 * Do test-test-and-set, that is, read first before
+		 * doing test-and-set, to reduce bus contention.
+		 *
+		 * Test-and-set is a machine-level atomic operation
+		 * that writes 1 into the lock word and returns the
+		 * previous value. If that value was 0, the lock was
+		 * previously unheld and we now own it. If it was 1,
+		 * we don't.
+		 */
+		if (spinlock_data_get(&splk->splk_lock) != 0) {
+			contended = true;
+			continue;
+		}
+		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
+			/*
+			 * Somebody else got there first. Back off, so
+			 * the cpus that lost don't all pounce together
+			 * again at the next release.
+			 */
+			contended = true;
+			spinlock_backoff(delay);
+			if (delay < SPINLOCK_BACKOFF_MAX) {
+				delay *= 2;
+			}
+			continue;
+		}
+		return contended;
+	}
+}
+
+/*
+ * Wait for and take a ticket lock. Returns true if we had to wait.
+ */
+static
+bool
+spinlock_wait_ticket(struct spinlock *splk)
+{
+	spinlock_data_t mine, serving;
+	bool contended = false;
+
+	mine = spinlock_data_fetchadd(&splk->splk_next, 1);
+	while ((serving = spinlock_data_get(&splk->splk_lock)) != mine) {
+		contended = true;
+		spinlock_backoff((mine - serving) * SPINLOCK_TICKET_BACKOFF);
+	}
+	return contended;
 }
 
 /*
@@ -75,6 +203,10 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	bool contended;
+#if OPT_LOCKSTAT
+	uint32_t start = 0;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -90,28 +222,34 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
-	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&splk->splk_lock) != 0) {
-			continue;
+#if OPT_LOCKSTAT
+	if (splk->splk_name != NULL) {
+		if (splk->splk_stat == NULL) {
+			splk->splk_stat = lockstat_get(splk->splk_name, true);
 		}
-		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
-			continue;
-		}
-		break;
+		start = cpu_cycles();
+	}
+#endif
+
+	if (splk->splk_ticket) {
+		contended = spinlock_wait_ticket(splk);
+	}
+	else {
+		contended = spinlock_wait_tas(splk);
 	}
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
+
+#if OPT_LOCKSTAT
+	if (splk->splk_stat != NULL) {
+		lockstat_acquired(splk->splk_stat, contended,
+				  cpu_cycles() - start);
+		splk->splk_acquired_at = cpu_cycles();
+	}
+#else
+	(void)contended;
+#endif
 }
 
 /*
@@ -127,9 +265,23 @@ spinlock_release(struct spinlock *splk)
 		curcpu->c_spinlocks--;
 	}
 
+#if OPT_LOCKSTAT
+	if (splk->splk_stat != NULL) {
+		lockstat_released(splk->splk_stat,
+				  cpu_cycles() - splk->splk_acquired_at);
+	}
+#endif
+
 	splk->splk_holder = NULL;
 	membar_any_store();
-	spinlock_data_set(&splk->splk_lock, 0);
+	if (splk->splk_ticket) {
+		/* Only the holder changes now-serving; pass it on. */
+		spinlock_data_set(&splk->splk_lock,
+				  spinlock_data_get(&splk->splk_lock) + 1);
+	}
+	else {
+		spinlock_data_set(&splk->splk_lock, 0);
+	}
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
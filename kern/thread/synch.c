@@ -33,12 +33,17 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
+#include <cpu.h>
 #include <current.h>
 #include <synch.h>
+#include <kmem_cache.h>
+#include <kmalloc_tag.h>
+#include <lockstat.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -49,21 +54,21 @@ sem_create(const char *name, unsigned initial_count)
 {
         struct semaphore *sem;
 
-        sem = kmalloc(sizeof(struct semaphore));
+        sem = kmalloc_tagged(sizeof(struct semaphore), KMT_THREAD);
         if (sem == NULL) {
                 return NULL;
         }
 
         sem->sem_name = kstrdup(name);
         if (sem->sem_name == NULL) {
-                kfree(sem);
+                kfree_tagged(sem, KMT_THREAD);
                 return NULL;
         }
 
 	sem->sem_wchan = wchan_create(sem->sem_name);
 	if (sem->sem_wchan == NULL) {
 		kfree(sem->sem_name);
-		kfree(sem);
+		kfree_tagged(sem, KMT_THREAD);
 		return NULL;
 	}
 
@@ -82,7 +87,7 @@ sem_destroy(struct semaphore *sem)
 	spinlock_cleanup(&sem->sem_lock);
 	wchan_destroy(sem->sem_wchan);
         kfree(sem->sem_name);
-        kfree(sem);
+        kfree_tagged(sem, KMT_THREAD);
 }
 
 void
@@ -138,6 +143,53 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+/*
+ * Locks are created and destroyed all the time (every process and
+ * every open file has some), so they are recycled through an object
+ * cache. A cached lock keeps its wait channel and spinlock; only the
+ * name has to be set up on each lock_create.
+ */
+static int lock_ctor(void *obj);
+static void lock_dtor(void *obj);
+
+static struct kmem_cache lock_cache =
+        KMEM_CACHE_INITIALIZER("lock", struct lock, KMT_THREAD,
+                               lock_ctor, lock_dtor);
+
+static
+int
+lock_ctor(void *obj)
+{
+        struct lock *lock = obj;
+
+        lock->lk_name = NULL;
+        lock->lk_holder = NULL;
+
+        lock->lk_wchan = wchan_create("lock");
+        if (lock->lk_wchan == NULL) {
+                return ENOMEM;
+        }
+
+        spinlock_init(&lock->lk_spinlock);
+        lock->lk_lock = 0;
+#if OPT_LOCKSTAT
+        lock->lk_stat = NULL;
+        lock->lk_acquired_at = 0;
+#endif
+
+        return 0;
+}
+
+static
+void
+lock_dtor(void *obj)
+{
+        struct lock *lock = obj;
+
+        spinlock_cleanup(&lock->lk_spinlock);
+        wchan_destroy(lock->lk_wchan);
+}
+
 struct lock *
 lock_create(const char *name)
 {
@@ -145,36 +197,24 @@ lock_create(const char *name)
 
         struct lock *lock;
 
-        lock = kmalloc(sizeof(struct lock));
+        lock = kmem_cache_alloc(&lock_cache);
         if (lock == NULL) {
                 return NULL;
         }
 
         lock->lk_name = kstrdup(name);
         if (lock->lk_name == NULL) {
-                kfree(lock);
+                kmem_cache_free(&lock_cache, lock);
                 return NULL;
         }
 
-        lock->lk_holder = NULL;
+        wchan_setname(lock->lk_wchan, lock->lk_name);
+#if OPT_LOCKSTAT
+        lock->lk_stat = lockstat_get(lock->lk_name, false);
+#endif
 
-	lock->lk_wchan = wchan_create(lock->lk_name);
-	if (lock->lk_wchan == NULL) {
-		kfree(lock->lk_name);
-		kfree(lock);
-		return NULL;
-	}
-
-	spinlock_init(&lock->lk_spinlock);
-
-        if (&lock->lk_spinlock == NULL) { 
-                wchan_destroy(lock->lk_wchan);
-                kfree(lock->lk_name);
-                kfree(lock);
-                return NULL;
-        }
-
-        lock->lk_lock = 0;
+        KASSERT(lock->lk_holder == NULL);
+        KASSERT(lock->lk_lock == 0);
 
         return lock;
 }
@@ -183,29 +223,84 @@ void
 lock_destroy(struct lock *lock)
 {
         KASSERT(lock);
+        KASSERT(lock->lk_holder == NULL);
+        KASSERT(lock->lk_lock == 0);
 
-	if (&lock->lk_spinlock) spinlock_cleanup(&lock->lk_spinlock);
-	if (lock->lk_wchan) wchan_destroy(lock->lk_wchan);
-        if (lock->lk_name) kfree(lock->lk_name);
-        if (lock) kfree(lock);
+        /* the name is going away, so the wchan can't keep pointing at it */
+        wchan_setname(lock->lk_wchan, "lock");
+        kfree(lock->lk_name);
+        lock->lk_name = NULL;
 
-        // this breaks because VM isn't initialized yet
-        // KASSERT(lock == NULL);
+        kmem_cache_free(&lock_cache, lock);
+}
+
+/*
+ * How many times lock_acquire polls a lock whose holder is running on
+ * another cpu before giving up and going to sleep. A context switch
+ * away and back costs a few thousand cycles, and a poll is a handful,
+ * so this covers critical sections of up to about that length.
+ */
+#define LOCK_SPIN_MAX 1000
+
+/*
+ * True if OWNER is running on some other cpu right now. This is read
+ * without any lock held, so it is only a hint; and OWNER might even
+ * have released the lock and exited, but thread structures are kernel
+ * memory, so looking at a stale one is harmless.
+ */
+static
+bool
+lock_owner_running(const volatile struct thread *owner)
+{
+        return owner != NULL && owner->t_state == S_RUN &&
+                owner->t_cpu != curcpu->c_self;
 }
 
 void
 lock_acquire(struct lock *lock)
 {
+        struct thread *owner;
+        unsigned spins;
+#if OPT_LOCKSTAT
+        uint32_t start = cpu_cycles();
+        bool contended;
+#endif
+
         KASSERT(lock);
         KASSERT(lock->lk_holder != curthread);
 
         spinlock_acquire(&lock->lk_spinlock);
+#if OPT_LOCKSTAT
+        contended = lock->lk_lock == 1;
+#endif
 
+        spins = 0;
         while (lock->lk_lock == 1) {
                 /**
-                 * If the lock is held by another thread, sleep on lock's wait channel.
+                 * If the holder is running on another cpu, it will
+                 * probably let go in a few instructions, and waiting
+                 * for it here is cheaper than sleeping. Poll without
+                 * the spinlock (the holder needs it to release) until
+                 * the lock is free, the holder stops running, or we
+                 * have spun long enough; then look again.
+                */
+                owner = lock->lk_holder;
+                if (spins < LOCK_SPIN_MAX && lock_owner_running(owner)) {
+                        spinlock_release(&lock->lk_spinlock);
+                        while (lock->lk_lock == 1 && spins < LOCK_SPIN_MAX &&
+                               lock_owner_running(owner)) {
+                                spins++;
+                        }
+                        spinlock_acquire(&lock->lk_spinlock);
+                        continue;
+                }
+
+                /**
+                 * Otherwise sleep on lock's wait channel. Whoever holds
+                 * it when we wake up may be worth spinning on again.
                 */
                 wchan_sleep(lock->lk_wchan, &lock->lk_spinlock);
+                spins = 0;
         }
         /** 
          * Lock is now free
@@ -218,6 +313,10 @@ lock_acquire(struct lock *lock)
         */
         lock->lk_lock = 1; 
         lock->lk_holder = curthread; // can we just use the address in lock_do_i_hold? Probably better since we don't know if non-duplicating thread names are enforced.
+#if OPT_LOCKSTAT
+        lockstat_acquired(lock->lk_stat, contended, cpu_cycles() - start);
+        lock->lk_acquired_at = cpu_cycles();
+#endif
 
         KASSERT(lock->lk_holder == curthread);
 
@@ -240,6 +339,9 @@ lock_release(struct lock *lock)
         KASSERT(lock->lk_lock == 1);
         KASSERT(lock->lk_holder == curthread);
 
+#if OPT_LOCKSTAT
+        lockstat_released(lock->lk_stat, cpu_cycles() - lock->lk_acquired_at);
+#endif
         lock->lk_lock = 0; 
         lock->lk_holder = NULL;
 
@@ -265,21 +367,21 @@ cv_create(const char *name)
 {
         struct cv *cv;
 
-        cv = kmalloc(sizeof(struct cv));
+        cv = kmalloc_tagged(sizeof(struct cv), KMT_THREAD);
         if (cv == NULL) {
                 return NULL;
         }
 
         cv->cv_name = kstrdup(name);
         if (cv->cv_name==NULL) {
-                kfree(cv);
+                kfree_tagged(cv, KMT_THREAD);
                 return NULL;
         }
 
         cv->cv_wchan = wchan_create(cv->cv_name);
         if (cv->cv_wchan == NULL) {
                 kfree(cv->cv_name);
-                kfree(cv);
+                kfree_tagged(cv, KMT_THREAD);
                 return NULL;
         }
 
@@ -288,7 +390,7 @@ cv_create(const char *name)
         if (&cv->cv_spinlock == NULL) {
                 wchan_destroy(cv->cv_wchan);
                 kfree(cv->cv_name);
-                kfree(cv);
+                kfree_tagged(cv, KMT_THREAD);
                 return NULL;
         }
 
@@ -308,7 +410,7 @@ cv_destroy(struct cv *cv)
         if (&cv->cv_spinlock) spinlock_cleanup(&cv->cv_spinlock);
         if (cv->cv_wchan) wchan_destroy(cv->cv_wchan);
         if (cv->cv_name) kfree(cv->cv_name);
-        if (cv) kfree(cv);
+        if (cv) kfree_tagged(cv, KMT_THREAD);
 }
 
 void
@@ -354,6 +456,27 @@ cv_wait(struct cv *cv, struct lock *lock)
         KASSERT(lock_do_i_hold(lock));
 }
 
+int
+cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks)
+{
+        int result;
+
+        KASSERT(cv != NULL);
+        KASSERT(lock);
+        KASSERT(lock_do_i_hold(lock) == true);
+
+        /**
+         * Same as cv_wait, except that the sleep on the wchan can time out.
+        */
+        spinlock_acquire(&cv->cv_spinlock);
+        lock_release(lock);
+        result = wchan_sleep_timeout(cv->cv_wchan, &cv->cv_spinlock, ticks);
+        spinlock_release(&cv->cv_spinlock);
+
+        lock_acquire(lock);
+        return result;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
@@ -395,3 +518,200 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 
         spinlock_release(&cv->cv_spinlock);
 }
+
+////////////////////////////////////////////////////////////
+//
+// RW lock.
+
+struct rwlock *
+rw_create(const char *name)
+{
+        struct rwlock *rw;
+
+        KASSERT(name != NULL);
+
+        rw = kmalloc_tagged(sizeof(struct rwlock), KMT_THREAD);
+        if (rw == NULL) {
+                return NULL;
+        }
+
+        rw->rw_name = kstrdup(name);
+        if (rw->rw_name == NULL) {
+                kfree_tagged(rw, KMT_THREAD);
+                return NULL;
+        }
+
+        rw->rw_rwchan = wchan_create(rw->rw_name);
+        if (rw->rw_rwchan == NULL) {
+                kfree(rw->rw_name);
+                kfree_tagged(rw, KMT_THREAD);
+                return NULL;
+        }
+
+        rw->rw_wwchan = wchan_create(rw->rw_name);
+        if (rw->rw_wwchan == NULL) {
+                wchan_destroy(rw->rw_rwchan);
+                kfree(rw->rw_name);
+                kfree_tagged(rw, KMT_THREAD);
+                return NULL;
+        }
+
+        spinlock_init(&rw->rw_spinlock);
+        rw->rw_readers = 0;
+        rw->rw_wwaiting = 0;
+        rw->rw_writer = NULL;
+#if OPT_LOCKSTAT
+        rw->rw_stat = lockstat_get(rw->rw_name, false);
+#endif
+
+        return rw;
+}
+
+void
+rw_destroy(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(rw->rw_readers == 0);
+        KASSERT(rw->rw_wwaiting == 0);
+        KASSERT(rw->rw_writer == NULL);
+
+        spinlock_cleanup(&rw->rw_spinlock);
+        wchan_destroy(rw->rw_wwchan);
+        wchan_destroy(rw->rw_rwchan);
+        kfree(rw->rw_name);
+        kfree_tagged(rw, KMT_THREAD);
+}
+
+/*
+ * For lockstat, each read or write acquisition is counted. The hold
+ * time is how long the lock was taken at all: from the writer getting
+ * it, or the first reader of a group, until the writer or the last
+ * reader lets go.
+ */
+
+void
+rw_rlock(struct rwlock *rw)
+{
+#if OPT_LOCKSTAT
+        uint32_t start = cpu_cycles();
+        bool contended;
+#endif
+
+        KASSERT(rw != NULL);
+        KASSERT(rw->rw_writer != curthread);
+
+        spinlock_acquire(&rw->rw_spinlock);
+#if OPT_LOCKSTAT
+        contended = rw->rw_writer != NULL || rw->rw_wwaiting > 0;
+#endif
+
+        /**
+         * Wait out the writer, and also any writer that is waiting,
+         * so that writers don't starve.
+        */
+        while (rw->rw_writer != NULL || rw->rw_wwaiting > 0) {
+                wchan_sleep(rw->rw_rwchan, &rw->rw_spinlock);
+        }
+        rw->rw_readers++;
+#if OPT_LOCKSTAT
+        lockstat_acquired(rw->rw_stat, contended, cpu_cycles() - start);
+        if (rw->rw_readers == 1) {
+                rw->rw_acquired_at = cpu_cycles();
+        }
+#endif
+
+        spinlock_release(&rw->rw_spinlock);
+}
+
+void
+rw_runlock(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_spinlock);
+
+        KASSERT(rw->rw_readers > 0);
+        KASSERT(rw->rw_writer == NULL);
+        rw->rw_readers--;
+#if OPT_LOCKSTAT
+        if (rw->rw_readers == 0) {
+                lockstat_released(rw->rw_stat,
+                                  cpu_cycles() - rw->rw_acquired_at);
+        }
+#endif
+
+        /**
+         * The last reader out lets a writer in. Readers can only be
+         * waiting if a writer is too, and then it goes first.
+        */
+        if (rw->rw_readers == 0 && rw->rw_wwaiting > 0) {
+                wchan_wakeone(rw->rw_wwchan, &rw->rw_spinlock);
+        }
+
+        spinlock_release(&rw->rw_spinlock);
+}
+
+void
+rw_wlock(struct rwlock *rw)
+{
+#if OPT_LOCKSTAT
+        uint32_t start = cpu_cycles();
+        bool contended;
+#endif
+
+        KASSERT(rw != NULL);
+        KASSERT(rw->rw_writer != curthread);
+
+        spinlock_acquire(&rw->rw_spinlock);
+#if OPT_LOCKSTAT
+        contended = rw->rw_writer != NULL || rw->rw_readers > 0;
+#endif
+
+        rw->rw_wwaiting++;
+        while (rw->rw_writer != NULL || rw->rw_readers > 0) {
+                wchan_sleep(rw->rw_wwchan, &rw->rw_spinlock);
+        }
+        rw->rw_wwaiting--;
+        rw->rw_writer = curthread;
+#if OPT_LOCKSTAT
+        lockstat_acquired(rw->rw_stat, contended, cpu_cycles() - start);
+        rw->rw_acquired_at = cpu_cycles();
+#endif
+
+        spinlock_release(&rw->rw_spinlock);
+}
+
+void
+rw_wunlock(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_spinlock);
+
+        KASSERT(rw->rw_writer == curthread);
+        KASSERT(rw->rw_readers == 0);
+#if OPT_LOCKSTAT
+        lockstat_released(rw->rw_stat, cpu_cycles() - rw->rw_acquired_at);
+#endif
+        rw->rw_writer = NULL;
+
+        /**
+         * Hand over to the next writer if there is one; the readers
+         * would only go back to sleep. Otherwise let all readers in.
+        */
+        if (rw->rw_wwaiting > 0) {
+                wchan_wakeone(rw->rw_wwchan, &rw->rw_spinlock);
+        }
+        else {
+                wchan_wakeall(rw->rw_rwchan, &rw->rw_spinlock);
+        }
+
+        spinlock_release(&rw->rw_spinlock);
+}
+
+bool
+rw_wlock_do_i_hold(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        return rw->rw_writer == curthread;
+}
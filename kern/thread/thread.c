@@ -50,6 +50,8 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <kmalloc_tag.h>
+#include <timer.h>
 
 #include "opt-synchprobs.h"
 
@@ -118,44 +120,93 @@ thread_checkstack(struct thread *thread)
 }
 
 /*
- * Create a thread. This is used both to create a first thread
- * for each CPU and to create subsequent forked threads.
+ * Set a thread's name. Short names are copied into the thread itself;
+ * only long ones need an allocation.
  */
 static
-struct thread *
-thread_create(const char *name)
+int
+thread_setname(struct thread *thread, const char *name)
 {
-	struct thread *thread;
-
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
-	if (thread == NULL) {
-		return NULL;
+	if (strlen(name) < sizeof(thread->t_namebuf)) {
+		strcpy(thread->t_namebuf, name);
+		thread->t_name = thread->t_namebuf;
+	}
+	else {
+		thread->t_name = kstrdup(name);
+		if (thread->t_name == NULL) {
+			return ENOMEM;
+		}
 	}
+	return 0;
+}
 
-	thread->t_name = kstrdup(name);
-	if (thread->t_name == NULL) {
-		kfree(thread);
-		return NULL;
+static
+void
+thread_freename(struct thread *thread)
+{
+	if (thread->t_name != NULL && thread->t_name != thread->t_namebuf) {
+		kfree(thread->t_name);
 	}
+	thread->t_name = NULL;
+}
+
+/*
+ * Initialize the fields of a thread that are reset every time it is
+ * used, whether it was just allocated or came out of the thread cache.
+ * The stack and the machine-dependent state are left alone.
+ */
+static
+void
+thread_init(struct thread *thread)
+{
 	thread->t_wchan_name = "NEW";
 	thread->t_state = S_READY;
 
 	/* Thread subsystem fields */
-	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
+	thread->t_wchan = NULL;
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
+	/* Scheduler fields; new threads start at the top level */
+	thread->t_priority = 0;
+	thread->t_ticks = 0;
+	thread->t_lastrun = 0;
+	thread->t_pinned = false;
+
 	/* If you add to struct thread, be sure to initialize here */
+}
+
+/*
+ * Create a thread. This is used both to create a first thread
+ * for each CPU and to create subsequent forked threads.
+ */
+static
+struct thread *
+thread_create(const char *name)
+{
+	struct thread *thread;
+
+	thread = kmalloc_tagged(sizeof(*thread), KMT_THREAD);
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	if (thread_setname(thread, name)) {
+		kfree_tagged(thread, KMT_THREAD);
+		return NULL;
+	}
+	thread_machdep_init(&thread->t_machdep);
+	thread->t_stack = NULL;
+	thread_init(thread);
 
 	return thread;
 }
@@ -173,9 +224,10 @@ cpu_create(unsigned hardware_number)
 {
 	struct cpu *c;
 	int result;
+	unsigned i;
 	char namebuf[16];
 
-	c = kmalloc(sizeof(*c));
+	c = kmalloc_tagged(sizeof(*c), KMT_THREAD);
 	if (c == NULL) {
 		panic("cpu_create: Out of memory\n");
 	}
@@ -185,16 +237,27 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_deadthreads);
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
+	c->c_steals = 0;
+	c->c_migrations = 0;
+	c->c_wakeups_kept = 0;
+	c->c_wakeups_moved = 0;
+	c->c_threads_reused = 0;
+	c->c_threads_created = 0;
 
 	c->c_isidle = false;
-	threadlist_init(&c->c_runqueue);
-	spinlock_init(&c->c_runqueue_lock);
+	for (i=0; i<CPU_NPRIORITIES; i++) {
+		threadlist_init(&c->c_runqueue[i]);
+	}
+	spinlock_init_ticket(&c->c_runqueue_lock);
+	spinlock_setname(&c->c_runqueue_lock, "runqueue");
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
 	spinlock_init(&c->c_ipi_lock);
+	spinlock_setname(&c->c_ipi_lock, "ipi");
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
 	if (result != 0) {
@@ -221,7 +284,7 @@ cpu_create(unsigned hardware_number)
 		/*c->c_curthread->t_stack = ... */
 	}
 	else {
-		c->c_curthread->t_stack = kmalloc(STACK_SIZE);
+		c->c_curthread->t_stack = kmalloc_tagged(STACK_SIZE, KMT_THREAD);
 		if (c->c_curthread->t_stack == NULL) {
 			panic("cpu_create: couldn't allocate stack");
 		}
@@ -257,7 +320,7 @@ thread_destroy(struct thread *thread)
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
 	if (thread->t_stack != NULL) {
-		kfree(thread->t_stack);
+		kfree_tagged(thread->t_stack, KMT_THREAD);
 	}
 	threadlistnode_cleanup(&thread->t_listnode);
 	thread_machdep_cleanup(&thread->t_machdep);
@@ -265,13 +328,95 @@ thread_destroy(struct thread *thread)
 	/* sheer paranoia */
 	thread->t_wchan_name = "DESTROYED";
 
-	kfree(thread->t_name);
-	kfree(thread);
+	thread_freename(thread);
+	kfree_tagged(thread, KMT_THREAD);
+}
+
+/*
+ * Thread cache.
+ *
+ * Forking a thread used to cost three allocations (the thread, its
+ * name, and its stack) and exiting three frees, which is most of the
+ * work in a fork-and-exit storm. Instead, exorcise keeps up to
+ * THREAD_CACHE_MAX dead threads per cpu, stack and machine-dependent
+ * state intact, and thread_fork reinitializes one of those when it
+ * can. The cache is per-cpu and only touched with interrupts off, so
+ * it needs no lock.
+ */
+#define THREAD_CACHE_MAX	8
+
+static bool thread_cache_enabled = true;
+
+void
+thread_cache_enable(bool enable)
+{
+	thread_cache_enabled = enable;
+}
+
+/*
+ * Put a zombie in this cpu's thread cache, if it will fit. Returns
+ * false if it should be destroyed instead.
+ */
+static
+bool
+thread_cache_put(struct thread *z)
+{
+	KASSERT(curthread->t_curspl > 0);
+
+	if (!thread_cache_enabled || z->t_stack == NULL ||
+	    curcpu->c_deadthreads.tl_count >= THREAD_CACHE_MAX) {
+		return false;
+	}
+	KASSERT(z->t_proc == NULL);
+	thread_checkstack(z);
+	thread_freename(z);
+	z->t_wchan_name = "CACHED";
+	threadlist_addtail(&curcpu->c_deadthreads, z);
+	return true;
+}
+
+/*
+ * Get a thread from this cpu's thread cache and set it up as a new
+ * thread named NAME, with its stack already allocated. Returns NULL
+ * if the cache is empty.
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *t;
+	int spl;
+
+	spl = splhigh();
+	t = NULL;
+	if (thread_cache_enabled) {
+		t = threadlist_remhead(&curcpu->c_deadthreads);
+	}
+	if (t != NULL) {
+		curcpu->c_threads_reused++;
+	}
+	else {
+		curcpu->c_threads_created++;
+	}
+	splx(spl);
+
+	if (t == NULL) {
+		return NULL;
+	}
+
+	KASSERT(t->t_state == S_ZOMBIE);
+	if (thread_setname(t, name)) {
+		thread_destroy(t);
+		return NULL;
+	}
+	thread_init(t);
+	return t;
 }
 
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
- * need to have thread_destroy called on them.)
+ * need to have thread_destroy called on them.) Up to THREAD_CACHE_MAX
+ * of them are kept for reuse instead.
  *
  * The list of zombies is per-cpu.
  */
@@ -284,7 +429,9 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		if (!thread_cache_put(z)) {
+			thread_destroy(z);
+		}
 	}
 }
 
@@ -296,6 +443,9 @@ exorcise(void)
 void
 thread_panic(void)
 {
+	struct threadlist *tl;
+	unsigned i;
+
 	/*
 	 * Kill off other CPUs.
 	 *
@@ -310,9 +460,12 @@ thread_panic(void)
 	 * to.  Instead, blat the list structure by hand, and take the
 	 * risk that it might not be quite atomic.
 	 */
-	curcpu->c_runqueue.tl_count = 0;
-	curcpu->c_runqueue.tl_head.tln_next = &curcpu->c_runqueue.tl_tail;
-	curcpu->c_runqueue.tl_tail.tln_prev = &curcpu->c_runqueue.tl_head;
+	for (i=0; i<CPU_NPRIORITIES; i++) {
+		tl = &curcpu->c_runqueue[i];
+		tl->tl_count = 0;
+		tl->tl_head.tln_next = &tl->tl_tail;
+		tl->tl_tail.tln_prev = &tl->tl_head;
+	}
 
 	/*
 	 * Ideally, we want to make sure sleeping threads don't wake
@@ -443,6 +596,99 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Return the number of cpus in the system. Once thread_start_cpus has
+ * run this doesn't change, so no locking is needed.
+ */
+unsigned
+thread_numcpus(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+/*
+ * Run queue helpers. Each cpu has one run queue per priority level;
+ * a ready thread sits on the queue for its t_priority. All of these
+ * must be called with the cpu's run queue lock held.
+ */
+
+/* Total number of ready threads on C. */
+static
+unsigned
+runqueue_count(struct cpu *c)
+{
+	unsigned i, count;
+
+	count = 0;
+	for (i=0; i<CPU_NPRIORITIES; i++) {
+		count += c->c_runqueue[i].tl_count;
+	}
+	return count;
+}
+
+/* True if C has a ready thread at priority level MAXLEVEL or better. */
+static
+bool
+runqueue_has_ready(struct cpu *c, unsigned maxlevel)
+{
+	unsigned i;
+
+	for (i=0; i<=maxlevel && i<CPU_NPRIORITIES; i++) {
+		if (!threadlist_isempty(&c->c_runqueue[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Queue T at the back of its level on C. */
+static
+void
+runqueue_addtail(struct cpu *c, struct thread *t)
+{
+	KASSERT(t->t_priority < CPU_NPRIORITIES);
+	threadlist_addtail(&c->c_runqueue[t->t_priority], t);
+}
+
+/* Take the next thread to run: the head of the highest nonempty level. */
+static
+struct thread *
+runqueue_remhead(struct cpu *c)
+{
+	unsigned i;
+
+	for (i=0; i<CPU_NPRIORITIES; i++) {
+		if (!threadlist_isempty(&c->c_runqueue[i])) {
+			return threadlist_remhead(&c->c_runqueue[i]);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Take the thread that would run last: the tail of the lowest
+ * nonempty level. Used to pick threads to migrate, which thus
+ * tend to be the CPU-bound ones. Pinned threads are passed over,
+ * since they must not move.
+ */
+static
+struct thread *
+runqueue_remtail(struct cpu *c)
+{
+	struct thread *t;
+	unsigned i;
+
+	for (i=CPU_NPRIORITIES; i-- > 0; ) {
+		THREADLIST_FORALL_REV(t, c->c_runqueue[i]) {
+			if (!t->t_pinned) {
+				threadlist_remove(&c->c_runqueue[i], t);
+				return t;
+			}
+		}
+	}
+	return NULL;
+}
+
 /*
  * Make a thread runnable.
  *
@@ -467,7 +713,7 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	runqueue_addtail(targetcpu, target);
 
 	if (targetcpu->c_isidle) {
 		/*
@@ -482,6 +728,80 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 }
 
+/*
+ * Work stealing.
+ *
+ * Called from the idle loop in thread_switch, with our own run queue
+ * unlocked, when there is nothing to run. Find the cpu with the most
+ * ready threads and take the one at the tail of its lowest level,
+ * which is the one it would have run last anyway.
+ *
+ * Only steal from a cpu with at least STEAL_MIN_READY ready threads,
+ * so that it still has something to do afterwards; otherwise a thread
+ * would just bounce back and forth between two half-idle cpus.
+ *
+ * Returns the stolen thread, now assigned to this cpu but not yet on
+ * its run queue, or NULL if there was nothing worth taking.
+ */
+#define STEAL_MIN_READY		2
+
+static
+struct thread *
+thread_steal(void)
+{
+	struct cpu *c, *victim;
+	struct thread *t;
+	unsigned i, numcpus, count, maxcount;
+
+	victim = NULL;
+	maxcount = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == curcpu->c_self) {
+			continue;
+		}
+		spinlock_acquire(&c->c_runqueue_lock);
+		count = runqueue_count(c);
+		spinlock_release(&c->c_runqueue_lock);
+		if (count >= STEAL_MIN_READY && count > maxcount) {
+			victim = c;
+			maxcount = count;
+		}
+	}
+	if (victim == NULL) {
+		return NULL;
+	}
+
+	/* The count may have changed since we looked; check again. */
+	spinlock_acquire(&victim->c_runqueue_lock);
+	t = NULL;
+	if (runqueue_count(victim) >= STEAL_MIN_READY) {
+		t = runqueue_remtail(victim);
+		/*
+		 * As in thread_consider_migration, the victim's
+		 * curthread can be on its run queue while it is
+		 * unidling; never take that one. Pinned threads
+		 * aren't offered, so there may be nothing.
+		 */
+		if (t != NULL && t == victim->c_curthread) {
+			runqueue_addtail(victim, t);
+			t = NULL;
+		}
+		if (t != NULL) {
+			t->t_cpu = curcpu->c_self;
+		}
+	}
+	spinlock_release(&victim->c_runqueue_lock);
+
+	if (t != NULL) {
+		curcpu->c_steals++;
+		DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u",
+		      t->t_name, victim->c_number, curcpu->c_number);
+	}
+	return t;
+}
+
 /*
  * Create a new thread based on an existing one.
  *
@@ -489,37 +809,44 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
  * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
  *
  * The new thread is created in the process P. If P is null, the
- * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * process is inherited from the caller. It starts on cpu CPU, and
+ * stays there if PINNED.
  */
+static
 int
-thread_fork(const char *name,
-	    struct proc *proc,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2)
+thread_fork_common(const char *name,
+		   struct proc *proc,
+		   struct cpu *cpu, bool pinned,
+		   void (*entrypoint)(void *data1, unsigned long data2),
+		   void *data1, unsigned long data2)
 {
 	struct thread *newthread;
 	int result;
 
-	newthread = thread_create(name);
+	/* Reuse a dead thread and its stack if we have one */
+	newthread = thread_cache_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc_tagged(STACK_SIZE, KMT_THREAD);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
 	 */
 
 	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_cpu = cpu;
+	newthread->t_pinned = pinned;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -542,12 +869,38 @@ thread_fork(const char *name,
 	/* Set up the switchframe so entrypoint() gets called */
 	switchframe_init(newthread, entrypoint, data1, data2);
 
-	/* Lock the current cpu's run queue and make the new thread runnable */
+	/* Lock its cpu's run queue and make the new thread runnable */
 	thread_make_runnable(newthread, false);
 
 	return 0;
 }
 
+/*
+ * The new thread starts on the same CPU as the caller, unless the
+ * scheduler intervenes first.
+ */
+int
+thread_fork(const char *name,
+	    struct proc *proc,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2)
+{
+	return thread_fork_common(name, proc, curthread->t_cpu, false,
+				  entrypoint, data1, data2);
+}
+
+int
+thread_fork_on(const char *name,
+	       struct proc *proc,
+	       unsigned cpunum,
+	       void (*entrypoint)(void *data1, unsigned long data2),
+	       void *data1, unsigned long data2)
+{
+	KASSERT(cpunum < cpuarray_num(&allcpus));
+	return thread_fork_common(name, proc, cpuarray_get(&allcpus, cpunum),
+				  true, entrypoint, data1, data2);
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -562,7 +915,7 @@ static
 void
 thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 {
-	struct thread *cur, *next;
+	struct thread *cur, *next, *stolen;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -588,8 +941,13 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	/*
+	 * Micro-optimization: if nothing to do, just return. That is
+	 * also the case if everything waiting is at a lower priority
+	 * than us, since we'd be picked again straight away.
+	 */
+	if (newstate == S_READY &&
+	    !runqueue_has_ready(curcpu->c_self, cur->t_priority)) {
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
@@ -613,6 +971,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		 * on the list.
 		 */
 		threadlist_addtail(&wc->wc_threads, cur);
+		cur->t_wchan = wc;
 		spinlock_release(lk);
 		break;
 	    case S_ZOMBIE:
@@ -642,11 +1001,17 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
 	do {
-		next = threadlist_remhead(&curcpu->c_runqueue);
+		next = runqueue_remhead(curcpu->c_self);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			stolen = thread_steal();
+			if (stolen == NULL) {
+				cpu_idle();
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
+			if (stolen != NULL) {
+				runqueue_addtail(curcpu->c_self, stolen);
+			}
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
@@ -658,6 +1023,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	 * assume the compiler will optimize one away if they're the
 	 * same.
 	 */
+	cur->t_lastrun = curcpu->c_hardclocks;
 	curcpu->c_curthread = next;
 	curthread = next;
 
@@ -830,17 +1196,173 @@ thread_yield(void)
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * This is a multilevel feedback queue. Each cpu has CPU_NPRIORITIES
+ * run queues and always runs the highest-priority ready thread;
+ * threads at the same level share the cpu round-robin.
+ *
+ *   - New threads start at level 0, the highest.
+ *   - A thread that uses up the quantum of its level without giving
+ *     up the cpu is demoted one level (thread_tick). Quanta double
+ *     at each level, so CPU-bound threads sink and run for longer
+ *     stretches, less often.
+ *   - A thread woken from wchan_sleep is promoted one level
+ *     (thread_wakeup_boost), so interactive and I/O-bound threads
+ *     stay near the top.
+ *   - Every SCHED_AGING_HARDCLOCKS, schedule() moves every waiting
+ *     thread up one level, so nothing starves behind a stream of
+ *     higher-priority work.
+ */
+
+/* Quantum, in hardclocks, at priority level 0; doubled at each level. */
+#define SCHED_QUANTUM_BASE	1
+
+/*
+ * Age waiting threads every this many hardclocks (1 sec). schedule()
+ * only runs every SCHEDULE_HARDCLOCKS, so this must be a multiple of it.
  */
+#define SCHED_AGING_HARDCLOCKS	100
+
+static
+unsigned
+sched_quantum(unsigned level)
+{
+	return SCHED_QUANTUM_BASE << level;
+}
+
+/*
+ * Promote a thread that is being woken up. The caller holds the
+ * thread off-cpu (it has just been taken off a wchan).
+ */
+static
+void
+thread_wakeup_boost(struct thread *target)
+{
+	if (target->t_priority > 0) {
+		target->t_priority--;
+		target->t_ticks = 0;
+	}
+}
 
+/*
+ * This is called periodically from hardclock(). It ages the current
+ * CPU's run queues: every SCHED_AGING_HARDCLOCKS, each waiting thread
+ * moves up one level.
+ */
 void
 schedule(void)
 {
+	struct cpu *c = curcpu->c_self;
+	struct thread *t;
+	unsigned i;
+
+	if ((c->c_hardclocks % SCHED_AGING_HARDCLOCKS) != 0) {
+		return;
+	}
+
+	spinlock_acquire(&c->c_runqueue_lock);
 	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
+	 * Go top down, so each thread moves exactly once: by the time
+	 * level i is emptied into level i-1, level i-1 is finished.
 	 */
+	for (i=1; i<CPU_NPRIORITIES; i++) {
+		while ((t = threadlist_remhead(&c->c_runqueue[i])) != NULL) {
+			t->t_priority = i - 1;
+			t->t_ticks = 0;
+			threadlist_addtail(&c->c_runqueue[i - 1], t);
+		}
+	}
+	spinlock_release(&c->c_runqueue_lock);
+}
+
+/*
+ * Timer tick for the current thread, called from hardclock().
+ *
+ * Charge the tick to the thread. If that uses up its quantum, demote
+ * it (unless it is already at the bottom) and yield; otherwise, yield
+ * only if something of higher priority is waiting, so that a thread
+ * woken by an interrupt doesn't wait out a long low-level quantum.
+ */
+void
+thread_tick(void)
+{
+	struct thread *cur = curthread;
+	bool preempt;
+
+	/* The idle loop isn't charged for anything. */
+	if (curcpu->c_isidle) {
+		return;
+	}
+
+	cur->t_ticks++;
+	if (cur->t_ticks >= sched_quantum(cur->t_priority)) {
+		cur->t_ticks = 0;
+		if (cur->t_priority < CPU_NPRIORITIES - 1) {
+			cur->t_priority++;
+		}
+		preempt = true;
+	}
+	else if (cur->t_priority == 0) {
+		preempt = false;
+	}
+	else {
+		spinlock_acquire(&curcpu->c_runqueue_lock);
+		preempt = runqueue_has_ready(curcpu->c_self,
+					     cur->t_priority - 1);
+		spinlock_release(&curcpu->c_runqueue_lock);
+	}
+
+	if (preempt) {
+		thread_yield();
+	}
+}
+
+void
+thread_printstats(void)
+{
+	struct cpu *c;
+	unsigned i, j, numcpus;
+	unsigned number, hardclocks, rq[CPU_NPRIORITIES];
+	unsigned steals, migrations, kept, moved, created, reused;
+	bool idle;
+
+	kprintf("cpu  hardclocks  idle");
+	for (j=0; j<CPU_NPRIORITIES; j++) {
+		kprintf("  rq%u", j);
+	}
+	kprintf("     steals migrations  wake_kept wake_moved"
+		"  fork_new fork_reuse\n");
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+
+		/*
+		 * kprintf is slow with a spinlock held, and the cpu can't
+		 * schedule meanwhile, so copy the row out and print it after.
+		 */
+		spinlock_acquire(&c->c_runqueue_lock);
+		number = c->c_number;
+		hardclocks = c->c_hardclocks;
+		idle = c->c_isidle;
+		for (j=0; j<CPU_NPRIORITIES; j++) {
+			rq[j] = c->c_runqueue[j].tl_count;
+		}
+		steals = c->c_steals;
+		migrations = c->c_migrations;
+		kept = c->c_wakeups_kept;
+		moved = c->c_wakeups_moved;
+		created = c->c_threads_created;
+		reused = c->c_threads_reused;
+		spinlock_release(&c->c_runqueue_lock);
+
+		kprintf("%3u  %10u  %4s", number, hardclocks,
+			idle ? "yes" : "no");
+		for (j=0; j<CPU_NPRIORITIES; j++) {
+			kprintf("  %3u", rq[j]);
+		}
+		kprintf("  %9u  %9u  %9u  %9u  %8u  %9u\n",
+			steals, migrations, kept, moved, created, reused);
+	}
 }
 
 /*
@@ -856,10 +1378,14 @@ schedule(void)
  * and the performance loss due to underutilization of some CPUs is
  * something that needs to be tuned and probably is workload-specific.
  *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * Idle cpus pull work for themselves (see thread_steal), so this only
+ * has to even out load between busy cpus. To keep threads from being
+ * shuffled back and forth over a difference of one, only push when we
+ * are more than MIGRATE_SLACK threads over our share. Pinned threads
+ * count towards the load but are never sent (see runqueue_remtail).
  */
+#define MIGRATE_SLACK		1
+
 void
 thread_consider_migration(void)
 {
@@ -874,15 +1400,15 @@ thread_consider_migration(void)
 	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
 		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
+		total_count += runqueue_count(c);
 		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
+			my_count = runqueue_count(c);
 		}
 		spinlock_release(&c->c_runqueue_lock);
 	}
 
 	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
+	if (my_count <= one_share + MIGRATE_SLACK) {
 		return;
 	}
 
@@ -890,7 +1416,11 @@ thread_consider_migration(void)
 	threadlist_init(&victims);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
+		t = runqueue_remtail(curcpu->c_self);
+		if (t == NULL) {
+			to_send = i;
+			break;
+		}
 		threadlist_addhead(&victims, t);
 	}
 	spinlock_release(&curcpu->c_runqueue_lock);
@@ -901,7 +1431,7 @@ thread_consider_migration(void)
 			continue;
 		}
 		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
+		while (runqueue_count(c) < one_share && to_send > 0) {
 			t = threadlist_remhead(&victims);
 			/*
 			 * Ordinarily, curthread will not appear on
@@ -932,10 +1462,11 @@ thread_consider_migration(void)
 			}
 
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			runqueue_addtail(c, t);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
+			curcpu->c_migrations++;
 			to_send--;
 			if (c->c_isidle) {
 				/*
@@ -956,7 +1487,7 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			runqueue_addtail(curcpu->c_self, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -985,7 +1516,7 @@ wchan_create(const char *name)
 	struct wchan *wc;
 	int result;
 
-	wc = kmalloc(sizeof(*wc));
+	wc = kmalloc_tagged(sizeof(*wc), KMT_THREAD);
 	if (wc == NULL) {
 		return NULL;
 	}
@@ -999,7 +1530,7 @@ wchan_create(const char *name)
 	if (result) {
 		KASSERT(result == ENOMEM);
 		threadlist_cleanup(&wc->wc_threads);
-		kfree(wc);
+		kfree_tagged(wc, KMT_THREAD);
 		return NULL;
 	}
 
@@ -1030,7 +1561,18 @@ wchan_destroy(struct wchan *wc)
 	spinlock_release(&allwchans_lock);
 
 	threadlist_cleanup(&wc->wc_threads);
-	kfree(wc);
+	kfree_tagged(wc, KMT_THREAD);
+}
+
+/*
+ * Change the symbolic name of a wait channel. Used by objects that
+ * are recycled through an object cache and so keep their wait channel
+ * across lives. The same rules about NAME apply as for wchan_create.
+ */
+void
+wchan_setname(struct wchan *wc, const char *name)
+{
+	wc->wc_name = name;
 }
 
 /*
@@ -1056,6 +1598,86 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	spinlock_acquire(lk);
 }
 
+/*
+ * Wakeup placement.
+ *
+ * Pick the cpu a thread being woken up should run on. Its previous
+ * cpu (t_cpu) is preferred, since some of its working set may still
+ * be in that cpu's cache, as long as it won't have to wait long there.
+ * Otherwise it goes to an idle cpu, if there is one.
+ *
+ * How long the thread has been asleep, measured in hardclocks of its
+ * previous cpu, is taken as a rough estimate of how much of its cache
+ * state is left: a thread that ran within the last WAKEUP_WARM_HARDCLOCKS
+ * is "warm" and is worth queueing behind up to WAKEUP_WARM_MAXLOAD
+ * threads (counting the running one); a cold thread moves to an idle
+ * cpu if the previous one has anything to do at all.
+ *
+ * The caller holds the thread off-cpu (it has just been taken off a
+ * wchan), so it is safe to change its t_cpu.
+ */
+#define WAKEUP_WARM_HARDCLOCKS	2
+#define WAKEUP_WARM_MAXLOAD	2
+
+static
+void
+thread_wakeup_place(struct thread *target)
+{
+	struct cpu *prev, *c;
+	unsigned i, numcpus, load, maxload;
+	bool warm;
+
+	prev = target->t_cpu;
+	numcpus = cpuarray_num(&allcpus);
+	if (numcpus == 1) {
+		return;
+	}
+	if (target->t_pinned) {
+		curcpu->c_wakeups_kept++;
+		return;
+	}
+
+	spinlock_acquire(&prev->c_runqueue_lock);
+	/*
+	 * If the previous cpu went idle straight after this thread
+	 * went to sleep, it is still idling on the thread's stack (see
+	 * thread_consider_migration). It must stay put, and that cpu
+	 * is idle anyway.
+	 */
+	if (target == prev->c_curthread) {
+		spinlock_release(&prev->c_runqueue_lock);
+		curcpu->c_wakeups_kept++;
+		return;
+	}
+	load = runqueue_count(prev) + (prev->c_isidle ? 0 : 1);
+	warm = prev->c_hardclocks - target->t_lastrun <= WAKEUP_WARM_HARDCLOCKS;
+	spinlock_release(&prev->c_runqueue_lock);
+
+	maxload = warm ? WAKEUP_WARM_MAXLOAD : 0;
+	if (load <= maxload) {
+		curcpu->c_wakeups_kept++;
+		return;
+	}
+
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == prev) {
+			continue;
+		}
+		spinlock_acquire(&c->c_runqueue_lock);
+		if (c->c_isidle && runqueue_count(c) == 0) {
+			target->t_cpu = c;
+			spinlock_release(&c->c_runqueue_lock);
+			curcpu->c_wakeups_moved++;
+			return;
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+
+	/* Nowhere better to go. */
+	curcpu->c_wakeups_kept++;
+}
+
 /*
  * Wake up one thread sleeping on a wait channel.
  */
@@ -1073,6 +1695,7 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 		/* Nobody was sleeping. */
 		return;
 	}
+	target->t_wchan = NULL;
 
 	/*
 	 * Note that thread_make_runnable acquires a runqueue lock
@@ -1082,6 +1705,8 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 	 * in thread_switch.
 	 */
 
+	thread_wakeup_boost(target);
+	thread_wakeup_place(target);
 	thread_make_runnable(target, false);
 }
 
@@ -1103,6 +1728,7 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * private list.
 	 */
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 
@@ -1112,12 +1738,86 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * make each thread runnable.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
+		thread_wakeup_boost(target);
+		thread_wakeup_place(target);
 		thread_make_runnable(target, false);
 	}
 
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Timed sleeps. A timer is armed for the sleeping thread; if it goes
+ * off while the thread is still on the wchan, the timer takes it off
+ * and wakes it the same way wchan_wakeone would have.
+ */
+struct wchan_timeout {
+	struct timer wt_timer;
+	struct thread *wt_thread;
+	struct wchan *wt_wchan;
+	struct spinlock *wt_lock;
+	bool wt_expired;
+};
+
+static
+void
+wchan_timeout_expire(void *arg)
+{
+	struct wchan_timeout *wt = arg;
+	struct thread *target = wt->wt_thread;
+
+	spinlock_acquire(wt->wt_lock);
+	if (target->t_wchan == wt->wt_wchan) {
+		threadlist_remove(&wt->wt_wchan->wc_threads, target);
+		target->t_wchan = NULL;
+		wt->wt_expired = true;
+
+		thread_wakeup_boost(target);
+		thread_wakeup_place(target);
+		thread_make_runnable(target, false);
+	}
+	spinlock_release(wt->wt_lock);
+}
+
+int
+wchan_sleep_timeout(struct wchan *wc, struct spinlock *lk, unsigned ticks)
+{
+	struct wchan_timeout wt;
+
+	/* may not sleep in an interrupt handler */
+	KASSERT(!curthread->t_in_interrupt);
+
+	/* must hold the spinlock */
+	KASSERT(spinlock_do_i_hold(lk));
+
+	/* must not hold other spinlocks */
+	KASSERT(curcpu->c_spinlocks == 1);
+
+	if (ticks == 0) {
+		return ETIMEDOUT;
+	}
+
+	timer_init(&wt.wt_timer, wchan_timeout_expire, &wt);
+	wt.wt_thread = curthread;
+	wt.wt_wchan = wc;
+	wt.wt_lock = lk;
+	wt.wt_expired = false;
+
+	/*
+	 * The timer can't take us off the wchan before we are on it,
+	 * because it needs LK, which we hold until thread_switch has
+	 * queued us.
+	 */
+	timer_add(&wt.wt_timer, ticks);
+	thread_switch(S_SLEEP, wc, lk);
+
+	/* Make sure the timer is done with WT before it goes away */
+	timer_del(&wt.wt_timer);
+
+	spinlock_acquire(lk);
+	return wt.wt_expired ? ETIMEDOUT : 0;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
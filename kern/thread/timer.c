@@ -0,0 +1,130 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <timer.h>
+
+/* Must be a power of two. With HZ=100 one turn of the wheel is 2.56s. */
+#define TIMER_WHEEL_SIZE 256
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+
+static struct spinlock timer_lock = SPINLOCK_INITIALIZER_NAMED("timer");
+static struct timer *timer_wheel[TIMER_WHEEL_SIZE];
+static volatile unsigned timer_ticks = 0;
+static struct timer *timer_running = NULL;  // whose function is being called
+
+/* True if tick A comes before tick B */
+#define TICK_BEFORE(a, b) ((int)((a) - (b)) < 0)
+
+void
+timer_init(struct timer *t, void (*func)(void *), void *arg)
+{
+    t->tm_func = func;
+    t->tm_arg = arg;
+    t->tm_expires = 0;
+    t->tm_next = NULL;
+    t->tm_prevp = NULL;
+}
+
+/*
+ * Unlink an armed timer from its bucket. Must hold timer_lock.
+ */
+static
+void
+timer_unlink(struct timer *t)
+{
+    *t->tm_prevp = t->tm_next;
+    if (t->tm_next != NULL)
+    {
+        t->tm_next->tm_prevp = t->tm_prevp;
+    }
+    t->tm_next = NULL;
+    t->tm_prevp = NULL;
+}
+
+void
+timer_add(struct timer *t, unsigned ticks)
+{
+    struct timer **pp;
+
+    KASSERT(t->tm_func != NULL);
+    KASSERT(ticks > 0);
+    /* Further out than this would look like the past */
+    KASSERT(ticks <= 0x7fffffff);
+
+    spinlock_acquire(&timer_lock);
+    KASSERT(t->tm_prevp == NULL);
+
+    t->tm_expires = timer_ticks + ticks;
+
+    /* Keep the bucket sorted, soonest first */
+    pp = &timer_wheel[t->tm_expires & TIMER_WHEEL_MASK];
+    while (*pp != NULL && !TICK_BEFORE(t->tm_expires, (*pp)->tm_expires))
+    {
+        pp = &(*pp)->tm_next;
+    }
+    t->tm_next = *pp;
+    t->tm_prevp = pp;
+    if (*pp != NULL)
+    {
+        (*pp)->tm_prevp = &t->tm_next;
+    }
+    *pp = t;
+
+    spinlock_release(&timer_lock);
+}
+
+bool
+timer_del(struct timer *t)
+{
+    spinlock_acquire(&timer_lock);
+    if (t->tm_prevp != NULL)
+    {
+        timer_unlink(t);
+        spinlock_release(&timer_lock);
+        return true;
+    }
+
+    /* Already fired; it may still be running on cpu 0 */
+    while (timer_running == t)
+    {
+        spinlock_release(&timer_lock);
+        spinlock_acquire(&timer_lock);
+    }
+    spinlock_release(&timer_lock);
+    return false;
+}
+
+unsigned
+timer_now(void)
+{
+    return timer_ticks;
+}
+
+void
+timer_tick(void)
+{
+    struct timer **bucket;
+    struct timer *t;
+    unsigned now;
+
+    spinlock_acquire(&timer_lock);
+    now = ++timer_ticks;
+    bucket = &timer_wheel[now & TIMER_WHEEL_MASK];
+
+    /*
+     * Everything here expiring now is at the front. Timers that
+     * belong to a later turn of the wheel are behind them.
+     */
+    while ((t = *bucket) != NULL && !TICK_BEFORE(now, t->tm_expires))
+    {
+        timer_unlink(t);
+        timer_running = t;
+        spinlock_release(&timer_lock);
+
+        t->tm_func(t->tm_arg);
+
+        spinlock_acquire(&timer_lock);
+        timer_running = NULL;
+    }
+    spinlock_release(&timer_lock);
+}
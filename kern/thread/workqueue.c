@@ -0,0 +1,428 @@
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <cpu.h>
+#include <current.h>
+#include <thread.h>
+#include <proc.h>
+#include <workqueue.h>
+#include <platform/maxcpus.h>
+
+struct workqueue
+{
+    struct spinlock wq_lock;        // protects everything below
+    struct work *wq_head;           // pending items, in order
+    struct work *wq_tail;
+    struct work *wq_delayed;        // items waiting out their delay
+    struct work *wq_current;        // item being run; never dereferenced
+    struct wchan *wq_workchan;      // the worker sleeps here
+    struct wchan *wq_donechan;      // work_flush sleeps here
+    unsigned wq_nrun;               // items run so far
+};
+
+static struct workqueue workqueues[MAXCPUS];
+static volatile unsigned num_workqueues = 0;
+
+/*
+ * Remove W from the singly linked list starting at *LISTP. Returns
+ * the item before it (NULL if it was first) through PREVP.
+ */
+static
+bool
+worklist_remove(struct work **listp, struct work *w, struct work **prevp)
+{
+    struct work *prev = NULL;
+    struct work *cur;
+
+    for (cur = *listp; cur != NULL; cur = cur->w_next)
+    {
+        if (cur == w)
+        {
+            if (prev == NULL)
+            {
+                *listp = w->w_next;
+            }
+            else
+            {
+                prev->w_next = w->w_next;
+            }
+            w->w_next = NULL;
+            *prevp = prev;
+            return true;
+        }
+        prev = cur;
+    }
+    return false;
+}
+
+/*
+ * Append W to Q's pending list and wake the worker. Q must be locked.
+ */
+static
+void
+workqueue_append(struct workqueue *q, struct work *w)
+{
+    w->w_next = NULL;
+    if (q->wq_tail == NULL)
+    {
+        q->wq_head = w;
+    }
+    else
+    {
+        q->wq_tail->w_next = w;
+    }
+    q->wq_tail = w;
+    wchan_wakeone(q->wq_workchan, &q->wq_lock);
+}
+
+/*
+ * Take W off Q's pending or delayed list. Q must be locked.
+ */
+static
+bool
+workqueue_remove(struct workqueue *q, struct work *w)
+{
+    struct work *prev;
+
+    if (worklist_remove(&q->wq_head, w, &prev))
+    {
+        if (q->wq_tail == w)
+        {
+            q->wq_tail = prev;
+        }
+        return true;
+    }
+    return worklist_remove(&q->wq_delayed, w, &prev);
+}
+
+/*
+ * Check whether W is on Q's pending or delayed list. Q must be locked.
+ */
+static
+bool
+workqueue_contains(struct workqueue *q, struct work *w)
+{
+    struct work *cur;
+
+    for (cur = q->wq_head; cur != NULL; cur = cur->w_next)
+    {
+        if (cur == w)
+        {
+            return true;
+        }
+    }
+    for (cur = q->wq_delayed; cur != NULL; cur = cur->w_next)
+    {
+        if (cur == w)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static
+void
+workqueue_worker(void *data1, unsigned long junk)
+{
+    struct workqueue *q = data1;
+    struct work *w;
+    void (*func)(void *);
+    void *arg;
+
+    (void)junk;
+
+    spinlock_acquire(&q->wq_lock);
+    while (1)
+    {
+        while (q->wq_head == NULL)
+        {
+            wchan_sleep(q->wq_workchan, &q->wq_lock);
+        }
+
+        w = q->wq_head;
+        q->wq_head = w->w_next;
+        if (q->wq_head == NULL)
+        {
+            q->wq_tail = NULL;
+        }
+        w->w_next = NULL;
+
+        /*
+         * Once w_pending is clear the item may be queued again, or
+         * freed by whoever owns it, so copy out what we need first.
+         */
+        func = w->w_func;
+        arg = w->w_arg;
+        q->wq_current = w;
+        spinlock_data_set(&w->w_pending, 0);
+        spinlock_release(&q->wq_lock);
+
+        func(arg);
+
+        spinlock_acquire(&q->wq_lock);
+        q->wq_current = NULL;
+        q->wq_nrun++;
+        wchan_wakeall(q->wq_donechan, &q->wq_lock);
+    }
+}
+
+void
+work_init(struct work *w, void (*func)(void *), void *arg)
+{
+    w->w_func = func;
+    w->w_arg = arg;
+    spinlock_data_set(&w->w_pending, 0);
+    w->w_queue = NULL;
+    w->w_next = NULL;
+    w->w_delay = 0;
+}
+
+bool
+work_queue(struct work *w)
+{
+    return work_queue_delayed(w, 0);
+}
+
+bool
+work_queue_delayed(struct work *w, unsigned hardclocks)
+{
+    struct workqueue *q;
+    unsigned num;
+    int spl;
+
+    KASSERT(w->w_func != NULL);
+
+    if (num_workqueues == 0)
+    {
+        return false;
+    }
+
+    /*
+     * From the claim until the item is on a queue, work_flush and
+     * work_cancel can only wait for us by spinning, so don't let us be
+     * preempted or interrupted in between.
+     */
+    spl = splhigh();
+
+    /* Claim the item. The test-and-set can fail spuriously, so retry. */
+    while (spinlock_data_testandset(&w->w_pending) != 0)
+    {
+        if (spinlock_data_get(&w->w_pending) != 0)
+        {
+            splx(spl);
+            return false;
+        }
+    }
+
+    /*
+     * If it is still running, queue it behind itself on the same
+     * worker so it never runs twice at once. Otherwise use this cpu's
+     * queue.
+     */
+    q = w->w_queue;
+    if (q != NULL)
+    {
+        spinlock_acquire(&q->wq_lock);
+        if (q->wq_current != w)
+        {
+            spinlock_release(&q->wq_lock);
+            q = NULL;
+        }
+    }
+    if (q == NULL)
+    {
+        num = curcpu->c_number;
+        if (num >= num_workqueues)
+        {
+            num = 0;
+        }
+        q = &workqueues[num];
+        spinlock_acquire(&q->wq_lock);
+    }
+
+    w->w_queue = q;
+    if (hardclocks == 0)
+    {
+        workqueue_append(q, w);
+    }
+    else
+    {
+        w->w_delay = hardclocks;
+        w->w_next = q->wq_delayed;
+        q->wq_delayed = w;
+    }
+    spinlock_release(&q->wq_lock);
+    splx(spl);
+
+    return true;
+}
+
+bool
+work_cancel(struct work *w)
+{
+    struct workqueue *q;
+    bool removed;
+
+    while (spinlock_data_get(&w->w_pending) != 0)
+    {
+        q = w->w_queue;
+        if (q == NULL)
+        {
+            /* Being queued for the first time, on another cpu, right now */
+            continue;
+        }
+
+        spinlock_acquire(&q->wq_lock);
+        removed = w->w_queue == q && workqueue_remove(q, w);
+        if (removed)
+        {
+            spinlock_data_set(&w->w_pending, 0);
+            wchan_wakeall(q->wq_donechan, &q->wq_lock);
+        }
+        spinlock_release(&q->wq_lock);
+
+        if (removed)
+        {
+            return true;
+        }
+        /* Otherwise it is on its way onto a queue; look again. */
+    }
+    return false;
+}
+
+/*
+ * While the item is on a queue or running, sleep on the queue's
+ * wq_donechan, which the worker wakes each time it finishes an item.
+ * The only time we look again without sleeping is when the item is
+ * pending but on no queue yet: work_queue_delayed is then between its
+ * claim and its enqueue with interrupts off, on another cpu, so that
+ * lasts a few instructions.
+ */
+void
+work_flush(struct work *w)
+{
+    struct workqueue *q;
+    bool busy;
+
+    KASSERT(!curthread->t_in_interrupt);
+
+    while (1)
+    {
+        q = w->w_queue;
+        if (q == NULL)
+        {
+            if (spinlock_data_get(&w->w_pending) == 0)
+            {
+                /* Never queued */
+                return;
+            }
+            continue;
+        }
+
+        spinlock_acquire(&q->wq_lock);
+        busy = w->w_queue == q &&
+            (q->wq_current == w || workqueue_contains(q, w));
+        if (busy)
+        {
+            wchan_sleep(q->wq_donechan, &q->wq_lock);
+            spinlock_release(&q->wq_lock);
+            continue;
+        }
+        spinlock_release(&q->wq_lock);
+
+        /* Not here; done unless it is on its way onto a queue */
+        if (spinlock_data_get(&w->w_pending) == 0)
+        {
+            return;
+        }
+    }
+}
+
+void
+workqueue_tick(void)
+{
+    struct workqueue *q;
+    struct work *w, *next, *prev;
+    unsigned num;
+
+    num = curcpu->c_number;
+    if (num >= num_workqueues)
+    {
+        return;
+    }
+    q = &workqueues[num];
+
+    /* Peek without the lock; nothing to do most of the time. */
+    if (q->wq_delayed == NULL)
+    {
+        return;
+    }
+
+    spinlock_acquire(&q->wq_lock);
+    prev = NULL;
+    for (w = q->wq_delayed; w != NULL; w = next)
+    {
+        next = w->w_next;
+        KASSERT(w->w_delay > 0);
+        w->w_delay--;
+        if (w->w_delay > 0)
+        {
+            prev = w;
+            continue;
+        }
+        if (prev == NULL)
+        {
+            q->wq_delayed = next;
+        }
+        else
+        {
+            prev->w_next = next;
+        }
+        workqueue_append(q, w);
+    }
+    spinlock_release(&q->wq_lock);
+}
+
+void
+workqueue_bootstrap(void)
+{
+    struct workqueue *q;
+    char name[16];
+    unsigned i, n;
+    int result;
+
+    n = thread_numcpus();
+    KASSERT(n <= MAXCPUS);
+
+    for (i = 0; i < n; i++)
+    {
+        q = &workqueues[i];
+        spinlock_init(&q->wq_lock);
+        q->wq_head = NULL;
+        q->wq_tail = NULL;
+        q->wq_delayed = NULL;
+        q->wq_current = NULL;
+        q->wq_nrun = 0;
+        q->wq_workchan = wchan_create("workqueue");
+        q->wq_donechan = wchan_create("workqueue flush");
+        if (q->wq_workchan == NULL || q->wq_donechan == NULL)
+        {
+            panic("workqueue_bootstrap: Out of memory\n");
+        }
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        snprintf(name, sizeof(name), "worker/%u", i);
+        result = thread_fork_on(name, kproc, i, workqueue_worker, &workqueues[i], 0);
+        if (result)
+        {
+            panic("workqueue_bootstrap: thread_fork: %s\n", strerror(result));
+        }
+    }
+
+    num_workqueues = n;
+}
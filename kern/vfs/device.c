@@ -36,6 +36,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <lib.h>
 #include <uio.h>
@@ -225,6 +226,21 @@ dev_isseekable(struct vnode *v)
 	return true;
 }
 
+/*
+ * For poll(). Devices that don't say otherwise never block.
+ */
+static
+int
+dev_poll(struct vnode *v, int events, struct pollentry *pe)
+{
+	struct device *d = v->vn_data;
+
+	if (d->d_ops->devop_poll == NULL) {
+		return vnode_poll_ready(v, events, pe);
+	}
+	return DEVOP_POLL(d, events, pe);
+}
+
 /*
  * For fsync() - meaningless, do nothing.
  */
@@ -335,6 +351,7 @@ static const struct vnode_ops dev_vnode_ops = {
 	.vop_stat = dev_stat,
 	.vop_gettype = dev_gettype,
 	.vop_isseekable = dev_isseekable,
+	.vop_poll = dev_poll,
 	.vop_fsync = null_fsync,
 	.vop_mmap = dev_mmap,
 	.vop_truncate = dev_truncate,
@@ -32,6 +32,7 @@
  */
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <synch.h>
 #include <vfs.h>
@@ -72,6 +73,17 @@ vnode_cleanup(struct vnode *vn)
 }
 
 
+/*
+ * Poll a vnode that is always ready.
+ */
+int
+vnode_poll_ready(struct vnode *vn, int events, struct pollentry *pe)
+{
+	(void)vn;
+	(void)pe;
+	return events & (POLLIN | POLLOUT);
+}
+
 /*
  * Increment refcount.
  * Called by VOP_INCREF.
@@ -46,6 +46,7 @@
 #include <bitmap.h>
 #include <kern/swapspace.h>
 #include <thread.h>
+#include <kmalloc_tag.h>
 
 
 int 
@@ -99,7 +100,7 @@ as_zero_region(vaddr_t va, unsigned npages)
 struct addrspace *
 as_create(void)
 {
-	struct addrspace *as = kmalloc(sizeof(struct addrspace));
+	struct addrspace *as = kmalloc_tagged(sizeof(struct addrspace), KMT_VM);
 	if (as==NULL) {
 		return NULL;
 	}
@@ -108,6 +109,7 @@ as_create(void)
 	as->user_heap_start = 0;
 	as->user_heap_end = 0;
 	as->ptbase = (vaddr_t *)alloc_kpages(1,false);	// Allocate physical page for the top level page table.
+	kmalloc_tag_account(KMT_PAGETABLE, PAGE_SIZE);
 	as_zero_region((vaddr_t)as->ptbase, 1); // Fill the top level page table with zeros
 	as->n_kuseg_pages_ram = 0;
 	as->n_kuseg_pages_swap = 0;
@@ -170,16 +172,18 @@ as_destroy(struct addrspace *as)
 
                 // Free the low-level page table itself
                 free_kpages(llpt_vaddr, false);
+                kmalloc_tag_account(KMT_PAGETABLE, -PAGE_SIZE);
             }
         }
 
         // Free the top-level page table
         free_kpages((vaddr_t)as->ptbase, false);
+        kmalloc_tag_account(KMT_PAGETABLE, -PAGE_SIZE);
     }
 
 
     // Free the address space structure
-    kfree(as);
+    kfree_tagged(as, KMT_VM);
 
 	invalidate_tlb();
 	lock_release(dumbervm.kern_lk);
@@ -317,6 +321,7 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 				lock_release(dumbervm.kern_lk);
 				return ENOMEM;
 			}
+			kmalloc_tag_account(KMT_PAGETABLE, PAGE_SIZE);
 			memcpy(new_as_llpt, old_as_llpt, PAGE_SIZE);
 			new->ptbase[i] = (vaddr_t)new_as_llpt; // put in top-level pagetable
 			
@@ -464,6 +469,7 @@ as_move_pagetable_to_swap(struct addrspace* as, int vpn1)
 	// buf should be a kseg0 vaddr?
 	write_page_to_swap(as, swap_idx, (void *)TLPTE_MASK_VADDR(as->ptbase[vpn1])); 
 	free_kpages(as->ptbase[vpn1],false);
+	kmalloc_tag_account(KMT_PAGETABLE, -PAGE_SIZE);
 	// Update the top-level page table entry to point to the swap space
 	as->ptbase[vpn1] = (vaddr_t)(swap_idx << 12 | 0b1); // set the swap bit	 
 	
@@ -483,6 +489,7 @@ as_load_pagetable_from_swap(struct addrspace *as, int swap_idx, int vpn1)
 	{
 		return ENOMEM;
 	}
+	kmalloc_tag_account(KMT_PAGETABLE, PAGE_SIZE);
 
 	read_from_swap(as, swap_idx, dumbervm.swap_buffer);
 	memcpy((void *)new_ram_page, dumbervm.swap_buffer, PAGE_SIZE);
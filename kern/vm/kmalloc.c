@@ -29,9 +29,14 @@
 
 #include <types.h>
 #include <lib.h>
+#include <spl.h>
 #include <spinlock.h>
+#include <cpu.h>
+#include <current.h>
 #include <vm.h>
 #include <synch.h>
+#include <kmalloc_tag.h>
+#include <platform/maxcpus.h>
 
 /*
  * Kernel malloc.
@@ -79,6 +84,13 @@ fill_deadbeef(void *vptr, size_t len)
 //    cannot recursively use the subpage allocator. (We could probably
 //    make that work, but it would be painful.)
 //
+//    Sizes above half a page don't fit on a single page without
+//    wasting a lot of it, so for those the "page" is actually a slab
+//    of a few physically contiguous pages (see slabpages[]). A 3K
+//    block then costs 3K instead of a whole 4K page, and a 5K one
+//    6K instead of 8K. Everything below works on slabs; for the
+//    smaller sizes a slab is just one page.
+//
 
 ////////////////////////////////////////
 
@@ -122,15 +134,28 @@ fill_deadbeef(void *vptr, size_t len)
 #undef CHECKBEEF
 #undef CHECKGUARDS
 
+/*
+ * PERCPU enables the per-cpu magazines (see below) in front of the
+ * subpage allocator. It is turned off with GUARDS and LABELS, because
+ * blocks sitting in a magazine look allocated to the heap checking
+ * and dumping code.
+ */
+#if !defined(GUARDS) && !defined(LABELS)
+#define PERCPU
+#endif
+
 ////////////////////////////////////////
 
 #if PAGE_SIZE == 4096
 
-#define NSIZES 8
-static const size_t sizes[NSIZES] = { 16, 32, 64, 128, 256, 512, 1024, 2048 };
+#define NSIZES 10
+static const size_t sizes[NSIZES] =
+	{ 16, 32, 64, 128, 256, 512, 1024, 2048, 3072, 6144 };
+static const unsigned slabpages[NSIZES] =
+	{ 1,  1,  1,  1,   1,   1,   1,    1,    3,    3 };
 
 #define SMALLEST_SUBPAGE_SIZE 16
-#define LARGEST_SUBPAGE_SIZE 2048
+#define LARGEST_SUBPAGE_SIZE 6144
 
 #elif PAGE_SIZE == 8192
 #error "No support for 8k pages (yet?)"
@@ -154,6 +179,10 @@ struct pageref {
 
 #define INVALID_OFFSET   (0xffff)
 
+/* Size of the slab for, and number of blocks in a slab of, a size */
+#define SLAB_SIZE(blk)    (slabpages[blk] * PAGE_SIZE)
+#define SLAB_NBLOCKS(blk) (SLAB_SIZE(blk) / sizes[blk])
+
 #define PR_PAGEADDR(pr)  ((pr)->pageaddr_and_blocktype & PAGE_FRAME)
 #define PR_BLOCKTYPE(pr) ((pr)->pageaddr_and_blocktype & ~PAGE_FRAME)
 #define MKPAB(pa, blk)   (((pa)&PAGE_FRAME) | ((blk) & ~PAGE_FRAME))
@@ -161,13 +190,14 @@ struct pageref {
 ////////////////////////////////////////
 
 /*
- * Use one spinlock for the whole thing. Making parts of the kmalloc
- * logic per-cpu is worthwhile for scalability; however, for the time
- * being at least we won't, because it adds a lot of complexity and in
- * OS/161 performance and scalability aren't super-critical.
+ * Use one spinlock for the heap pages and their accounting. The common
+ * case of allocating and freeing small blocks does not take it, as it
+ * goes through the per-cpu magazines below instead. Every cpu falls
+ * back on it when its magazines run dry or overflow, so it is a ticket
+ * lock, to keep one cpu from being starved by the others.
  */
 
-static struct spinlock kmalloc_spinlock = SPINLOCK_INITIALIZER;
+static struct spinlock kmalloc_spinlock = SPINLOCK_INITIALIZER_TICKET("kmalloc");
 
 ////////////////////////////////////////
 
@@ -213,6 +243,12 @@ struct kheap_root {
 
 static struct kheap_root kheaproots[NUM_PAGEREFPAGES];
 
+/*
+ * All kheaproots before this one are full, so allocpageref can start
+ * looking here.
+ */
+static unsigned kheaproot_hint;
+
 /*
  * Allocate a page to hold pagerefs.
  */
@@ -263,9 +299,13 @@ allocpageref(void)
 	unsigned whichroot;
 	struct kheap_root *root;
 
-	for (whichroot=0; whichroot < NUM_PAGEREFPAGES; whichroot++) {
+	for (whichroot=kheaproot_hint; whichroot < NUM_PAGEREFPAGES;
+	     whichroot++) {
 		root = &kheaproots[whichroot];
 		if (root->numinuse >= NPAGEREFS_PER_PAGE) {
+			if (whichroot == kheaproot_hint) {
+				kheaproot_hint++;
+			}
 			continue;
 		}
 
@@ -330,6 +370,9 @@ freepageref(struct pageref *p)
 			root->pagerefs_inuse[i] &= ~k;
 			KASSERT(root->numinuse > 0);
 			root->numinuse--;
+			if (whichroot < kheaproot_hint) {
+				kheaproot_hint = whichroot;
+			}
 			return;
 		}
 	}
@@ -346,6 +389,210 @@ freepageref(struct pageref *p)
 static struct pageref *sizebases[NSIZES];
 static struct pageref *allbase;
 
+/*
+ * Map from physical page number to the pageref of a kernel heap page,
+ * or NULL for pages that don't belong to the subpage allocator. This
+ * lets kfree find the page and block size of a pointer without walking
+ * allbase and without the spinlock: the entry for a page can't change
+ * while the caller still owns a block on it.
+ *
+ * Like kheaproots, this is sized for the 16M RAM limit.
+ */
+static struct pageref *pagerefs_by_ppn[TOTAL_PAGEREFS];
+
+/*
+ * Physical page number of kernel address ADDR, or -1 if it's outside
+ * the range covered by the per-ppn tables.
+ */
+static
+int
+kheap_ppn(vaddr_t addr)
+{
+	paddr_t ppn;
+
+	if (addr < MIPS_KSEG0) {
+		return -1;
+	}
+	ppn = KSEG0_VADDR_TO_PADDR(addr) / PAGE_SIZE;
+	if (ppn >= TOTAL_PAGEREFS) {
+		return -1;
+	}
+	return ppn;
+}
+
+static
+struct pageref **
+pageref_slot(vaddr_t addr)
+{
+	int ppn;
+
+	ppn = kheap_ppn(addr);
+	if (ppn < 0) {
+		return NULL;
+	}
+	return &pagerefs_by_ppn[ppn];
+}
+
+/*
+ * Point the entries for all pages of the slab at PRPAGE, of type
+ * BLKTYPE, at PR (or clear them, if PR is NULL).
+ */
+static
+void
+set_slab_pagerefs(vaddr_t prpage, unsigned blktype, struct pageref *pr)
+{
+	struct pageref **slot;
+	unsigned i;
+
+	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+
+	for (i=0; i<slabpages[blktype]; i++) {
+		slot = pageref_slot(prpage + i * PAGE_SIZE);
+		KASSERT(slot != NULL);
+		KASSERT(pr == NULL ? *slot != NULL : *slot == NULL);
+		*slot = pr;
+	}
+}
+
+////////////////////////////////////////
+
+#ifdef PERCPU
+
+/*
+ * Per-cpu magazines.
+ *
+ * Each cpu keeps a small stack of free blocks of every size. kmalloc
+ * pops from it and kfree pushes onto it with only interrupts disabled,
+ * so neither touches the spinlock or any shared data. When a
+ * magazine runs dry it is refilled from a heap page in a batch while
+ * we hold the spinlock anyway; when it overflows half of it is
+ * flushed back to the heap pages in one go.
+ *
+ * A magazine holds at most a slab worth of blocks, so the big sizes
+ * don't tie up too much memory.
+ */
+
+#define MAG_MAXBLOCKS 32
+
+struct magazine {
+	unsigned nblocks;
+	void *blocks[MAG_MAXBLOCKS];
+};
+
+struct kmalloc_cpu {
+	struct magazine mags[NSIZES];
+	unsigned long fastallocs;	/* kmallocs served by the magazine */
+	unsigned long fastfrees;	/* kfrees absorbed by the magazine */
+	unsigned long refills;		/* trips to the heap pages to refill */
+	unsigned long flushes;		/* trips to the heap pages to flush */
+};
+
+static struct kmalloc_cpu kmalloc_cpus[MAXCPUS];
+
+static
+inline
+unsigned
+mag_capacity(unsigned blktype)
+{
+	unsigned n = SLAB_NBLOCKS(blktype);
+
+	return n < MAG_MAXBLOCKS ? n : MAG_MAXBLOCKS;
+}
+
+/*
+ * The magazines of the current cpu. Interrupts must be off, so that
+ * we can't be switched out and end up running on another cpu.
+ */
+static
+inline
+struct kmalloc_cpu *
+mag_thiscpu(void)
+{
+	KASSERT(curcpu->c_number < MAXCPUS);
+	return &kmalloc_cpus[curcpu->c_number];
+}
+
+/*
+ * Take a block of type BLKTYPE from this cpu's magazine. Returns NULL
+ * if the magazine is empty (or the cpu structures aren't up yet).
+ */
+static
+void *
+mag_get(unsigned blktype)
+{
+	struct kmalloc_cpu *kc;
+	struct magazine *mag;
+	void *ret = NULL;
+	int spl;
+
+	if (!CURCPU_EXISTS()) {
+		return NULL;
+	}
+
+	spl = splhigh();
+	kc = mag_thiscpu();
+	mag = &kc->mags[blktype];
+	if (mag->nblocks > 0) {
+		mag->nblocks--;
+		ret = mag->blocks[mag->nblocks];
+		kc->fastallocs++;
+	}
+	splx(spl);
+
+	return ret;
+}
+
+/*
+ * Put the block at BLOCK, of type BLKTYPE, into this cpu's magazine.
+ * If the magazine is full, half of it is moved to FLUSH to be given
+ * back to the heap pages by the caller, and the number of blocks so
+ * moved is returned in *NFLUSH. Returns false if the block could not
+ * be taken at all.
+ */
+static
+bool
+mag_put(void *block, unsigned blktype, void **flush, unsigned *nflush)
+{
+	struct kmalloc_cpu *kc;
+	struct magazine *mag;
+	unsigned cap, i;
+	int spl;
+
+	*nflush = 0;
+	if (!CURCPU_EXISTS()) {
+		return false;
+	}
+
+	cap = mag_capacity(blktype);
+
+	spl = splhigh();
+	kc = mag_thiscpu();
+	mag = &kc->mags[blktype];
+	if (mag->nblocks >= cap) {
+		/* Full; keep the most recently freed (cache-warm) half. */
+		*nflush = cap / 2;
+		for (i=0; i < *nflush; i++) {
+			flush[i] = mag->blocks[i];
+		}
+		for (i=*nflush; i < mag->nblocks; i++) {
+			mag->blocks[i - *nflush] = mag->blocks[i];
+		}
+		mag->nblocks -= *nflush;
+		kc->flushes++;
+	}
+	else {
+		kc->fastfrees++;
+	}
+	/* cheap check for the most common double free */
+	KASSERT(mag->nblocks == 0 || mag->blocks[mag->nblocks-1] != block);
+	mag->blocks[mag->nblocks++] = block;
+	splx(spl);
+
+	return true;
+}
+
+#endif /* PERCPU */
+
 ////////////////////////////////////////
 
 #ifdef GUARDS
@@ -532,7 +779,7 @@ checksubpage(struct pageref *pr)
 	KASSERT(prpage < MIPS_KSEG1);
 #endif
 
-	KASSERT(pr->freelist_offset < PAGE_SIZE);
+	KASSERT(pr->freelist_offset < SLAB_SIZE(blktype));
 	KASSERT(pr->freelist_offset % blocksize == 0);
 
 	fla = prpage + pr->freelist_offset;
@@ -540,7 +787,7 @@ checksubpage(struct pageref *pr)
 
 	for (; fl != NULL; fl = fl->next) {
 		fla = (vaddr_t)fl;
-		KASSERT(fla >= prpage && fla < prpage + PAGE_SIZE);
+		KASSERT(fla >= prpage && fla < prpage + SLAB_SIZE(blktype));
 		KASSERT((fla-prpage) % blocksize == 0);
 #ifdef CHECKBEEF
 		checkdeadbeef(fl, blocksize);
@@ -557,7 +804,7 @@ checksubpage(struct pageref *pr)
 	KASSERT(nfree==pr->nfree);
 
 #ifdef CHECKGUARDS
-	numblocks = PAGE_SIZE / blocksize;
+	numblocks = SLAB_NBLOCKS(blktype);
 	for (i=0; i<numblocks; i++) {
 		mask = 1U << (i % 32);
 		if ((isfree[i / 32] & mask) == 0) {
@@ -641,7 +888,7 @@ void
 dump_subpage(struct pageref *pr, unsigned generation)
 {
 	unsigned blocksize = sizes[PR_BLOCKTYPE(pr)];
-	unsigned numblocks = PAGE_SIZE / blocksize;
+	unsigned numblocks = SLAB_NBLOCKS(PR_BLOCKTYPE(pr));
 	unsigned numfreewords = DIVROUNDUP(numblocks, 32);
 	uint32_t isfree[numfreewords], mask;
 	vaddr_t prpage;
@@ -766,7 +1013,7 @@ subpage_stats(struct pageref *pr)
 	KASSERT(blktype >= 0 && blktype < NSIZES);
 
 	/* compute how many bits we need in freemap and assert we fit */
-	n = PAGE_SIZE / sizes[blktype];
+	n = SLAB_NBLOCKS(blktype);
 	KASSERT(n <= 32 * ARRAYCOUNT(freemap));
 
 	if (pr->freelist_offset != INVALID_OFFSET) {
@@ -795,6 +1042,53 @@ subpage_stats(struct pageref *pr)
 	kprintf("\n");
 }
 
+/*
+ * Print how full the slabs of each block size are. Blocks sitting in
+ * the per-cpu magazines are counted as free, as they are available
+ * to kmalloc; "slack" is the memory in slabs that isn't in use.
+ */
+static
+void
+subpage_classstats(void)
+{
+	struct pageref *pr;
+	unsigned blktype;
+	unsigned long nslabs, nblocks, nfree, inuse, slack;
+#ifdef PERCPU
+	unsigned i;
+#endif
+
+	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+
+	kprintf("%6s %6s %6s %7s %7s %5s %9s %9s\n", "size", "slabs",
+		"pages", "blocks", "inuse", "used", "inuse(B)", "slack(B)");
+	for (blktype=0; blktype<NSIZES; blktype++) {
+		nslabs = nfree = 0;
+		for (pr = sizebases[blktype]; pr != NULL;
+		     pr = pr->next_samesize) {
+			nslabs++;
+			nfree += pr->nfree;
+		}
+#ifdef PERCPU
+		for (i=0; i<MAXCPUS; i++) {
+			nfree += kmalloc_cpus[i].mags[blktype].nblocks;
+		}
+#endif
+		if (nslabs == 0) {
+			continue;
+		}
+		nblocks = nslabs * SLAB_NBLOCKS(blktype);
+		KASSERT(nfree <= nblocks);
+		inuse = nblocks - nfree;
+		slack = nslabs * SLAB_SIZE(blktype) - inuse * sizes[blktype];
+		kprintf("%6lu %6lu %6lu %7lu %7lu %4lu%% %9lu %9lu\n",
+			(unsigned long)sizes[blktype], nslabs,
+			nslabs * slabpages[blktype], nblocks, inuse,
+			inuse * 100 / nblocks,
+			inuse * (unsigned long)sizes[blktype], slack);
+	}
+}
+
 /*
  * Print the whole heap.
  */
@@ -812,6 +1106,39 @@ kheap_printstats(void)
 		subpage_stats(pr);
 	}
 
+	kprintf("Size class occupancy:\n");
+	subpage_classstats();
+
+#ifdef PERCPU
+	{
+		struct kmalloc_cpu *kc;
+		unsigned i, j;
+
+		/*
+		 * Blocks in the magazines show up as allocated in the
+		 * page maps above. The other cpus' counters may be a
+		 * little stale.
+		 */
+		kprintf("Per-cpu magazines:\n");
+		for (i=0; i<MAXCPUS; i++) {
+			kc = &kmalloc_cpus[i];
+			if (kc->fastallocs == 0 && kc->fastfrees == 0 &&
+			    kc->refills == 0 && kc->flushes == 0) {
+				continue;
+			}
+			kprintf("cpu%u: %lu fast allocs, %lu fast frees, "
+				"%lu refills, %lu flushes\n   held:", i,
+				kc->fastallocs, kc->fastfrees,
+				kc->refills, kc->flushes);
+			for (j=0; j<NSIZES; j++) {
+				kprintf(" %lu:%u", (unsigned long)sizes[j],
+					kc->mags[j].nblocks);
+			}
+			kprintf("\n");
+		}
+	}
+#endif
+
 	spinlock_release(&kmalloc_spinlock);
 }
 
@@ -867,6 +1194,77 @@ int blocktype(size_t clientsz)
 	return 0;
 }
 
+/*
+ * Take a block off the free list of heap page PR, which must have
+ * one.
+ */
+static
+void *
+subpage_takeblock(struct pageref *pr)
+{
+	vaddr_t prpage;		// PR_PAGEADDR(pr)
+	vaddr_t fla;		// free list entry address
+	struct freelist *fl;	// free list entry
+	void *retptr;
+
+	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+	KASSERT(pr->nfree > 0);
+	KASSERT(pr->freelist_offset < SLAB_SIZE(PR_BLOCKTYPE(pr)));
+	prpage = PR_PAGEADDR(pr);
+	fla = prpage + pr->freelist_offset;
+	fl = (struct freelist *)fla;
+
+	retptr = fl;
+	fl = fl->next;
+	pr->nfree--;
+
+	if (fl != NULL) {
+		KASSERT(pr->nfree > 0);
+		fla = (vaddr_t)fl;
+		KASSERT(fla - prpage < SLAB_SIZE(PR_BLOCKTYPE(pr)));
+		pr->freelist_offset = fla - prpage;
+	}
+	else {
+		KASSERT(pr->nfree == 0);
+		pr->freelist_offset = INVALID_OFFSET;
+	}
+
+	return retptr;
+}
+
+#ifdef PERCPU
+/*
+ * Move up to half a magazine of blocks from heap page PR into this
+ * cpu's (empty) magazine for BLKTYPE, so the next few kmallocs of
+ * this size don't need to come back here.
+ */
+static
+void
+mag_refill(struct pageref *pr, unsigned blktype)
+{
+	struct kmalloc_cpu *kc;
+	struct magazine *mag;
+	unsigned want;
+
+	/* Holding the spinlock keeps interrupts off, so curcpu is stable. */
+	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+	if (!CURCPU_EXISTS()) {
+		return;
+	}
+
+	kc = mag_thiscpu();
+	mag = &kc->mags[blktype];
+	want = mag_capacity(blktype) / 2;
+	if (mag->nblocks >= want || pr->nfree == 0) {
+		return;
+	}
+	while (mag->nblocks < want && pr->nfree > 0) {
+		mag->blocks[mag->nblocks++] = subpage_takeblock(pr);
+	}
+	kc->refills++;
+}
+#endif
+
 /*
  * Allocate a block of size SZ, where SZ is not large enough to
  * warrant a whole-page allocation.
@@ -906,6 +1304,13 @@ subpage_kmalloc(size_t sz
 	blktype = blocktype(sz);
 	sz = sizes[blktype];
 
+#ifdef PERCPU
+	retptr = mag_get(blktype);
+	if (retptr != NULL) {
+		return retptr;
+	}
+#endif
+
 	spinlock_acquire(&kmalloc_spinlock);
 
 	checksubpages();
@@ -920,25 +1325,10 @@ subpage_kmalloc(size_t sz
 
 		doalloc: /* comes here after getting a whole fresh page */
 
-			KASSERT(pr->freelist_offset < PAGE_SIZE);
-			prpage = PR_PAGEADDR(pr);
-			fla = prpage + pr->freelist_offset;
-			fl = (struct freelist *)fla;
-
-			retptr = fl;
-			fl = fl->next;
-			pr->nfree--;
-
-			if (fl != NULL) {
-				KASSERT(pr->nfree > 0);
-				fla = (vaddr_t)fl;
-				KASSERT(fla - prpage < PAGE_SIZE);
-				pr->freelist_offset = fla - prpage;
-			}
-			else {
-				KASSERT(pr->nfree == 0);
-				pr->freelist_offset = INVALID_OFFSET;
-			}
+			retptr = subpage_takeblock(pr);
+#ifdef PERCPU
+			mag_refill(pr, blktype);
+#endif
 #ifdef GUARDS
 			retptr = establishguardband(retptr, clientsz, sz);
 #endif
@@ -963,7 +1353,7 @@ subpage_kmalloc(size_t sz
 	 */
 
 	spinlock_release(&kmalloc_spinlock);
-	prpage = alloc_kpages(1,true);
+	prpage = alloc_kpages(slabpages[blktype],true);
 	if (prpage==0) {
 		/* Out of memory. */
 		kprintf("kmalloc: Subpage allocator couldn't get a page\n");
@@ -971,8 +1361,8 @@ subpage_kmalloc(size_t sz
 	}
 	KASSERT(prpage % PAGE_SIZE == 0);
 #ifdef CHECKBEEF
-	/* deadbeef the whole page, as it probably starts zeroed */
-	fill_deadbeef((void *)prpage, PAGE_SIZE);
+	/* deadbeef the whole slab, as it probably starts zeroed */
+	fill_deadbeef((void *)prpage, SLAB_SIZE(blktype));
 #endif
 	spinlock_acquire(&kmalloc_spinlock);
 
@@ -985,8 +1375,10 @@ subpage_kmalloc(size_t sz
 		return NULL;
 	}
 
+	set_slab_pagerefs(prpage, blktype, pr);
+
 	pr->pageaddr_and_blocktype = MKPAB(prpage, blktype);
-	pr->nfree = PAGE_SIZE / sizes[blktype];
+	pr->nfree = SLAB_NBLOCKS(blktype);
 
 	/*
 	 * Note: fl is volatile because the MIPS toolchain we were
@@ -1017,23 +1409,117 @@ subpage_kmalloc(size_t sz
 }
 
 /*
- * Free a pointer previously returned from subpage_kmalloc. If the
- * pointer is not on any heap page we recognize, return -1.
+ * Give the NBLOCKS blocks in BLOCKS back to the free lists of their
+ * heap pages, and release any page that becomes entirely free. The
+ * blocks have already been checked and deadbeefed by subpage_kfree.
  */
 static
-int
-subpage_kfree(void *ptr)
+void
+subpage_release(void **blocks, unsigned nblocks)
 {
 	int blktype;		// index into sizes[] that we're using
-	vaddr_t ptraddr;	// same as ptr
+	vaddr_t ptraddr;	// address of the block being released
+	struct pageref **slot;	// pagerefs_by_ppn[] entry for its page
 	struct pageref *pr;	// pageref for page we're freeing in
 	vaddr_t prpage;		// PR_PAGEADDR(pr)
 	vaddr_t fla;		// free list entry address
 	struct freelist *fl;	// free list entry
 	vaddr_t offset;		// offset into page
+	unsigned n;
+
+	spinlock_acquire(&kmalloc_spinlock);
+
+	checksubpages();
+
+	for (n=0; n<nblocks; n++) {
+		ptraddr = (vaddr_t)blocks[n];
+		slot = pageref_slot(ptraddr);
+		KASSERT(slot != NULL && *slot != NULL);
+		pr = *slot;
+		prpage = PR_PAGEADDR(pr);
+		blktype = PR_BLOCKTYPE(pr);
+
+		/* check for corruption */
+		KASSERT(blktype>=0 && blktype<NSIZES);
+		checksubpage(pr);
+
+		offset = ptraddr - prpage;
+
+		/*
+		 * We probably ought to check for free twice by seeing if
+		 * the block is already on the free list. But that's
+		 * expensive, so we don't.
+		 */
+
+		fla = prpage + offset;
+		fl = (struct freelist *)fla;
+		if (pr->freelist_offset == INVALID_OFFSET) {
+			fl->next = NULL;
+		} else {
+			fl->next = (struct freelist *)(prpage + pr->freelist_offset);
+
+			/* this block should not already be on the free list! */
+#ifdef SLOW
+			{
+				struct freelist *fl2;
+
+				for (fl2 = fl->next; fl2 != NULL; fl2 = fl2->next) {
+					KASSERT(fl2 != fl);
+				}
+			}
+#else
+			/* check just the head */
+			KASSERT(fl != fl->next);
+#endif
+		}
+		pr->freelist_offset = offset;
+		pr->nfree++;
+
+		KASSERT(pr->nfree <= SLAB_NBLOCKS(blktype));
+		if (pr->nfree == SLAB_NBLOCKS(blktype)) {
+			/* Whole page is free. */
+			remove_lists(pr, blktype);
+			set_slab_pagerefs(prpage, blktype, NULL);
+			freepageref(pr);
+			/* Call free_kpages without kmalloc_spinlock. */
+			spinlock_release(&kmalloc_spinlock);
+			free_kpages(prpage,true);
+			spinlock_acquire(&kmalloc_spinlock);
+		}
+	}
+
+	spinlock_release(&kmalloc_spinlock);
+
+#ifdef SLOWER /* Don't get the lock unless checksubpages does something. */
+	spinlock_acquire(&kmalloc_spinlock);
+	checksubpages();
+	spinlock_release(&kmalloc_spinlock);
+#endif
+}
+
+/*
+ * Free a pointer previously returned from subpage_kmalloc, and return
+ * the size of its block in *BLOCKSIZERET. If the pointer is not on any
+ * heap page we recognize, return -1.
+ */
+static
+int
+subpage_kfree(void *ptr, size_t *blocksizeret)
+{
+	int blktype;		// index into sizes[] that we're using
+	vaddr_t ptraddr;	// same as ptr
+	struct pageref **slot;	// pagerefs_by_ppn[] entry for its page
+	struct pageref *pr;	// pageref for page we're freeing in
+	vaddr_t prpage;		// PR_PAGEADDR(pr)
+	vaddr_t offset;		// offset into page
+	void *block;		// the underlying block
 #ifdef GUARDS
 	size_t blocksize, smallerblocksize;
 #endif
+#ifdef PERCPU
+	void *flush[MAG_MAXBLOCKS / 2];
+	unsigned nflush;
+#endif
 
 	ptraddr = (vaddr_t)ptr;
 #ifdef GUARDS
@@ -1060,34 +1546,25 @@ subpage_kfree(void *ptr)
 	ptraddr -= LABEL_PTROFFSET;
 #endif
 
-	spinlock_acquire(&kmalloc_spinlock);
-
-	checksubpages();
-
-	for (pr = allbase; pr; pr = pr->next_all) {
-		prpage = PR_PAGEADDR(pr);
-		blktype = PR_BLOCKTYPE(pr);
-		KASSERT(blktype >= 0 && blktype < NSIZES);
-
-		/* check for corruption */
-		KASSERT(blktype>=0 && blktype<NSIZES);
-		checksubpage(pr);
-
-		if (ptraddr >= prpage && ptraddr < prpage + PAGE_SIZE) {
-			break;
-		}
-	}
-
+	/*
+	 * No lock needed: we own a block on this page (if it's one of
+	 * ours), so its entry can't change under us.
+	 */
+	slot = pageref_slot(ptraddr);
+	pr = slot != NULL ? *slot : NULL;
 	if (pr==NULL) {
 		/* Not on any of our pages - not a subpage allocation */
-		spinlock_release(&kmalloc_spinlock);
 		return -1;
 	}
 
+	prpage = PR_PAGEADDR(pr);
+	blktype = PR_BLOCKTYPE(pr);
+	KASSERT(blktype >= 0 && blktype < NSIZES);
+
 	offset = ptraddr - prpage;
 
 	/* Check for proper positioning and alignment */
-	if (offset >= PAGE_SIZE || offset % sizes[blktype] != 0) {
+	if (offset >= SLAB_SIZE(blktype) || offset % sizes[blktype] != 0) {
 		panic("kfree: subpage free of invalid addr %p\n", ptr);
 	}
 
@@ -1103,82 +1580,189 @@ subpage_kfree(void *ptr)
 	 */
 	fill_deadbeef((void *)ptraddr, sizes[blktype]);
 
-	/*
-	 * We probably ought to check for free twice by seeing if the block
-	 * is already on the free list. But that's expensive, so we don't.
-	 */
-
-	fla = prpage + offset;
-	fl = (struct freelist *)fla;
-	if (pr->freelist_offset == INVALID_OFFSET) {
-		fl->next = NULL;
-	} else {
-		fl->next = (struct freelist *)(prpage + pr->freelist_offset);
-
-		/* this block should not already be on the free list! */
-#ifdef SLOW
-		{
-			struct freelist *fl2;
+	block = (void *)ptraddr;
+	*blocksizeret = sizes[blktype];
 
-			for (fl2 = fl->next; fl2 != NULL; fl2 = fl2->next) {
-				KASSERT(fl2 != fl);
-			}
+#ifdef PERCPU
+	if (mag_put(block, blktype, flush, &nflush)) {
+		if (nflush > 0) {
+			subpage_release(flush, nflush);
 		}
-#else
-		/* check just the head */
-		KASSERT(fl != fl->next);
+		return 0;
+	}
 #endif
+
+	subpage_release(&block, 1);
+	return 0;
+}
+
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+//
+// Tagged accounting. See kmalloc_tag.h.
+//
+
+static const char *const ktag_names[KMT_NTAGS] = {
+	"untagged",
+	"vm",
+	"pagetable",
+	"file",
+	"proc",
+	"thread",
+	"sfs",
+};
+
+struct ktag_counters {
+	long bytes;		/* may go negative: frees on another cpu */
+	unsigned long allocs;
+	unsigned long frees;
+};
+
+static struct ktag_counters ktag_cpus[MAXCPUS][KMT_NTAGS];
+
+/* Protects ktag_peak. */
+static struct spinlock ktag_peak_lock = SPINLOCK_INITIALIZER;
+static long ktag_peak[KMT_NTAGS];
+
+/*
+ * Number of pages in each whole-page kmalloc, by the ppn of its first
+ * page, so that kfree can tell how much it is giving back.
+ */
+static uint16_t bigalloc_npages[TOTAL_PAGEREFS];
+
+static
+void
+ktag_charge(kmalloc_tag_t tag, long bytes)
+{
+	struct ktag_counters *kt;
+	unsigned cpunum;
+	int spl;
+
+	KASSERT((unsigned)tag < KMT_NTAGS);
+
+	/* Before the cpu structures exist, only the boot cpu runs. */
+	spl = splhigh();
+	cpunum = CURCPU_EXISTS() ? curcpu->c_number : 0;
+	KASSERT(cpunum < MAXCPUS);
+	kt = &ktag_cpus[cpunum][tag];
+	kt->bytes += bytes;
+	if (bytes > 0) {
+		kt->allocs++;
+	}
+	else if (bytes < 0) {
+		kt->frees++;
 	}
-	pr->freelist_offset = offset;
-	pr->nfree++;
+	splx(spl);
+}
 
-	KASSERT(pr->nfree <= PAGE_SIZE / sizes[blktype]);
-	if (pr->nfree == PAGE_SIZE / sizes[blktype]) {
-		/* Whole page is free. */
-		remove_lists(pr, blktype);
-		freepageref(pr);
-		/* Call free_kpages without kmalloc_spinlock. */
-		spinlock_release(&kmalloc_spinlock);
-		free_kpages(prpage,true);
+/*
+ * Add up the per-cpu counters for TAG. The other cpus keep going while
+ * we read, so this is only a snapshot.
+ */
+static
+void
+ktag_total(kmalloc_tag_t tag, struct ktag_counters *total)
+{
+	unsigned i;
+
+	total->bytes = 0;
+	total->allocs = 0;
+	total->frees = 0;
+	for (i=0; i<MAXCPUS; i++) {
+		total->bytes += ktag_cpus[i][tag].bytes;
+		total->allocs += ktag_cpus[i][tag].allocs;
+		total->frees += ktag_cpus[i][tag].frees;
 	}
-	else {
-		spinlock_release(&kmalloc_spinlock);
+}
+
+void
+kmalloc_tag_account(kmalloc_tag_t tag, long bytes)
+{
+	ktag_charge(tag, bytes);
+}
+
+void
+kmalloc_tag_sample(void)
+{
+	struct ktag_counters total;
+	unsigned tag;
+
+	spinlock_acquire(&ktag_peak_lock);
+	for (tag=0; tag<KMT_NTAGS; tag++) {
+		ktag_total(tag, &total);
+		if (total.bytes > ktag_peak[tag]) {
+			ktag_peak[tag] = total.bytes;
+		}
 	}
+	spinlock_release(&ktag_peak_lock);
+}
 
-#ifdef SLOWER /* Don't get the lock unless checksubpages does something. */
-	spinlock_acquire(&kmalloc_spinlock);
-	checksubpages();
-	spinlock_release(&kmalloc_spinlock);
-#endif
+void
+kmalloc_tag_printstats(void)
+{
+	struct ktag_counters totals[KMT_NTAGS];
+	unsigned order[KMT_NTAGS];
+	long peaks[KMT_NTAGS];
+	unsigned i, j, tmp;
+
+	kmalloc_tag_sample();
+
+	spinlock_acquire(&ktag_peak_lock);
+	for (i=0; i<KMT_NTAGS; i++) {
+		ktag_total(i, &totals[i]);
+		peaks[i] = ktag_peak[i];
+		order[i] = i;
+	}
+	spinlock_release(&ktag_peak_lock);
+
+	/* Largest current usage first; there are only a few tags. */
+	for (i=1; i<KMT_NTAGS; i++) {
+		for (j=i; j>0 && totals[order[j]].bytes >
+			     totals[order[j-1]].bytes; j--) {
+			tmp = order[j];
+			order[j] = order[j-1];
+			order[j-1] = tmp;
+		}
+	}
 
-	return 0;
+	kprintf("%-10s %10s %10s %10s %10s\n",
+		"tag", "bytes", "peak", "allocs", "frees");
+	for (i=0; i<KMT_NTAGS; i++) {
+		j = order[i];
+		kprintf("%-10s %10ld %10ld %10lu %10lu\n", ktag_names[j],
+			totals[j].bytes, peaks[j],
+			totals[j].allocs, totals[j].frees);
+	}
 }
 
-//
 ////////////////////////////////////////////////////////////
 
 /*
- * Allocate a block of size SZ. Redirect either to subpage_kmalloc or
- * alloc_kpages depending on how big SZ is.
+ * Allocate a block of size SZ, charged to TAG. Redirect either to
+ * subpage_kmalloc or alloc_kpages depending on how big SZ is.
  */
+static
 void *
-kmalloc(size_t sz)
-{
-	size_t checksz;
+kmalloc_internal(size_t sz, kmalloc_tag_t tag
 #ifdef LABELS
-	vaddr_t label;
+		 , vaddr_t label
 #endif
-
-#ifdef LABELS
-#ifdef __GNUC__
-	label = (vaddr_t)__builtin_return_address(0);
-#else
-#error "Don't know how to get return address with this compiler"
-#endif /* __GNUC__ */
-#endif /* LABELS */
+	)
+{
+	size_t checksz;
+	void *ret;
+	int ppn;
 
 	checksz = sz + GUARD_OVERHEAD + LABEL_OVERHEAD;
-	if (checksz >= LARGEST_SUBPAGE_SIZE) {
+	/*
+	 * Use whole pages for big blocks, and also for those that fit
+	 * a whole number of pages at least as well as any block size
+	 * (e.g. 3.5K is better off in one page than in a 6K block).
+	 */
+	if (checksz >= LARGEST_SUBPAGE_SIZE ||
+	    ROUNDUP(checksz, PAGE_SIZE) <= sizes[blocktype(checksz)]) {
 		unsigned long npages;
 		vaddr_t address;
 
@@ -1190,31 +1774,96 @@ kmalloc(size_t sz)
 		}
 		KASSERT(address % PAGE_SIZE == 0);
 
+		ppn = kheap_ppn(address);
+		if (ppn >= 0) {
+			KASSERT(npages <= 0xffff);
+			bigalloc_npages[ppn] = npages;
+		}
+		ktag_charge(tag, npages * PAGE_SIZE);
+
 		return (void *)address;
 	}
 
 #ifdef LABELS
-	return subpage_kmalloc(sz, label);
+	ret = subpage_kmalloc(sz, label);
 #else
-	return subpage_kmalloc(sz);
+	ret = subpage_kmalloc(sz);
 #endif
+	if (ret != NULL) {
+		ktag_charge(tag, sizes[blocktype(checksz)]);
+	}
+	return ret;
 }
 
 /*
- * Free a block previously returned from kmalloc.
+ * Free a block previously returned from kmalloc_internal with TAG.
  */
+static
 void
-kfree(void *ptr)
+kfree_internal(void *ptr, kmalloc_tag_t tag)
 {
+	size_t freed;
+	int ppn;
+
 	/*
 	 * Try subpage first; if that fails, assume it's a big allocation.
 	 */
 	if (ptr == NULL) {
 		return;
-	} else if (subpage_kfree(ptr)) {
+	} else if (subpage_kfree(ptr, &freed)) {
 		// Enters here if the pointer we are freeing is not a subpage
 		KASSERT((vaddr_t)ptr%PAGE_SIZE==0);
+		freed = 0;
+		ppn = kheap_ppn((vaddr_t)ptr);
+		if (ppn >= 0) {
+			freed = bigalloc_npages[ppn] * PAGE_SIZE;
+			bigalloc_npages[ppn] = 0;
+		}
 		free_kpages((vaddr_t)ptr,true);
-	} 
+	}
+	ktag_charge(tag, -(long)freed);
 }
 
+/*
+ * Allocate a block of size SZ.
+ */
+void *
+kmalloc(size_t sz)
+{
+#ifdef LABELS
+#ifdef __GNUC__
+	return kmalloc_internal(sz, KMT_UNTAGGED,
+				(vaddr_t)__builtin_return_address(0));
+#else
+#error "Don't know how to get return address with this compiler"
+#endif /* __GNUC__ */
+#else
+	return kmalloc_internal(sz, KMT_UNTAGGED);
+#endif /* LABELS */
+}
+
+/*
+ * Free a block previously returned from kmalloc.
+ */
+void
+kfree(void *ptr)
+{
+	kfree_internal(ptr, KMT_UNTAGGED);
+}
+
+void *
+kmalloc_tagged(size_t sz, kmalloc_tag_t tag)
+{
+#ifdef LABELS
+	return kmalloc_internal(sz, tag,
+				(vaddr_t)__builtin_return_address(0));
+#else
+	return kmalloc_internal(sz, tag);
+#endif
+}
+
+void
+kfree_tagged(void *ptr, kmalloc_tag_t tag)
+{
+	kfree_internal(ptr, tag);
+}
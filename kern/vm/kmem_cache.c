@@ -0,0 +1,198 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <kmem_cache.h>
+
+/*
+ * List of caches that have been used at least once, for statistics.
+ * Caches are static and never go away, so this only ever grows.
+ */
+static struct spinlock kmem_caches_lock = SPINLOCK_INITIALIZER;
+static struct kmem_cache *kmem_caches = NULL;
+
+static
+void
+kmem_cache_register(struct kmem_cache *kc)
+{
+    spinlock_acquire(&kmem_caches_lock);
+    if (!kc->kc_registered)
+    {
+        kc->kc_registered = true;
+        kc->kc_next = kmem_caches;
+        kmem_caches = kc;
+    }
+    spinlock_release(&kmem_caches_lock);
+}
+
+void *
+kmem_cache_alloc(struct kmem_cache *kc)
+{
+    void *obj = NULL;
+    int result;
+
+    KASSERT(kc != NULL);
+
+    if (!kc->kc_registered)
+    {
+        kmem_cache_register(kc);
+    }
+
+    spinlock_acquire(&kc->kc_lock);
+    if (kc->kc_nfree > 0)
+    {
+        kc->kc_nfree--;
+        obj = kc->kc_objs[kc->kc_nfree];
+        kc->kc_objs[kc->kc_nfree] = NULL;
+        kc->kc_hits++;
+    }
+    else
+    {
+        kc->kc_misses++;
+    }
+    spinlock_release(&kc->kc_lock);
+
+    if (obj != NULL)
+    {
+        return obj;
+    }
+
+    /*
+     * Cache is empty, make a new one. The constructor may sleep
+     * (it usually creates locks), so this is done without kc_lock.
+     */
+    obj = kmalloc_tagged(kc->kc_objsize, kc->kc_tag);
+    if (obj == NULL)
+    {
+        return NULL;
+    }
+
+    if (kc->kc_ctor != NULL)
+    {
+        result = kc->kc_ctor(obj);
+        if (result)
+        {
+            kfree_tagged(obj, kc->kc_tag);
+            return NULL;
+        }
+    }
+
+    return obj;
+}
+
+void
+kmem_cache_free(struct kmem_cache *kc, void *obj)
+{
+    KASSERT(kc != NULL);
+
+    if (obj == NULL)
+    {
+        return;
+    }
+
+    spinlock_acquire(&kc->kc_lock);
+    if (kc->kc_nfree < KMEM_CACHE_SIZE)
+    {
+        kc->kc_objs[kc->kc_nfree] = obj;
+        kc->kc_nfree++;
+        spinlock_release(&kc->kc_lock);
+        return;
+    }
+    kc->kc_releases++;
+    spinlock_release(&kc->kc_lock);
+
+    /* Cache is full, really get rid of it */
+    if (kc->kc_dtor != NULL)
+    {
+        kc->kc_dtor(obj);
+    }
+    kfree_tagged(obj, kc->kc_tag);
+}
+
+void
+kmem_cache_reap(struct kmem_cache *kc)
+{
+    void *obj;
+
+    KASSERT(kc != NULL);
+
+    while (1)
+    {
+        spinlock_acquire(&kc->kc_lock);
+        if (kc->kc_nfree == 0)
+        {
+            spinlock_release(&kc->kc_lock);
+            break;
+        }
+        kc->kc_nfree--;
+        obj = kc->kc_objs[kc->kc_nfree];
+        kc->kc_objs[kc->kc_nfree] = NULL;
+        kc->kc_releases++;
+        spinlock_release(&kc->kc_lock);
+
+        if (kc->kc_dtor != NULL)
+        {
+            kc->kc_dtor(obj);
+        }
+        kfree_tagged(obj, kc->kc_tag);
+    }
+}
+
+/* kmem_cache_printstats prints at most this many caches */
+#define KMEM_CACHE_STATS_MAX 32
+
+struct kmem_cache_stats
+{
+    const char *name;
+    size_t objsize;
+    unsigned int nfree;
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int releases;
+};
+
+void
+kmem_cache_printstats(void)
+{
+    struct kmem_cache_stats stats[KMEM_CACHE_STATS_MAX];
+    struct kmem_cache *kc;
+    unsigned int i, n, more;
+
+    /*
+     * kprintf may sleep on the console, so copy the numbers out under
+     * the locks and print them after.
+     */
+    n = 0;
+    more = 0;
+    spinlock_acquire(&kmem_caches_lock);
+    for (kc = kmem_caches; kc != NULL; kc = kc->kc_next)
+    {
+        if (n == KMEM_CACHE_STATS_MAX)
+        {
+            more++;
+            continue;
+        }
+        spinlock_acquire(&kc->kc_lock);
+        stats[n].name = kc->kc_name;
+        stats[n].objsize = kc->kc_objsize;
+        stats[n].nfree = kc->kc_nfree;
+        stats[n].hits = kc->kc_hits;
+        stats[n].misses = kc->kc_misses;
+        stats[n].releases = kc->kc_releases;
+        spinlock_release(&kc->kc_lock);
+        n++;
+    }
+    spinlock_release(&kmem_caches_lock);
+
+    kprintf("%-16s %8s %6s %10s %10s %10s\n",
+        "cache", "objsize", "cached", "hits", "misses", "releases");
+    for (i = 0; i < n; i++)
+    {
+        kprintf("%-16s %8lu %6u %10u %10u %10u\n",
+            stats[i].name, (unsigned long)stats[i].objsize, stats[i].nfree,
+            stats[i].hits, stats[i].misses, stats[i].releases);
+    }
+    if (more > 0)
+    {
+        kprintf("(%u more caches not shown)\n", more);
+    }
+}
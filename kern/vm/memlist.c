@@ -6,6 +6,7 @@
 #include <synch.h>
 #include <kern/memlist.h>
 #include <vm.h>
+#include <kmalloc_tag.h>
 
 
 /**
@@ -18,16 +19,16 @@
 */
 struct memlist* memlist_create(paddr_t start, paddr_t end) {
 
-    struct memlist *ml = kmalloc(sizeof(struct memlist));
+    struct memlist *ml = kmalloc_tagged(sizeof(struct memlist), KMT_VM);
     if (ml == NULL) 
     {
         return NULL;
     }
 
-    ml->head = kmalloc(sizeof(struct memlist_node));
+    ml->head = kmalloc_tagged(sizeof(struct memlist_node), KMT_VM);
     if (ml->head == NULL) 
     {
-        kfree(ml);
+        kfree_tagged(ml, KMT_VM);
         return NULL;
     }
 
@@ -88,7 +89,7 @@ struct memlist* memlist_bootstrap(paddr_t start, paddr_t end) {
 
 struct memlist_node *memlist_node_create(struct memlist_node *prev, struct memlist_node *next)
 {
-    struct memlist_node *new = kmalloc(sizeof(struct memlist_node));
+    struct memlist_node *new = kmalloc_tagged(sizeof(struct memlist_node), KMT_VM);
     
     if (new == NULL) return NULL;
      
@@ -106,12 +107,12 @@ void memlist_destroy(struct memlist *ml) {
 
     while (cur != NULL) 
     {
-        kfree(cur->prev);
+        kfree_tagged(cur->prev, KMT_VM);
         cur = cur->next;
     }
     
     spinlock_cleanup(&ml->ml_lk);
-    kfree(ml);
+    kfree_tagged(ml, KMT_VM);
 }
 
 /** 
@@ -161,7 +162,7 @@ paddr_t memlist_get_first_fit(struct memlist *ml, size_t sz) {
         {
             // split block into 
             // [ allocd, sz = sz] [ not_allocd, sz = prevsz - sz]
-            struct memlist_node *new = kmalloc(sizeof(struct memlist_node));
+            struct memlist_node *new = kmalloc_tagged(sizeof(struct memlist_node), KMT_VM);
             // 0-100
             // memlist_node on 0 to sizeof(struct memlist_node) = 1
             // 
@@ -233,7 +234,7 @@ void memlist_remove(struct memlist *ml, paddr_t blk)
             cur->prev->next = cur->next; // fix forward ptr
             if (cur->next != NULL) cur->next->prev = cur->prev; // fix backward ptr
             spinlock_release(&ml->ml_lk);
-            kfree(cur);
+            kfree_tagged(cur, KMT_VM);
         }
 
         // case 3: prev allocated or NULL, next not allocated
@@ -245,7 +246,7 @@ void memlist_remove(struct memlist *ml, paddr_t blk)
             if (cur->next != NULL) cur->next->prev = cur; // fix backward ptr
             cur->allocated = false; // set to be a large free blk 
             spinlock_release(&ml->ml_lk);
-            kfree(cur->next);
+            kfree_tagged(cur->next, KMT_VM);
         }
 
         // case 4: prev and next both unallocated 
@@ -256,8 +257,8 @@ void memlist_remove(struct memlist *ml, paddr_t blk)
             cur->prev->next = cur->next->next; // fix forward ptr
             cur->next->prev = cur->prev; // fix backward ptr 
             spinlock_release(&ml->ml_lk);
-            kfree(cur->next);
-            kfree(cur);
+            kfree_tagged(cur->next, KMT_VM);
+            kfree_tagged(cur, KMT_VM);
         }
     }
     else
@@ -274,7 +275,7 @@ struct memlist *memlist_copy(struct memlist *src, struct memlist *dst)
     if (src->head == NULL) return NULL; // nothing to copy
 
     if (dst->head == NULL) {
-        dst->head = kmalloc(sizeof(struct memlist_node));
+        dst->head = kmalloc_tagged(sizeof(struct memlist_node), KMT_VM);
         if (dst->head == NULL) return NULL;
     }
 
@@ -286,7 +287,7 @@ struct memlist *memlist_copy(struct memlist *src, struct memlist *dst)
     {
         if (cur_dst->next == NULL) 
         {
-            cur_dst->next = kmalloc(sizeof(struct memlist_node));
+            cur_dst->next = kmalloc_tagged(sizeof(struct memlist_node), KMT_VM);
             if (cur_dst->next == NULL) return NULL;
 
             cur_dst->next->prev = cur_dst; // set prev ptr
@@ -29,6 +29,10 @@
 
 #include <unistd.h>
 #include <err.h>
+#include <errno.h>
+
+/* Bytes per copy_file_range call */
+#define COPY_CHUNK (1024*1024)
 
 /*
  * cp - copy a file.
@@ -45,6 +49,7 @@ copy(const char *from, const char *to)
 	int tofd;
 	char buf[1024];
 	int len, wr, wrtot;
+	int copied = 0;
 
 	/*
 	 * Open the files, and give up if they won't open
@@ -58,6 +63,21 @@ copy(const char *from, const char *to)
 		err(1, "%s", to);
 	}
 
+	/*
+	 * Let the kernel move the data if it can; then it never comes
+	 * up here at all. If the kernel doesn't have copy_file_range,
+	 * or can't use it on these files, fall back to read and write.
+	 */
+	while ((len = copy_file_range(fromfd, tofd, COPY_CHUNK)) > 0) {
+		copied = 1;
+	}
+	if (len == 0) {
+		goto done;
+	}
+	if (copied || (errno != ENOSYS && errno != EINVAL)) {
+		err(1, "%s: copy to %s", from, to);
+	}
+
 	/*
 	 * As long as we get more than zero bytes, we haven't hit EOF.
 	 * Zero means EOF. Less than zero means an error occurred.
@@ -85,6 +105,7 @@ copy(const char *from, const char *to)
 		err(1, "%s", from);
 	}
 
+ done:
 	if (close(fromfd) < 0) {
 		err(1, "%s: close", from);
 	}
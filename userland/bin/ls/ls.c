@@ -30,10 +30,12 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
 #include <err.h>
+#include <dirent.h>
 
 /*
  * ls - list files.
@@ -127,18 +129,22 @@ printheader(const char *file)
 }
 
 /*
- * Show a single file.
+ * Show a single file. If ST is not null, it is the file's attributes,
+ * as they came with its directory entry.
  * We don't do the neat multicolumn listing that Unix ls does.
  */
 static
 void
-print(const char *path)
+print(const char *path, const struct stat *st)
 {
 	struct stat statbuf;
 	const char *file;
 	int typech;
 
-	if (lopt || sopt) {
+	if (st != NULL) {
+		statbuf = *st;
+	}
+	else if (lopt || sopt) {
 		int fd;
 
 		fd = open(path, O_RDONLY);
@@ -186,19 +192,31 @@ print(const char *path)
 }
 
 /*
- * List a directory.
+ * Buffer for getdirentries. Each call fills it with as many entries,
+ * attributes included, as fit, so a directory of any size takes a
+ * handful of calls rather than several per entry.
+ */
+#define DIRBUF_SIZE 16384
+
+/*
+ * Call FUNC for each entry of the directory PATH, with the entry's
+ * full name and attributes.
  */
 static
 void
-listdir(const char *path, int showheader)
+foreachentry(const char *path,
+	     void (*func)(const char *newpath, const struct dirent *d))
 {
-	int fd;
-	char buf[1024];
 	char newpath[1024];
-	ssize_t len;
+	const struct dirent *d;
+	ssize_t len, pos;
+	char *buf;
+	int fd;
 
-	if (showheader) {
-		printheader(path);
+	/* One per directory being walked, since func may recurse */
+	buf = malloc(DIRBUF_SIZE);
+	if (buf == NULL) {
+		err(1, "malloc");
 	}
 
 	/*
@@ -212,75 +230,79 @@ listdir(const char *path, int showheader)
 	/*
 	 * List the directory.
 	 */
-	while ((len = getdirentry(fd, buf, sizeof(buf)-1)) > 0) {
-		buf[len] = 0;
-
-		/* Assemble the full name of the new item */
-		snprintf(newpath, sizeof(newpath), "%s/%s", path, buf);
-
-		if (aopt || buf[0]!='.') {
-			/* Print it */
-			print(newpath);
+	while ((len = getdirentries(fd, buf, DIRBUF_SIZE)) > 0) {
+		for (pos = 0; pos < len; pos += d->d_reclen) {
+			d = (const struct dirent *)(buf + pos);
+
+			/* Assemble the full name of the new item */
+			snprintf(newpath, sizeof(newpath), "%s/%s",
+				 path, d->d_name);
+			func(newpath, d);
 		}
 	}
 	if (len<0) {
-		err(1, "%s: getdirentry", path);
+		err(1, "%s: getdirentries", path);
 	}
 
 	/* Done */
 	close(fd);
+	free(buf);
 }
 
 static
 void
-recursedir(const char *path)
+listentry(const char *newpath, const struct dirent *d)
 {
-	int fd;
-	char buf[1024];
-	char newpath[1024];
-	int len;
-
-	/*
-	 * Open it.
-	 */
-	fd = open(path, O_RDONLY);
-	if (fd<0) {
-		err(1, "%s", path);
+	if (aopt || d->d_name[0]!='.') {
+		/* Print it */
+		print(newpath, &d->d_stat);
 	}
+}
 
-	/*
-	 * List the directory.
-	 */
-	while ((len = getdirentry(fd, buf, sizeof(buf)-1)) > 0) {
-		buf[len] = 0;
-
-		/* Assemble the full name of the new item */
-		snprintf(newpath, sizeof(newpath), "%s/%s", path, buf);
+/*
+ * List a directory.
+ */
+static
+void
+listdir(const char *path, int showheader)
+{
+	if (showheader) {
+		printheader(path);
+	}
+	foreachentry(path, listentry);
+}
 
-		if (!aopt && buf[0]=='.') {
-			/* skip this one */
-			continue;
-		}
+static void recursedir(const char *path);
 
-		if (!strcmp(buf, ".") || !strcmp(buf, "..")) {
-			/* always skip these */
-			continue;
-		}
+static
+void
+recurseentry(const char *newpath, const struct dirent *d)
+{
+	if (!aopt && d->d_name[0]=='.') {
+		/* skip this one */
+		return;
+	}
 
-		if (!isdir(newpath)) {
-			continue;
-		}
+	if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, "..")) {
+		/* always skip these */
+		return;
+	}
 
-		listdir(newpath, 1 /*showheader*/);
-		if (Ropt) {
-			recursedir(newpath);
-		}
+	if (!S_ISDIR(d->d_stat.st_mode)) {
+		return;
 	}
-	if (len<0) {
-		err(1, "%s", path);
+
+	listdir(newpath, 1 /*showheader*/);
+	if (Ropt) {
+		recursedir(newpath);
 	}
+}
 
-	close(fd);
+static
+void
+recursedir(const char *path)
+{
+	foreachentry(path, recurseentry);
 }
 
 static
@@ -294,7 +316,7 @@ listitem(const char *path, int showheader)
 		}
 	}
 	else {
-		print(path);
+		print(path, NULL);
 	}
 }
 
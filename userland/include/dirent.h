@@ -0,0 +1,23 @@
+#ifndef _DIRENT_H_
+#define _DIRENT_H_
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/*
+ * Get struct dirent from the kernel.
+ */
+#include <kern/dirent.h>
+
+/*
+ * Reads as many whole entries of the directory open on FILEHANDLE as
+ * fit in BUF, continuing from where the last call left off. Returns
+ * the number of bytes filled, 0 at the end of the directory. Step
+ * through the entries with d_reclen.
+ *
+ * Each entry comes with the attributes fstat would give for it, so
+ * nothing needs to be opened to find out its type or size.
+ */
+ssize_t getdirentries(int filehandle, void *buf, size_t buflen);
+
+#endif /* _DIRENT_H_ */
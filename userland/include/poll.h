@@ -0,0 +1,19 @@
+#ifndef _POLL_H_
+#define _POLL_H_
+
+#include <sys/types.h>
+
+/*
+ * Get struct pollfd and the POLL* flags from the kernel.
+ */
+#include <kern/poll.h>
+
+/*
+ * Waits until one of the NFDS descriptors in FDS is ready for what its
+ * events ask, or TIMEOUT milliseconds pass; a TIMEOUT of 0 only looks
+ * and a negative one waits for good. Fills in each revents and returns
+ * how many are nonzero, 0 on timeout.
+ */
+int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+
+#endif /* _POLL_H_ */
@@ -0,0 +1,162 @@
+/*
+ * filestress.c
+ *
+ * Stress test for the system open file table.
+ *
+ * Builds a chain of processes, each forked by the one before it. Every
+ * process in the chain opens FILES_PER_PROC descriptors on the same file
+ * and seeks each one to an offset of its own before forking the next, so
+ * when the last process is running, nprocs * FILES_PER_PROC files are open
+ * at once -- thousands, by default. On the way back up, each process reads
+ * a byte through every one of its descriptors to check it still refers to
+ * its own open file, then closes them all.
+ *
+ * This is repeated several times so the file table has to grow and shrink
+ * again and again.
+ *
+ * Usage: filestress [nprocs]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define FILENAME	"filestress.dat"
+#define FILESIZE	4096
+#define FILES_PER_PROC	28	/* leaves room for stdin/out/err under OPEN_MAX */
+#define DEFAULT_PROCS	100
+#define ROUNDS		3
+
+static int nprocs;
+
+/* Where descriptor J of process DEPTH is seeked to */
+static
+off_t
+fileoffset(int depth, int j)
+{
+	return (off_t)((depth * FILES_PER_PROC + j) % FILESIZE);
+}
+
+static
+void
+makefile(void)
+{
+	unsigned char buf[FILESIZE];
+	int fd, i;
+
+	for (i=0; i<FILESIZE; i++) {
+		buf[i] = i & 0xff;
+	}
+
+	fd = open(FILENAME, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open for write", FILENAME);
+	}
+	if (write(fd, buf, FILESIZE) != FILESIZE) {
+		err(1, "%s: write", FILENAME);
+	}
+	close(fd);
+}
+
+/*
+ * Open this process's files, fork the rest of the chain, wait for it, and
+ * check our files. Returns the number of problems seen, here or below.
+ */
+static
+int
+chain(int depth)
+{
+	int fds[FILES_PER_PROC];
+	unsigned char ch;
+	int fails, status, j;
+	pid_t pid;
+
+	fails = 0;
+
+	for (j=0; j<FILES_PER_PROC; j++) {
+		fds[j] = open(FILENAME, O_RDONLY);
+		if (fds[j] < 0) {
+			err(1, "depth %d: open %d", depth, j);
+		}
+		if (lseek(fds[j], fileoffset(depth, j), SEEK_SET) < 0) {
+			err(1, "depth %d: lseek %d", depth, j);
+		}
+	}
+
+	if (depth + 1 < nprocs) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "depth %d: fork", depth);
+		}
+		if (pid == 0) {
+			/* Ours are the parent's; make room for the child's own */
+			for (j=0; j<FILES_PER_PROC; j++) {
+				close(fds[j]);
+			}
+			_exit(chain(depth + 1) ? 1 : 0);
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			err(1, "depth %d: waitpid", depth);
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			fails++;
+		}
+	}
+	else {
+		printf("filestress: %d files open at once\n",
+		       nprocs * FILES_PER_PROC);
+	}
+
+	for (j=0; j<FILES_PER_PROC; j++) {
+		if (read(fds[j], &ch, 1) != 1) {
+			warn("depth %d: read %d", depth, j);
+			fails++;
+		}
+		else if (ch != (fileoffset(depth, j) & 0xff)) {
+			warnx("depth %d: fd %d read %u, expected %u",
+			      depth, j, ch,
+			      (unsigned)(fileoffset(depth, j) & 0xff));
+			fails++;
+		}
+		if (close(fds[j])) {
+			warn("depth %d: close %d", depth, j);
+			fails++;
+		}
+	}
+
+	return fails;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int round, fails;
+
+	nprocs = DEFAULT_PROCS;
+	if (argc > 1) {
+		nprocs = atoi(argv[1]);
+		if (nprocs < 1) {
+			errx(1, "Usage: filestress [nprocs]");
+		}
+	}
+
+	makefile();
+
+	fails = 0;
+	for (round=0; round<ROUNDS; round++) {
+		printf("filestress: round %d, %d processes\n", round, nprocs);
+		fails += chain(0);
+	}
+
+	remove(FILENAME);
+
+	if (fails) {
+		errx(1, "FAILED: %d problems", fails);
+	}
+	printf("filestress: Passed.\n");
+	return 0;
+}
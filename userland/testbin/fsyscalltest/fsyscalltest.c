@@ -225,6 +225,95 @@ test_openfile_limits()
 	}
 }
 
+/*
+ * Now that descriptor tables grow, make sure fds far past the initial
+ * table size work: dup2 to the highest fd there is, read through it,
+ * and check that open hands out the lowest free fd even when that is
+ * in the middle of a nearly full table.
+ */
+static void
+test_high_fds()
+{
+	static char writebuf[41] = "High fds, high fds, all the way up......\n";
+	static char readbuf[41];
+	const char *file;
+	int fd, highfd, rv, i, hole;
+
+	file = "testfile2";
+
+	fd = open(file, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd<0)
+		err(1, "%s: open", file);
+
+	rv = write(fd, writebuf, 40);
+	if (rv<0)
+		err(1, "%s: write", file);
+
+	highfd = OPEN_MAX - 1;
+	rv = dup2(fd, highfd);
+	if (rv<0)
+		err(1, "%s: dup2 to %d", file, highfd);
+	else if (rv != highfd)
+		errx(1, "dup2() returned %d, expected %d", rv, highfd);
+
+	/* The duplicate shares the offset, which is at the end */
+	rv = lseek(highfd, 0, SEEK_SET);
+	if (rv<0)
+		err(1, "%s: lseek via fd %d", file, highfd);
+
+	rv = read(highfd, readbuf, 40);
+	if (rv != 40)
+		err(1, "%s: read via fd %d", file, highfd);
+	readbuf[40] = 0;
+	if (strcmp(readbuf, writebuf))
+		errx(1, "Buffer data mismatch reading via fd %d!", highfd);
+
+	rv = dup2(fd, OPEN_MAX);
+	if (rv >= 0)
+		errx(1, "dup2 to OPEN_MAX (%d) succeeded", OPEN_MAX);
+
+	/* Fill every fd between fd and highfd */
+	for (i = 0; i < OPEN_MAX - 5; i++)
+	{
+		openFDs[i] = open(file, O_RDONLY);
+		if (openFDs[i]<0)
+			err(1, "%s: open for %dth time", file, (i+1));
+	}
+
+	/* Every fd is now in use, so this should fail */
+	rv = open(file, O_RDONLY);
+	if (rv >= 0)
+		errx(1, "Opened fd %d with all %d fds in use", rv, OPEN_MAX);
+
+	/* Punch a hole in the middle; the next open should fill it */
+	hole = openFDs[(OPEN_MAX - 5) / 2];
+	rv = close(hole);
+	if (rv<0)
+		err(1, "%s: close fd %d", file, hole);
+
+	rv = open(file, O_RDONLY);
+	if (rv<0)
+		err(1, "%s: re-open after closing fd %d", file, hole);
+	else if (rv != hole)
+		errx(1, "open returned fd %d, expected the lowest free fd %d",
+		     rv, hole);
+
+	for (i = 0; i < OPEN_MAX - 5; i++)
+	{
+		rv = close(openFDs[i]);
+		if (rv<0)
+			err(1, "%s: close file descriptor %d", file, openFDs[i]);
+	}
+
+	rv = close(highfd);
+	if (rv<0)
+		err(1, "%s: close fd %d", file, highfd);
+
+	rv = close(fd);
+	if (rv<0)
+		err(1, "%s: close", file);
+}
+
 /* Open two files, write to them, read from them, make sure the
  * content checks, then close them. 
  */
@@ -371,8 +460,12 @@ main()
 	test_dup2();
 	printf("Passed Part 4 of fsyscalltest\n");
 
-	dir_test();
+	test_high_fds();
 	printf("Passed Part 5 of fsyscalltest\n");
+
+	/* Last, since it changes directory */
+	dir_test();
+	printf("Passed Part 6 of fsyscalltest\n");
 	
 	printf("All done!\n");
 	
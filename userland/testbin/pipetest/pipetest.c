@@ -0,0 +1,364 @@
+/*
+ * pipetest.c
+ *
+ * Tests for pipes.
+ *
+ * 1. Data written in odd-sized pieces comes out the other end in order,
+ *    read in different odd-sized pieces, across many trips round the
+ *    pipe's ring buffer.
+ * 2. Several writers at once: each write lands whole, not mixed up
+ *    with the others.
+ * 3. Reading gets end of file once every write end is closed,
+ *    including the copies held by other processes.
+ * 4. Writing gets EPIPE once the read end is closed.
+ * 5. poll sees each end's readiness: it times out on an empty pipe,
+ *    wakes when another process writes, and reports the other end
+ *    going away.
+ *
+ * Usage: pipetest
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <err.h>
+
+#define STREAM_BYTES	(1024 * 1024 + 77)
+#define WRITERS		4
+#define RECORDS		500	/* per writer */
+#define RECSIZE		400	/* under PIPE_BUF */
+
+static char wbuf[8192];
+static char rbuf[8192];
+
+/* The byte at position POS of the stream in test 1 */
+static
+char
+streambyte(unsigned long pos)
+{
+	return (char)(pos * 7 + pos / 251);
+}
+
+static
+void
+dowait(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		errx(1, "child: Exit %d", WEXITSTATUS(status));
+	}
+}
+
+static
+void
+test_stream(void)
+{
+	unsigned long pos, i;
+	size_t amt;
+	ssize_t len;
+	pid_t pid;
+	int fds[2];
+
+	printf("1. Stream through the ring...\n");
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		pos = 0;
+		amt = 1;
+		while (pos < STREAM_BYTES) {
+			/* 1, 4, 13, 40, ... up to 8K, then round again */
+			amt = amt * 3 + 1;
+			if (amt > sizeof(wbuf)) {
+				amt = 1;
+			}
+			if (amt > STREAM_BYTES - pos) {
+				amt = STREAM_BYTES - pos;
+			}
+			for (i=0; i<amt; i++) {
+				wbuf[i] = streambyte(pos + i);
+			}
+			len = write(fds[1], wbuf, amt);
+			if (len != (ssize_t)amt) {
+				err(1, "write");
+			}
+			pos += amt;
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+
+	pos = 0;
+	amt = 5;
+	while (1) {
+		amt = (amt * 5) % sizeof(rbuf) + 1;
+		len = read(fds[0], rbuf, amt);
+		if (len < 0) {
+			err(1, "read");
+		}
+		if (len == 0) {
+			break;
+		}
+		for (i=0; i<(unsigned long)len; i++) {
+			if (rbuf[i] != streambyte(pos + i)) {
+				errx(1, "byte %lu: got %d, expected %d",
+				     pos + i, rbuf[i], streambyte(pos + i));
+			}
+		}
+		pos += len;
+	}
+	if (pos != STREAM_BYTES) {
+		errx(1, "got %lu bytes, expected %lu", pos,
+		     (unsigned long)STREAM_BYTES);
+	}
+	close(fds[0]);
+	dowait(pid);
+	printf("   passed\n");
+}
+
+static
+void
+test_writers(void)
+{
+	unsigned long counts[WRITERS];
+	char rec[RECSIZE];
+	size_t have;
+	ssize_t len;
+	pid_t pids[WRITERS];
+	int fds[2];
+	int w, i, j;
+
+	printf("2. %d writers at once...\n", WRITERS);
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	for (w=0; w<WRITERS; w++) {
+		pids[w] = fork();
+		if (pids[w] < 0) {
+			err(1, "fork");
+		}
+		if (pids[w] == 0) {
+			close(fds[0]);
+			for (i=0; i<RECORDS; i++) {
+				/* Every byte of the record names its writer and number */
+				for (j=0; j<RECSIZE; j++) {
+					rec[j] = (char)(w * 64 + i % 64);
+				}
+				if (write(fds[1], rec, RECSIZE) != RECSIZE) {
+					err(1, "write");
+				}
+			}
+			_exit(0);
+		}
+	}
+	close(fds[1]);
+
+	for (w=0; w<WRITERS; w++) {
+		counts[w] = 0;
+	}
+
+	/* Reads can split records, so put each one back together first */
+	have = 0;
+	while ((len = read(fds[0], rec + have, RECSIZE - have)) > 0) {
+		have += len;
+		if (have < RECSIZE) {
+			continue;
+		}
+		for (j=1; j<RECSIZE; j++) {
+			if (rec[j] != rec[0]) {
+				errx(1, "record mixed up at byte %d", j);
+			}
+		}
+		w = (unsigned char)rec[0] / 64;
+		if (w >= WRITERS ||
+		    (unsigned char)rec[0] % 64 != counts[w] % 64) {
+			errx(1, "record out of order");
+		}
+		counts[w]++;
+		have = 0;
+	}
+	if (len < 0) {
+		err(1, "read");
+	}
+	if (have != 0) {
+		errx(1, "%lu bytes left over", (unsigned long)have);
+	}
+	for (w=0; w<WRITERS; w++) {
+		if (counts[w] != RECORDS) {
+			errx(1, "writer %d: got %lu records, expected %d",
+			     w, counts[w], RECORDS);
+		}
+		dowait(pids[w]);
+	}
+	close(fds[0]);
+	printf("   passed\n");
+}
+
+static
+void
+test_eof(void)
+{
+	pid_t pid;
+	int fds[2];
+	char ch;
+
+	printf("3. End of file after the last writer...\n");
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	/* The child holds a copy of the write end until it exits */
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		if (write(fds[1], "x", 1) != 1) {
+			err(1, "write");
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+
+	if (read(fds[0], &ch, 1) != 1 || ch != 'x') {
+		errx(1, "didn't get the child's byte");
+	}
+	if (read(fds[0], &ch, 1) != 0) {
+		errx(1, "no end of file after the child exited");
+	}
+	close(fds[0]);
+	dowait(pid);
+	printf("   passed\n");
+}
+
+static
+void
+test_epipe(void)
+{
+	int fds[2];
+
+	printf("4. EPIPE with no reader...\n");
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	close(fds[0]);
+	if (write(fds[1], "x", 1) != -1 || errno != EPIPE) {
+		errx(1, "write with no reader didn't fail with EPIPE");
+	}
+	close(fds[1]);
+	printf("   passed\n");
+}
+
+/* What poll says about the one fd FD, waiting at most TIMEOUT ms */
+static
+int
+pollone(int fd, int events, int timeout)
+{
+	struct pollfd pfd;
+	int n;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+	n = poll(&pfd, 1, timeout);
+	if (n < 0) {
+		err(1, "poll");
+	}
+	if ((n == 0) != (pfd.revents == 0)) {
+		errx(1, "poll returned %d with revents 0x%x", n, pfd.revents);
+	}
+	return pfd.revents;
+}
+
+static
+void
+test_poll(void)
+{
+	struct timespec ts;
+	pid_t pid;
+	int fds[2];
+	char ch;
+
+	printf("5. poll...\n");
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	if (pollone(fds[0], POLLIN, 50) != 0) {
+		errx(1, "empty pipe polled readable");
+	}
+	if (pollone(fds[1], POLLOUT, 0) != POLLOUT) {
+		errx(1, "empty pipe not polled writable");
+	}
+
+	/* The parent is asleep in poll by the time the child writes */
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		ts.tv_sec = 0;
+		ts.tv_nsec = 100 * 1000 * 1000;
+		nanosleep(&ts, NULL);
+		if (write(fds[1], "x", 1) != 1) {
+			err(1, "write");
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+
+	if (pollone(fds[0], POLLIN, -1) != POLLIN) {
+		errx(1, "write didn't wake poll");
+	}
+	if (read(fds[0], &ch, 1) != 1 || ch != 'x') {
+		errx(1, "didn't get the child's byte");
+	}
+
+	/* The write end goes when the child exits */
+	if ((pollone(fds[0], POLLIN, -1) & POLLHUP) == 0) {
+		errx(1, "no POLLHUP after the writer exited");
+	}
+	dowait(pid);
+	close(fds[0]);
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	close(fds[0]);
+	if ((pollone(fds[1], POLLOUT, 0) & POLLERR) == 0) {
+		errx(1, "no POLLERR with no reader");
+	}
+	close(fds[1]);
+	printf("   passed\n");
+}
+
+int
+main(void)
+{
+	test_stream();
+	test_writers();
+	test_eof();
+	test_epipe();
+	test_poll();
+	printf("All tests passed.\n");
+	return 0;
+}
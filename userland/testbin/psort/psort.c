@@ -412,6 +412,44 @@ dowrite(const char *path, int fd, const void *buf, size_t len)
 	}
 }
 
+/*
+ * The worker phases use pread/pwrite at explicit positions, so they
+ * never have to seek and never depend on a file offset.
+ */
+static
+void
+dopread(const char *path, int fd, void *buf, size_t len, off_t pos)
+{
+	int result;
+
+	result = pread(fd, buf, len, pos);
+	if (result < 0) {
+		complain("%s: pread", path);
+		exit(1);
+	}
+	if ((size_t) result != len) {
+		complainx("%s: pread: short count", path);
+		exit(1);
+	}
+}
+
+static
+void
+dopwrite(const char *path, int fd, const void *buf, size_t len, off_t pos)
+{
+	int result;
+
+	result = pwrite(fd, buf, len, pos);
+	if (result < 0) {
+		complain("%s: pwrite", path);
+		exit(1);
+	}
+	if ((size_t) result != len) {
+		complainx("%s: pwrite: short count", path);
+		exit(1);
+	}
+}
+
 static
 void
 dolseek(const char *name, int fd, off_t offset, int whence)
@@ -518,17 +556,14 @@ doforkall(const char *phasename, void (*func)(void))
 }
 
 static
-void
-seekmyplace(const char *name, int fd)
+off_t
+myplace(void)
 {
 	int keys_per, myfirst;
-	off_t offset;
 
 	keys_per = numkeys / numprocs;
 	myfirst = me*keys_per;
-	offset = myfirst * sizeof(int);
-
-	dolseek(name, fd, offset, SEEK_SET);
+	return myfirst * sizeof(int);
 }
 
 static
@@ -577,11 +612,12 @@ void
 genkeys_sub(void)
 {
 	int fd, i, mykeys, keys_done, keys_to_do, value;
+	off_t pos;
 
 	fd = doopen(PATH_KEYS, O_WRONLY, 0);
 
 	mykeys = getmykeys();
-	seekmyplace(PATH_KEYS, fd);
+	pos = myplace();
 
 	srandom(seeds[me]);
 	keys_done = 0;
@@ -606,7 +642,8 @@ genkeys_sub(void)
 			workspace[i] = value;
 		}
 
-		dowrite(PATH_KEYS, fd, workspace, keys_to_do*sizeof(int));
+		dopwrite(PATH_KEYS, fd, workspace, keys_to_do*sizeof(int), pos);
+		pos += keys_to_do*sizeof(int);
 		keys_done += keys_to_do;
 	}
 
@@ -675,11 +712,12 @@ bin(void)
 	const char *name;
 	int i, mykeys, keys_done, keys_to_do;
 	int key, pivot, binnum;
+	off_t pos;
 
 	infd = doopen(PATH_KEYS, O_RDONLY, 0);
 
 	mykeys = getmykeys();
-	seekmyplace(PATH_KEYS, infd);
+	pos = myplace();
 
 	for (i=0; i<numprocs; i++) {
 		name = binname(me, i);
@@ -695,8 +733,9 @@ bin(void)
 			keys_to_do = WORKNUM;
 		}
 
-		doexactread(PATH_KEYS, infd, workspace,
-			    keys_to_do * sizeof(int));
+		dopread(PATH_KEYS, infd, workspace,
+			keys_to_do * sizeof(int), pos);
+		pos += keys_to_do * sizeof(int);
 
 		for (i=0; i<keys_to_do; i++) {
 			key = workspace[i];
@@ -742,12 +781,11 @@ sortbins(void)
 		}
 
 		fd = doopen(name, O_RDWR, 0);
-		doexactread(name, fd, workspace, binsize);
+		dopread(name, fd, workspace, binsize, 0);
 
 		sortints(workspace, binsize/sizeof(int));
 
-		dolseek(name, fd, 0, SEEK_SET);
-		dowrite(name, fd, workspace, binsize);
+		dopwrite(name, fd, workspace, binsize, 0);
 		doclose(name, fd);
 	}
 }
@@ -1002,12 +1040,13 @@ dovalidate(void)
 	const char *name;
 	int fd, i, mykeys, keys_done, keys_to_do;
 	int key, smallest, largest;
+	off_t pos;
 
 	name = PATH_SORTED;
 	fd = doopen(name, O_RDONLY, 0);
 
 	mykeys = getmykeys();
-	seekmyplace(name, fd);
+	pos = myplace();
 
 	smallest = RANDOM_MAX;
 	largest = 0;
@@ -1019,7 +1058,8 @@ dovalidate(void)
 			keys_to_do = WORKNUM;
 		}
 
-		doexactread(name, fd, workspace, keys_to_do * sizeof(int));
+		dopread(name, fd, workspace, keys_to_do * sizeof(int), pos);
+		pos += keys_to_do * sizeof(int);
 
 		for (i=0; i<keys_to_do; i++) {
 			key = workspace[i];
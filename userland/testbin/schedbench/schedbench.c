@@ -0,0 +1,189 @@
+/*
+ * schedbench.c
+ *
+ * Interactive latency under CPU load.
+ *
+ * For each load level, starts that many copies of /testbin/hog and,
+ * while they run, times a stream of one-character writes to the
+ * console. Each write has to wait for the console interrupt, so it
+ * measures how quickly an I/O-bound thread gets the cpu back after a
+ * wakeup, which is what a user typing at sh sees as echo latency.
+ *
+ * One CSV line is printed per load level:
+ *
+ *     label,bench,param,samples,p50_ns,p90_ns,p99_ns,max_ns
+ *
+ * where param is the number of hogs. "label" is the first argument,
+ * as in sysbench. The probe's characters appear on their own line
+ * before each CSV line; use grep , to pick out the results.
+ *
+ * Usage: schedbench [label [nhogs ...]]
+ *
+ * With no load levels given, 0, 1, 2 and 4 hogs are run.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+
+#define SAMPLES          200    /* echoes timed per load level */
+#define MAXHOGS          8
+
+#define HOG_PROG         "/testbin/hog"
+
+static const char *label = "unknown";
+static uint64_t samples[SAMPLES];
+
+static const unsigned defaultloads[] = { 0, 1, 2, 4 };
+static const unsigned numdefaultloads =
+	sizeof(defaultloads) / sizeof(defaultloads[0]);
+
+////////////////////////////////////////////////////////////
+// support code
+
+static
+uint64_t
+now_ns(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	if (__time(&secs, &nsecs) < 0) {
+		err(1, "__time");
+	}
+	return (uint64_t)secs * 1000000000ULL + nsecs;
+}
+
+static
+int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/*
+ * PCT'th percentile of the (sorted) samples.
+ */
+static
+uint64_t
+percentile(unsigned pct)
+{
+	unsigned ix;
+
+	ix = (SAMPLES * pct) / 100;
+	if (ix >= SAMPLES) {
+		ix = SAMPLES - 1;
+	}
+	return samples[ix];
+}
+
+static
+pid_t
+spawnhog(void)
+{
+	static char *hargv[2] = { (char *)"hog", NULL };
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		execv(HOG_PROG, hargv);
+		err(1, "%s", HOG_PROG);
+	}
+	return pid;
+}
+
+static
+void
+dowait(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		errx(1, "hog: Exit %d", WEXITSTATUS(status));
+	}
+}
+
+////////////////////////////////////////////////////////////
+// benchmark
+
+static
+void
+bench_echo(unsigned nhogs)
+{
+	pid_t pids[MAXHOGS];
+	uint64_t start;
+	unsigned i;
+
+	if (nhogs > MAXHOGS) {
+		errx(1, "At most %d hogs", MAXHOGS);
+	}
+
+	for (i=0; i<nhogs; i++) {
+		pids[i] = spawnhog();
+	}
+
+	for (i=0; i<SAMPLES; i++) {
+		start = now_ns();
+		if (write(STDOUT_FILENO, ".", 1) != 1) {
+			err(1, "write");
+		}
+		samples[i] = now_ns() - start;
+	}
+	if (write(STDOUT_FILENO, "\n", 1) != 1) {
+		err(1, "write");
+	}
+
+	for (i=0; i<nhogs; i++) {
+		dowait(pids[i]);
+	}
+
+	qsort(samples, SAMPLES, sizeof(samples[0]), cmp_u64);
+	printf("%s,echo_latency,%u,%u,%llu,%llu,%llu,%llu\n", label, nhogs,
+	       SAMPLES,
+	       (unsigned long long)percentile(50),
+	       (unsigned long long)percentile(90),
+	       (unsigned long long)percentile(99),
+	       (unsigned long long)samples[SAMPLES - 1]);
+}
+
+////////////////////////////////////////////////////////////
+// main
+
+int
+main(int argc, char *argv[])
+{
+	unsigned i;
+	int j;
+
+	if (argc > 1) {
+		label = argv[1];
+	}
+
+	printf("label,bench,param,samples,p50_ns,p90_ns,p99_ns,max_ns\n");
+
+	if (argc > 2) {
+		for (j=2; j<argc; j++) {
+			bench_echo(atoi(argv[j]));
+		}
+	}
+	else {
+		for (i=0; i<numdefaultloads; i++) {
+			bench_echo(defaultloads[i]);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,595 @@
+/*
+ * sysbench.c
+ *
+ * System call rate benchmarks with machine-readable output.
+ *
+ * Each benchmark runs a system call (or a short sequence of them) in a
+ * tight loop, times the loop with __time(), and prints one CSV line in
+ * the same format as vmbench:
+ *
+ *     label,bench,param,iters,total_ns,ns_per_op
+ *
+ * "label" is the first argument (e.g. the kernel config name, or
+ * "before"/"after" a change) so that runs can be concatenated and
+ * compared.
+ *
+ * Usage: sysbench [label [bench ...]]
+ *
+ * With no benchmark names, all benchmarks are run.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+#include <dirent.h>
+
+#define OPEN_ITERS       1000   /* iterations for open/close */
+#define FORK_ITERS       64     /* iterations for fork tests */
+#define FORK_FDS         64     /* descriptors held open for fork_fds */
+#define SLEEP_ITERS      50     /* iterations for nanosleep */
+#define SLEEP_NS         1000000 /* requested sleep, 1ms */
+
+#define OPEN_FILE        "con:"
+#define VEC_ITERS        1000   /* iterations for write_pair/writev_pair */
+#define VEC_FILE         "null:"
+#define COPY_MB          4      /* file size for copy_rw/copy_range */
+#define COPY_SRC         "sysbench.src"
+#define COPY_DST         "sysbench.dst"
+#define LS_ENTRIES       1000   /* files listed by ls_entry/ls_batch */
+#define LS_PASSES        4      /* listings of them per benchmark */
+#define PIPE_MB          64     /* data moved by pipe_stream */
+
+static const char *label = "unknown";
+
+////////////////////////////////////////////////////////////
+// support code
+
+static
+uint64_t
+now_ns(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	if (__time(&secs, &nsecs) < 0) {
+		err(1, "__time");
+	}
+	return (uint64_t)secs * 1000000000ULL + nsecs;
+}
+
+static
+void
+report(const char *bench, unsigned long param, unsigned long iters,
+       uint64_t start, uint64_t end)
+{
+	uint64_t total = end - start;
+
+	printf("%s,%s,%lu,%lu,%llu,%llu\n", label, bench, param, iters,
+	       (unsigned long long)total,
+	       (unsigned long long)(iters > 0 ? total / iters : 0));
+}
+
+static
+void
+dowait(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		errx(1, "child: Exit %d", WEXITSTATUS(status));
+	}
+}
+
+////////////////////////////////////////////////////////////
+// benchmarks
+
+/*
+ * open + close round trip. Each open creates an open-file object and
+ * each close destroys it again.
+ */
+static
+void
+bench_openclose(void)
+{
+	unsigned long i;
+	int fd;
+	uint64_t start, end;
+
+	start = now_ns();
+	for (i=0; i<OPEN_ITERS; i++) {
+		fd = open(OPEN_FILE, O_RDONLY);
+		if (fd < 0) {
+			err(1, "%s: open", OPEN_FILE);
+		}
+		if (close(fd) < 0) {
+			err(1, "%s: close", OPEN_FILE);
+		}
+	}
+	end = now_ns();
+	report("open_close", 0, OPEN_ITERS, start, end);
+}
+
+/*
+ * A record written as a header and a payload, the way printf-heavy
+ * tools emit it: two writes each, then one writev each. Writing to
+ * null: leaves just the cost of the system calls. param is the number
+ * of system calls per record.
+ */
+static char vec_header[16] = "record 0000000:";
+static char vec_payload[112];
+
+static
+void
+bench_writepair(void)
+{
+	unsigned long i;
+	int fd;
+	uint64_t start, end;
+
+	fd = open(VEC_FILE, O_WRONLY);
+	if (fd < 0) {
+		err(1, "%s: open", VEC_FILE);
+	}
+
+	start = now_ns();
+	for (i=0; i<VEC_ITERS; i++) {
+		if (write(fd, vec_header, sizeof(vec_header)) < 0 ||
+		    write(fd, vec_payload, sizeof(vec_payload)) < 0) {
+			err(1, "%s: write", VEC_FILE);
+		}
+	}
+	end = now_ns();
+	report("write_pair", 2, VEC_ITERS, start, end);
+
+	close(fd);
+}
+
+static
+void
+bench_writevpair(void)
+{
+	struct iovec iov[2];
+	unsigned long i;
+	int fd;
+	uint64_t start, end;
+
+	fd = open(VEC_FILE, O_WRONLY);
+	if (fd < 0) {
+		err(1, "%s: open", VEC_FILE);
+	}
+
+	iov[0].iov_base = vec_header;
+	iov[0].iov_len = sizeof(vec_header);
+	iov[1].iov_base = vec_payload;
+	iov[1].iov_len = sizeof(vec_payload);
+
+	start = now_ns();
+	for (i=0; i<VEC_ITERS; i++) {
+		if (writev(fd, iov, 2) != sizeof(vec_header) + sizeof(vec_payload)) {
+			err(1, "%s: writev", VEC_FILE);
+		}
+	}
+	end = now_ns();
+	report("writev_pair", 1, VEC_ITERS, start, end);
+
+	close(fd);
+}
+
+/*
+ * Copy a COPY_MB megabyte file, once through a user buffer with read
+ * and write and once with copy_file_range, which keeps the data in the
+ * kernel. Run from an SFS volume. iters is the size in MB, so
+ * ns_per_op is the time per MB and 1000000000/ns_per_op the MB/s.
+ */
+static char copybuf[4096];
+
+static
+void
+copy_setup(int *fromfd, int *tofd)
+{
+	unsigned long i;
+	int fd;
+
+	fd = open(COPY_SRC, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open", COPY_SRC);
+	}
+	for (i=0; i<COPY_MB * 1024 * 1024 / sizeof(copybuf); i++) {
+		if (write(fd, copybuf, sizeof(copybuf)) != sizeof(copybuf)) {
+			err(1, "%s: write", COPY_SRC);
+		}
+	}
+	close(fd);
+
+	*fromfd = open(COPY_SRC, O_RDONLY);
+	if (*fromfd < 0) {
+		err(1, "%s: open", COPY_SRC);
+	}
+	*tofd = open(COPY_DST, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (*tofd < 0) {
+		err(1, "%s: open", COPY_DST);
+	}
+}
+
+static
+void
+copy_cleanup(int fromfd, int tofd)
+{
+	close(fromfd);
+	close(tofd);
+	remove(COPY_SRC);
+	remove(COPY_DST);
+}
+
+static
+void
+bench_copyrw(void)
+{
+	int fromfd, tofd, len;
+	uint64_t start, end;
+
+	copy_setup(&fromfd, &tofd);
+
+	start = now_ns();
+	while ((len = read(fromfd, copybuf, sizeof(copybuf))) > 0) {
+		if (write(tofd, copybuf, len) != len) {
+			err(1, "%s: write", COPY_DST);
+		}
+	}
+	if (len < 0) {
+		err(1, "%s: read", COPY_SRC);
+	}
+	end = now_ns();
+	report("copy_rw", COPY_MB * 1024 * 1024, COPY_MB, start, end);
+
+	copy_cleanup(fromfd, tofd);
+}
+
+static
+void
+bench_copyrange(void)
+{
+	int fromfd, tofd, len;
+	uint64_t start, end;
+
+	copy_setup(&fromfd, &tofd);
+
+	start = now_ns();
+	while ((len = copy_file_range(fromfd, tofd, 1024 * 1024)) > 0) {
+		/* nothing */
+	}
+	if (len < 0) {
+		err(1, "copy_file_range");
+	}
+	end = now_ns();
+	report("copy_range", COPY_MB * 1024 * 1024, COPY_MB, start, end);
+
+	copy_cleanup(fromfd, tofd);
+}
+
+/*
+ * Listing a directory of LS_ENTRIES files with their sizes, as ls -l
+ * does: once the old way, with getdirentry and an open, fstat and close
+ * per entry, and once with getdirentries, which hands back the sizes
+ * with the names a buffer at a time. The files are made in the current
+ * directory. iters is the number of listings.
+ */
+static char lsbuf[16384];
+
+static
+void
+ls_setup(void)
+{
+	char name[32];
+	unsigned long i;
+	int fd;
+
+	for (i=0; i<LS_ENTRIES; i++) {
+		snprintf(name, sizeof(name), "sysbench.%04lu", i);
+		fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+		if (fd < 0) {
+			err(1, "%s: open", name);
+		}
+		close(fd);
+	}
+}
+
+static
+void
+ls_cleanup(void)
+{
+	char name[32];
+	unsigned long i;
+
+	for (i=0; i<LS_ENTRIES; i++) {
+		snprintf(name, sizeof(name), "sysbench.%04lu", i);
+		remove(name);
+	}
+}
+
+static
+void
+bench_lsentry(void)
+{
+	struct stat st;
+	unsigned long i;
+	uint64_t start, end;
+	int dirfd, fd, len;
+
+	ls_setup();
+
+	start = now_ns();
+	for (i=0; i<LS_PASSES; i++) {
+		dirfd = open(".", O_RDONLY);
+		if (dirfd < 0) {
+			err(1, ".: open");
+		}
+		while ((len = getdirentry(dirfd, lsbuf, sizeof(lsbuf)-1)) > 0) {
+			lsbuf[len] = 0;
+			fd = open(lsbuf, O_RDONLY);
+			if (fd < 0) {
+				err(1, "%s: open", lsbuf);
+			}
+			if (fstat(fd, &st) < 0) {
+				err(1, "%s: fstat", lsbuf);
+			}
+			close(fd);
+		}
+		if (len < 0) {
+			err(1, "getdirentry");
+		}
+		close(dirfd);
+	}
+	end = now_ns();
+	report("ls_entry", LS_ENTRIES, LS_PASSES, start, end);
+
+	ls_cleanup();
+}
+
+static
+void
+bench_lsbatch(void)
+{
+	unsigned long i;
+	uint64_t start, end;
+	int dirfd, len;
+
+	ls_setup();
+
+	start = now_ns();
+	for (i=0; i<LS_PASSES; i++) {
+		dirfd = open(".", O_RDONLY);
+		if (dirfd < 0) {
+			err(1, ".: open");
+		}
+		while ((len = getdirentries(dirfd, lsbuf, sizeof(lsbuf))) > 0) {
+			/* the sizes are already in lsbuf */
+		}
+		if (len < 0) {
+			err(1, "getdirentries");
+		}
+		close(dirfd);
+	}
+	end = now_ns();
+	report("ls_batch", LS_ENTRIES, LS_PASSES, start, end);
+
+	ls_cleanup();
+}
+
+/*
+ * Moving PIPE_MB through a pipe from a child to its parent, a 16K write
+ * and read at a time. iters is the size in MB, so 1000000000/ns_per_op
+ * is the MB/s.
+ */
+static
+void
+bench_pipestream(void)
+{
+	unsigned long total, i;
+	uint64_t start, end;
+	pid_t pid;
+	int fds[2], len;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	start = now_ns();
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		for (i=0; i<PIPE_MB * 1024 * 1024 / sizeof(lsbuf); i++) {
+			if (write(fds[1], lsbuf, sizeof(lsbuf)) != sizeof(lsbuf)) {
+				err(1, "pipe write");
+			}
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+
+	/* Ends when the child's write end goes away */
+	total = 0;
+	while ((len = read(fds[0], lsbuf, sizeof(lsbuf))) > 0) {
+		total += len;
+	}
+	if (len < 0) {
+		err(1, "pipe read");
+	}
+	dowait(pid);
+	end = now_ns();
+	close(fds[0]);
+
+	if (total != PIPE_MB * 1024 * 1024) {
+		errx(1, "pipe: got %lu bytes, sent %lu", total,
+		     (unsigned long)PIPE_MB * 1024 * 1024);
+	}
+	report("pipe_stream", PIPE_MB * 1024 * 1024, PIPE_MB, start, end);
+}
+
+/*
+ * fork + _exit + waitpid round trip. Each iteration creates and
+ * destroys a process.
+ */
+static
+void
+bench_forkexit(void)
+{
+	unsigned long i;
+	pid_t pid;
+	uint64_t start, end;
+
+	start = now_ns();
+	for (i=0; i<FORK_ITERS; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			_exit(0);
+		}
+		dowait(pid);
+	}
+	end = now_ns();
+	report("fork_exit_wait", 0, FORK_ITERS, start, end);
+}
+
+/*
+ * fork + _exit + waitpid with FORK_FDS descriptors open. The child
+ * closes one of them, so it gets its own copy of the descriptor table
+ * and takes a reference to every open file; exiting drops them all
+ * again. This is the cost of file reference counting at fork/exit.
+ */
+static
+void
+bench_forkfds(void)
+{
+	int fds[FORK_FDS];
+	unsigned long i;
+	pid_t pid;
+	uint64_t start, end;
+
+	for (i=0; i<FORK_FDS; i++) {
+		fds[i] = open(OPEN_FILE, O_RDONLY);
+		if (fds[i] < 0) {
+			err(1, "%s: open", OPEN_FILE);
+		}
+	}
+
+	start = now_ns();
+	for (i=0; i<FORK_ITERS; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			close(fds[0]);
+			_exit(0);
+		}
+		dowait(pid);
+	}
+	end = now_ns();
+	report("fork_fds", FORK_FDS, FORK_ITERS, start, end);
+
+	for (i=0; i<FORK_FDS; i++) {
+		close(fds[i]);
+	}
+}
+
+/*
+ * 1ms nanosleep. ns_per_op shows how long a short sleep really takes,
+ * which is bounded below by the length of a clock tick.
+ */
+static
+void
+bench_nanosleep(void)
+{
+	struct timespec ts;
+	unsigned long i;
+	uint64_t start, end;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = SLEEP_NS;
+
+	start = now_ns();
+	for (i=0; i<SLEEP_ITERS; i++) {
+		if (nanosleep(&ts, NULL) < 0) {
+			err(1, "nanosleep");
+		}
+	}
+	end = now_ns();
+	report("nanosleep", SLEEP_NS, SLEEP_ITERS, start, end);
+}
+
+////////////////////////////////////////////////////////////
+// main
+
+static const struct {
+	const char *name;
+	void (*func)(void);
+} benches[] = {
+	{ "open_close",     bench_openclose },
+	{ "write_pair",     bench_writepair },
+	{ "writev_pair",    bench_writevpair },
+	{ "copy_rw",        bench_copyrw },
+	{ "copy_range",     bench_copyrange },
+	{ "ls_entry",       bench_lsentry },
+	{ "ls_batch",       bench_lsbatch },
+	{ "pipe_stream",    bench_pipestream },
+	{ "fork_exit_wait", bench_forkexit },
+	{ "fork_fds",       bench_forkfds },
+	{ "nanosleep",      bench_nanosleep },
+};
+static const unsigned numbenches = sizeof(benches) / sizeof(benches[0]);
+
+static
+void
+runbench(const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<numbenches; i++) {
+		if (!strcmp(benches[i].name, name)) {
+			benches[i].func();
+			return;
+		}
+	}
+	errx(1, "No such benchmark %s", name);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned i;
+	int j;
+
+	if (argc > 1) {
+		label = argv[1];
+	}
+
+	printf("label,bench,param,iters,total_ns,ns_per_op\n");
+
+	if (argc > 2) {
+		for (j=2; j<argc; j++) {
+			runbench(argv[j]);
+		}
+	}
+	else {
+		for (i=0; i<numbenches; i++) {
+			benches[i].func();
+		}
+	}
+
+	return 0;
+}
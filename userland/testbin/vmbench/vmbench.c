@@ -0,0 +1,355 @@
+/*
+ * vmbench.c
+ *
+ * VM microbenchmarks with machine-readable output.
+ *
+ * Unlike huge, matmult, parallelvm and friends, which only say whether
+ * the VM system works, this program measures how fast it is. Every
+ * measurement is timed with __time() and printed as one CSV line:
+ *
+ *     label,bench,param,iters,total_ns,ns_per_op
+ *
+ * where "label" is the first argument (use the kernel config name,
+ * e.g. DUMBVM, GENERIC, GENERIC-OPT) so that the output of runs on
+ * different kernels can be concatenated and diffed.
+ *
+ * Usage: vmbench [label [max-working-set-in-KB]]
+ *
+ * The working-set sweep doubles from WS_MIN_KB up to the maximum
+ * (default WS_MAX_KB), which should be set larger than the RAM
+ * configured in sys161.conf so that the sweep crosses into swap.
+ *
+ * Note: our sbrk only accepts page-multiple increments, so all heap
+ * regions here are whole pages.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+/*
+ * Caution: OS/161 doesn't provide any way to get this properly from
+ * the kernel.
+ */
+#define PAGE_SIZE 4096
+
+#define WS_MIN_KB        256
+#define WS_MAX_KB        8192
+
+#define SBRK_PAGES       256    /* pages for the sbrk growth test */
+#define FORK_ITERS       32     /* iterations for fork tests */
+#define REFAULT_PAGES    64     /* pages re-touched after eviction */
+#define RANDOM_SEED      161    /* fixed so runs are comparable */
+
+#define EXEC_PROG        "/bin/true"
+
+static const char *label = "unknown";
+
+////////////////////////////////////////////////////////////
+// support code
+
+static
+uint64_t
+now_ns(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	if (__time(&secs, &nsecs) < 0) {
+		err(1, "__time");
+	}
+	return (uint64_t)secs * 1000000000ULL + nsecs;
+}
+
+static
+void
+report(const char *bench, unsigned long param, unsigned long iters,
+       uint64_t start, uint64_t end)
+{
+	uint64_t total = end - start;
+
+	printf("%s,%s,%lu,%lu,%llu,%llu\n", label, bench, param, iters,
+	       (unsigned long long)total,
+	       (unsigned long long)(iters > 0 ? total / iters : 0));
+}
+
+static
+char *
+grow(unsigned long npages)
+{
+	void *p;
+
+	p = sbrk(npages * PAGE_SIZE);
+	if (p == (void *)-1) {
+		err(1, "sbrk(%lu pages)", npages);
+	}
+	return p;
+}
+
+static
+void
+shrink(unsigned long npages)
+{
+	if (sbrk(-(__intptr_t)(npages * PAGE_SIZE)) == (void *)-1) {
+		err(1, "sbrk(-%lu pages)", npages);
+	}
+}
+
+static
+void
+touch_seq(volatile char *base, unsigned long npages)
+{
+	unsigned long i;
+
+	for (i=0; i<npages; i++) {
+		base[i * PAGE_SIZE] = (char)i;
+	}
+}
+
+static
+void
+dowait(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		errx(1, "child: Exit %d", WEXITSTATUS(status));
+	}
+}
+
+////////////////////////////////////////////////////////////
+// benchmarks
+
+/*
+ * Latency of the first touch of freshly sbrk'd pages.
+ */
+static
+void
+bench_firsttouch(unsigned long npages)
+{
+	char *base;
+	uint64_t start, end;
+
+	base = grow(npages);
+	start = now_ns();
+	touch_seq(base, npages);
+	end = now_ns();
+	report("fault_first_touch", npages, npages, start, end);
+	shrink(npages);
+}
+
+/*
+ * Latency of faulting pages back in after they were pushed out by
+ * touching a working set of WSPAGES. Only meaningful when the working
+ * set is larger than RAM.
+ */
+static
+void
+bench_refault(unsigned long wspages)
+{
+	char *base;
+	unsigned long n;
+	uint64_t start, end;
+
+	n = wspages < REFAULT_PAGES ? wspages : REFAULT_PAGES;
+
+	base = grow(wspages);
+	touch_seq(base, wspages);
+	start = now_ns();
+	touch_seq(base, n);
+	end = now_ns();
+	report("fault_refault", wspages, n, start, end);
+	shrink(wspages);
+}
+
+/*
+ * Write-after-fork latency: the child writes every page of a region
+ * the parent had already touched. With a copy-on-write VM this is the
+ * COW fault cost; with an eager as_copy it is the plain TLB fault
+ * cost and the difference shows up in fork latency instead.
+ */
+static
+void
+bench_cow(unsigned long npages)
+{
+	char *base;
+	pid_t pid;
+	uint64_t start, end;
+
+	base = grow(npages);
+	touch_seq(base, npages);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		start = now_ns();
+		touch_seq(base, npages);
+		end = now_ns();
+		report("fault_cow", npages, npages, start, end);
+		_exit(0);
+	}
+	dowait(pid);
+	shrink(npages);
+}
+
+/*
+ * Cost of growing the heap one page at a time.
+ */
+static
+void
+bench_sbrk(void)
+{
+	unsigned long i;
+	uint64_t start, end;
+
+	start = now_ns();
+	for (i=0; i<SBRK_PAGES; i++) {
+		grow(1);
+	}
+	end = now_ns();
+	report("sbrk_grow", PAGE_SIZE, SBRK_PAGES, start, end);
+
+	start = now_ns();
+	for (i=0; i<SBRK_PAGES; i++) {
+		shrink(1);
+	}
+	end = now_ns();
+	report("sbrk_shrink", PAGE_SIZE, SBRK_PAGES, start, end);
+}
+
+/*
+ * fork + _exit + waitpid round trip.
+ */
+static
+void
+bench_forkexit(void)
+{
+	unsigned long i;
+	pid_t pid;
+	uint64_t start, end;
+
+	start = now_ns();
+	for (i=0; i<FORK_ITERS; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			_exit(0);
+		}
+		dowait(pid);
+	}
+	end = now_ns();
+	report("fork_exit_wait", 0, FORK_ITERS, start, end);
+}
+
+/*
+ * fork + execv + waitpid round trip.
+ */
+static
+void
+bench_forkexec(void)
+{
+	char *args[2];
+	unsigned long i;
+	pid_t pid;
+	uint64_t start, end;
+
+	args[0] = (char *)EXEC_PROG;
+	args[1] = NULL;
+
+	start = now_ns();
+	for (i=0; i<FORK_ITERS; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			execv(EXEC_PROG, args);
+			_exit(1);
+		}
+		dowait(pid);
+	}
+	end = now_ns();
+	report("fork_exec_wait", 0, FORK_ITERS, start, end);
+}
+
+/*
+ * Sequential versus random touch throughput over a working set of
+ * WSPAGES. Each pass touches every page once (random order is drawn
+ * with replacement, so it is the same number of touches).
+ */
+static
+void
+bench_touch(unsigned long wspages)
+{
+	volatile char *base;
+	unsigned long i;
+	uint64_t start, end;
+
+	base = grow(wspages);
+	/* populate, so both passes measure steady state */
+	touch_seq(base, wspages);
+
+	start = now_ns();
+	touch_seq(base, wspages);
+	end = now_ns();
+	report("touch_seq", wspages, wspages, start, end);
+
+	start = now_ns();
+	for (i=0; i<wspages; i++) {
+		base[(random() % wspages) * PAGE_SIZE] = (char)i;
+	}
+	end = now_ns();
+	report("touch_random", wspages, wspages, start, end);
+
+	shrink(wspages);
+}
+
+////////////////////////////////////////////////////////////
+// main
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long maxkb = WS_MAX_KB;
+	unsigned long kb, pages;
+
+	if (argc > 1) {
+		label = argv[1];
+	}
+	if (argc > 2) {
+		maxkb = atoi(argv[2]);
+		if (maxkb < WS_MIN_KB) {
+			errx(1, "Usage: vmbench [label [max-working-set-KB]]");
+		}
+	}
+
+	srandom(RANDOM_SEED);
+
+	printf("label,bench,param,iters,total_ns,ns_per_op\n");
+
+	bench_firsttouch(WS_MIN_KB * 1024 / PAGE_SIZE);
+	bench_cow(WS_MIN_KB * 1024 / PAGE_SIZE);
+	bench_sbrk();
+	bench_forkexit();
+	bench_forkexec();
+
+	for (kb = WS_MIN_KB; kb <= maxkb; kb *= 2) {
+		pages = kb * 1024 / PAGE_SIZE;
+		bench_touch(pages);
+		bench_refault(pages);
+	}
+
+	return 0;
+}